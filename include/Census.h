@@ -0,0 +1,105 @@
+/*
+* Random soup census: runs many random soups to stabilisation on all cores
+* and counts the resulting objects by canonical form.
+*/
+
+#ifndef CENSUS_H
+#define CENSUS_H
+
+#include "World.h"
+#include "Objects.h"
+#include "Random.h"
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <unordered_map>
+
+class Census {
+private:
+    /**
+     * @brief Object counts of a batch of soups, handed from a worker to the collector.
+     */
+    struct Tally {
+        std::unordered_map<std::string, uint64_t> counts;
+        uint64_t soups = 0;
+        Tally* next = nullptr;
+    };
+
+    int soup_size; // Edge length of the random soup in cells.
+    int world_size; // Edge length of the torus the soup evolves in.
+    int threads;
+    long max_generations; // Soups not stable after this many generations are counted as unstable.
+    int max_period; // Maximum period searched when classifying objects.
+    Rule rule;
+    CounterRNG rng;
+
+    std::atomic<uint64_t> next_soup; // Index of the next soup to run, shared by all workers.
+    std::atomic<Tally*> pending; // Lock-free stack of finished batches, drained by the collector.
+    std::atomic<int> running_workers;
+
+    std::map<std::string, uint64_t> totals;
+    uint64_t soups_done = 0;
+
+    /**
+     * @brief Worker loop: takes soup indices until all soups are done and publishes its tallies in batches.
+     */
+    void worker(uint64_t soups);
+
+    /**
+     * @brief Push a batch onto the pending stack (compare and swap, no locks).
+     */
+    void publish(Tally* tally);
+
+    /**
+     * @brief Take all pending batches and merge them into the totals.
+     */
+    void collect();
+
+    /**
+     * @brief Write the current totals to the results file, sorted by frequency.
+     */
+    void write_results(const std::string& file_name, double seconds);
+
+    /**
+     * @brief Clear the world and fill the center with the soup of the given index.
+     */
+    void fill_soup(World& world, uint64_t index);
+
+    /**
+     * @brief Evolve the world until a grid state repeats.
+     *
+     * @return True if stable before max_generations.
+     */
+    bool run_to_stabilisation(World& world);
+
+    /**
+     * @brief Split the living cells into objects. Cells within a distance of two are linked,
+     * so that oscillators with disconnected phases (e.g. the toad) stay one object.
+     */
+    std::vector<CellList> segment(World& world);
+
+public:
+    /**
+     * @brief Construct a new Census.
+     *
+     * @param soup_size Edge length of the random soup.
+     * @param world_size Edge length of the torus the soup evolves in.
+     * @param seed Seed of the counter-based RNG. Soup i is always the same for a given seed.
+     * @param threads Number of worker threads.
+     * @param max_generations Generation limit per soup.
+     * @param rule The Life-like rule. Rules with B0 are rejected (std::invalid_argument).
+     */
+    Census(int soup_size, int world_size, uint64_t seed, int threads, long max_generations, const Rule& rule = Rule());
+
+    /**
+     * @brief Run the census and stream the tallies to a results file.
+     *
+     * @param soups Number of soups.
+     * @param file_name Results file, rewritten with the current totals after every report.
+     */
+    void run(uint64_t soups, const std::string& file_name);
+};
+
+#endif // CENSUS_H
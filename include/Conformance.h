@@ -0,0 +1,110 @@
+/*
+* Cross-engine conformance and throughput harness: every engine is run from the same seeds
+* on odd, non-power-of-two and degenerate (below 3 cells) sizes, and the state hash of every
+* generation is compared with the single-threaded scalar engine. The first divergent generation
+* and cell are reported, and the throughput of the engine is measured in the same run.
+*/
+
+#ifndef CONFORMANCE_H
+#define CONFORMANCE_H
+
+#include "World.h"
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+class Conformance {
+private:
+    /**
+     * @brief One start state: a size, a rule and how the world is filled.
+     */
+    struct Case {
+        int height;
+        int width;
+        Rule rule;
+        std::string fill; // "random" (density 0.3) or "patterns" (library patterns, one per 64 cells).
+        uint64_t seed;
+    };
+
+    // Outcome of one run.
+    enum class Result {
+        Passed,
+        Diverged,
+        Skipped // The engine could not be set up (e.g. no OpenCL device).
+    };
+
+    std::vector<Engine> engines;
+    std::vector<Case> cases;
+    std::vector<int> threads; // Worker counts the CPU engines are run with.
+    long generations;
+    std::vector<int> block_steps; // Generations per pass the blocked and OpenCL engines are run with.
+    std::string device; // OpenCL device (see DeviceSelection::parse), default device if empty.
+    bool adaptive; // Also run the adaptive engine selection, started on the scalar engine.
+    int skipped = 0; // Runs of the last run() that were skipped.
+
+    /**
+     * @brief Fill a new world with the start state of a case.
+     */
+    void fill(World& world, const Case& test);
+
+    /**
+     * @brief Hashes of the generations 0 to generations of the scalar engine (single-threaded, generic loop).
+     */
+    std::vector<uint64_t> reference_hashes(const Case& test);
+
+    /**
+     * @brief Print the first cell of a divergent generation, found by running the reference again.
+     */
+    void report_divergence(const Case& test, const World& world, long generation, std::ostream& out);
+
+    /**
+     * @brief Run an engine on a case and compare it with the reference.
+     *
+     * @param adaptive Start on the engine and let the adaptive selection switch between the engines.
+     * @param fixed Let the single-threaded scalar engine use FixedEngine at its sizes (reported as fixed).
+     * @param steps Generations per pass of the blocked and OpenCL engines.
+     * @return Whether all compared generations match, or Skipped if the engine is not available.
+     */
+    Result check(const Case& test, Engine engine, bool adaptive, bool fixed, int threads, int steps,
+               const std::vector<uint64_t>& reference, std::ostream& out);
+
+public:
+    /**
+     * @brief Construct a harness.
+     *
+     * @param engines Engines to compare with the scalar reference.
+     * @param sizes Sizes as height x width, e.g. "1x1" or "33x31".
+     * @param rules Rules of the cases.
+     * @param fills "random" and/or "patterns".
+     * @param seeds Seeds of every fill.
+     * @param threads Worker counts of the CPU engines.
+     * @param generations Generations per case.
+     * @param block_steps Generations per pass the blocked and OpenCL engines are run with, each
+     * one a run of its own (1 runs OpenCL through evolve, more through evolve_multi); their hashes
+     * are compared at the end of every pass.
+     * @param device OpenCL device of the opencl and split engines, default device if empty.
+     * @param adaptive Also run the adaptive engine selection, switching between scalar, lookup, blocked
+     * and (if opencl is among the engines) OpenCL.
+     * Throws std::invalid_argument for malformed sizes.
+     */
+    Conformance(const std::vector<Engine>& engines, const std::vector<std::string>& sizes,
+                const std::vector<Rule>& rules, const std::vector<std::string>& fills,
+                const std::vector<uint64_t>& seeds, const std::vector<int>& threads,
+                long generations, const std::vector<int>& block_steps, const std::string& device = "", bool adaptive = false);
+
+    /**
+     * @brief Run all engines on all cases, one line per run. Scalar also gets a fixed row at the FixedEngine sizes.
+     *
+     * @return Number of runs that diverged from the reference (skipped runs are counted by skipped_runs).
+     */
+    int run(std::ostream& out);
+
+    /**
+     * @brief Runs of the last run that were skipped because their engine could not be set up.
+     */
+    int skipped_runs() const { return skipped; }
+};
+
+#endif // CONFORMANCE_H
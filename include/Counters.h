@@ -0,0 +1,152 @@
+/*
+* Hardware performance counters of the engine steps, read with perf_event_open (Linux).
+* Every thread that computes a step (the calling thread and the workers of the CPU engines) counts
+* cycles, instructions and last level cache misses of its own user-space code. The counts are summed
+* per generation and per thread, memory traffic is estimated as one cache line per last level miss.
+* Counters the kernel refuses (perf_event_paranoid, virtual machines without PMU) are reported as unavailable.
+* The OpenCL engines are only measured on the host, the device work is not counted.
+*/
+
+#ifndef COUNTERS_H
+#define COUNTERS_H
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+enum class Counter {
+    Cycles = 0,
+    Instructions = 1,
+    CacheMisses = 2 // Last level cache misses.
+};
+
+static const int COUNTER_KINDS = 3;
+
+/**
+ * @brief Counter values, scaled for the time the kernel multiplexed the counters out. 0 if unavailable.
+ */
+struct CounterValues {
+    double counts[COUNTER_KINDS] = {0, 0, 0};
+
+    double operator[](Counter counter) const { return counts[(int)counter]; }
+    void add(const CounterValues& other);
+};
+
+/**
+ * @brief Counters of one step (one generation, or block_steps generations of the blocked and OpenCL passes).
+ */
+struct GenerationCounters {
+    long generation; // Generation after the step.
+    long steps; // Generations the step computed.
+    double seconds; // Wall time of the step.
+    CounterValues values; // Summed over the threads.
+};
+
+/**
+ * @brief Metrics derived from counter values.
+ */
+struct CounterMetrics {
+    double cells_per_cycle = 0; // Cell updates per cycle (summed over the threads).
+    double instructions_per_cycle = 0;
+    double bytes = 0; // Estimated memory traffic: cache misses times cache line size.
+    double bandwidth = 0; // Bytes per wall second.
+    double peak_fraction = 0; // Of the peak bandwidth, 0 if the peak is unknown.
+};
+
+class StepCounters {
+private:
+    // The counters of one thread, opened by that thread.
+    struct ThreadCounters {
+        std::thread::id owner;
+        int fds[COUNTER_KINDS];
+        uint64_t start[COUNTER_KINDS][3]; // Value, time enabled, time running at start.
+
+        ThreadCounters(const bool* enabled);
+        ~ThreadCounters();
+        void begin();
+        CounterValues end();
+    };
+
+    long cells; // Cells of the world, each updated once per generation.
+    bool enabled[COUNTER_KINDS];
+    std::vector<std::unique_ptr<ThreadCounters> > counters; // By thread index, 0 is the calling thread.
+    std::vector<CounterValues> step_values; // Of every thread in the running step.
+    std::vector<CounterValues> thread_values; // Of every thread since the last reset.
+    GenerationCounters totals; // Sum of the steps since the last reset, with the generation of the last one.
+    GenerationCounters slowest; // Step with the most cycles per generation (steps 0 if none).
+    std::chrono::steady_clock::time_point step_begin;
+
+public:
+    /**
+     * @brief Probe which counters can be opened.
+     *
+     * @param cells Cells of the world.
+     */
+    StepCounters(long cells);
+
+    ~StepCounters();
+
+    /**
+     * @brief Whether the kernel grants a counter.
+     */
+    bool available(Counter counter) const { return enabled[(int)counter]; }
+
+    /**
+     * @brief Start a step computed by the given number of threads.
+     */
+    void begin_step(int threads);
+
+    /**
+     * @brief Start and stop the counters of a thread, called by the thread itself (its index is fixed
+     * for the step). Different threads can call these concurrently.
+     */
+    void start(int thread);
+    void stop(int thread);
+
+    /**
+     * @brief Finish a step and add it to the totals (the steps are not kept, only the slowest one).
+     *
+     * @param generation Generation after the step.
+     * @param generations Generations the step computed.
+     */
+    void end_step(long generation, long generations);
+
+    void reset();
+
+    /**
+     * @brief The step with the most cycles per generation since the last reset (steps 0 if none).
+     */
+    const GenerationCounters& getSlowest() const { return slowest; }
+
+    /**
+     * @brief Counter values of every thread (by index, 0 is the calling thread) since the last reset.
+     */
+    const std::vector<CounterValues>& getThreads() const { return thread_values; }
+
+    /**
+     * @brief Sum of the steps since the last reset, with the generation of the last one.
+     */
+    const GenerationCounters& total() const { return totals; }
+
+    /**
+     * @brief Metrics of one or more steps.
+     *
+     * @param peak_bandwidth Peak memory bandwidth in bytes per second, 0 if unknown.
+     */
+    CounterMetrics metrics(const GenerationCounters& step, double peak_bandwidth) const;
+
+    /**
+     * @brief Size of a cache line of the host.
+     */
+    static size_t line_size();
+
+    /**
+     * @brief Copy bandwidth of the host with one thread per cpu (bytes read and written per second),
+     * measured once on a buffer much larger than the caches.
+     */
+    static double peak_bandwidth();
+};
+
+#endif // COUNTERS_H
@@ -0,0 +1,135 @@
+/*
+* Resident simulation server: keeps worlds (with their engines, OpenCL contexts and buffers) alive between
+* jobs and takes commands over a Unix domain socket.
+*
+* Binary protocol, all integers little-endian, strings as u16 length and bytes:
+*   request:  u32 size (of the rest), u8 command, u32 world, payload
+*   response: u32 size (of the rest), u8 status (0 ok, 1 error), payload (the message on error)
+* Commands and their payloads (request -> response):
+*   CREATE   i32 height, i32 width, str engine, str rule -> u32 world
+*   LOAD     str engine, str safestate (in configurations/, as for the CLI) -> u32 world
+*   STEP     i64 generations -> i64 generation
+*   QUERY    i32 y, i32 x, i32 rows, i32 columns -> i64 generation, cells
+*   SET      i32 y, i32 x, i32 rows, i32 columns, cells -> (empty)
+*   STATS    -> i64 generation, u64 population, i32 min x, min y, max x, max y (-1 if empty), str engine
+*   SNAPSHOT str name -> (empty), saved like the CLI save (configurations/<name>.txt)
+*   DESTROY  -> (empty)
+* Cells are 1 bit per cell, row-major, every row padded to whole bytes, bit i of byte j is column 8 * j + i.
+* CREATE and LOAD ignore the world field. File names of LOAD and SNAPSHOT must not contain '/' or "..".
+*
+* Every connection is served by its own thread. Commands on different worlds run concurrently,
+* commands on the same world one after the other.
+*/
+
+#ifndef DAEMON_H
+#define DAEMON_H
+
+#include "World.h"
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum class DaemonCommand : uint8_t {
+    Create = 1,
+    Load = 2,
+    Step = 3,
+    Query = 4,
+    Set = 5,
+    Stats = 6,
+    Snapshot = 7,
+    Destroy = 8
+};
+
+class Daemon {
+private:
+    // A world and the lock that serializes the commands on it.
+    struct Resident {
+        std::mutex mutex;
+        World world;
+
+        Resident(int height, int width) : world(height, width) { }
+        explicit Resident(std::string& file_name) : world(file_name) { }
+    };
+
+    struct Connection {
+        int socket;
+        std::thread thread;
+        std::atomic<bool> done{false};
+    };
+
+    // Requests above this size close the connection.
+    static const uint32_t MAX_REQUEST = 1u << 30;
+
+    std::string socket_path;
+    int threads; // CPU engine threads of every world.
+    int listener = -1;
+    std::atomic<bool> stopping{false};
+
+    std::mutex worlds_mutex; // Guards worlds and next_world, not the worlds themselves.
+    std::map<uint32_t, std::shared_ptr<Resident> > worlds;
+    uint32_t next_world = 1;
+
+    std::list<Connection> connections; // Only touched by the accept loop.
+    std::mutex sockets_mutex; // Guards the sockets of connections against stop.
+
+    /**
+     * @brief Read requests from a client and answer them until it disconnects.
+     */
+    void serve(Connection& connection);
+
+    /**
+     * @brief Execute one command. Throws std::exception subclasses for failed commands.
+     *
+     * @return The payload of the response.
+     */
+    std::vector<uint8_t> handle(DaemonCommand command, uint32_t world, const std::vector<uint8_t>& request);
+
+    /**
+     * @brief Add a world (engine set up, threads started) and return its id.
+     */
+    uint32_t add(std::shared_ptr<Resident> resident, const std::string& engine);
+
+    /**
+     * @brief A world by id. Throws std::invalid_argument if there is none.
+     */
+    std::shared_ptr<Resident> find(uint32_t world);
+
+public:
+    /**
+     * @brief Create the socket (replacing a stale socket file) and listen.
+     * Throws std::runtime_error if the socket can't be created.
+     *
+     * @param socket_path Path of the Unix domain socket.
+     * @param threads CPU engine threads of every world.
+     */
+    Daemon(const std::string& socket_path, int threads);
+
+    /**
+     * @brief Close the socket and remove the socket file.
+     */
+    ~Daemon();
+
+    /**
+     * @brief Accept and serve clients until stop is called, then close all connections.
+     */
+    void run();
+
+    /**
+     * @brief Make run return within a fraction of a second. Async-signal-safe.
+     */
+    void stop();
+
+    /**
+     * @brief Number of resident worlds.
+     */
+    size_t world_count();
+};
+
+#endif // DAEMON_H
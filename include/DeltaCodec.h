@@ -0,0 +1,48 @@
+/*
+* Compact coding of the difference between two generations, shared by the history ring and the delta log.
+* A delta is the XOR of two grids (the cells that were born or died), stored as pairs of varints:
+* the number of unchanged cells, then the number of changed cells, from the first cell on.
+* Trailing unchanged cells are not stored, so a still life costs zero bytes.
+*/
+
+#ifndef DELTACODEC_H
+#define DELTACODEC_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief Append a varint (7 bits per byte, high bit = more bytes follow).
+ */
+void put_varint(std::vector<uint8_t>& out, uint64_t value);
+
+/**
+ * @brief Read a varint and advance the pointer.
+ *
+ * @return False if the data ends inside the varint.
+ */
+bool get_varint(const uint8_t*& data, const uint8_t* end, uint64_t& value);
+
+/**
+ * @brief Append the delta from previous to current.
+ *
+ * @param previous The older grid, or NULL for an empty grid (the delta is then a keyframe).
+ * @param current The newer grid.
+ * @param cells Number of cells of both grids.
+ * @param out Receives the coded delta.
+ */
+void encode_delta(const bool* previous, const bool* current, size_t cells, std::vector<uint8_t>& out);
+
+/**
+ * @brief Flip the changed cells of a delta, turning the older grid into the newer one.
+ * Throws std::runtime_error if the delta is corrupt or doesn't fit the grid.
+ *
+ * @param data The coded delta.
+ * @param size Bytes of the coded delta.
+ * @param cells The grid (the older generation, or an empty grid for a keyframe).
+ * @param count Number of cells of the grid.
+ */
+void apply_delta(const uint8_t* data, size_t size, bool* cells, size_t count);
+
+#endif // DELTACODEC_H
@@ -0,0 +1,192 @@
+/*
+* Append-only log of generations for offline replay.
+* The file starts with a header (magic, version, height, width, keyframe interval), followed by frames:
+* a kind byte (keyframe or delta), the generation and the size as varints, then the delta (see DeltaCodec.h)
+* against the previous frame or, for keyframes, against an empty grid. Every keyframe starts a run of
+* consecutive generations. On close the seek index (first generation, offset and length of every run)
+* is appended, with its offset and a magic at the very end. A log without index (the writer didn't close)
+* is scanned instead. A run recorded after a seek replaces the generations from its first one on.
+*/
+
+#ifndef DELTALOG_H
+#define DELTALOG_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// One run of the seek index.
+struct LogRun {
+    long generation; // Generation of the keyframe.
+    uint64_t offset; // File offset of the keyframe.
+    long frames; // Consecutive generations, the keyframe included.
+};
+
+class DeltaLogWriter {
+private:
+    struct Snapshot {
+        long generation;
+        std::unique_ptr<bool[]> cells;
+    };
+    // Recorded grids waiting for the encoder, record blocks when there are more.
+    static const size_t MAX_PENDING = 8;
+
+    int width;
+    int height;
+    size_t cells;
+    int keyframe_interval;
+
+    // Shared with the encoder thread, guarded by mutex.
+    std::deque<Snapshot> pending;
+    std::vector<std::unique_ptr<bool[]> > free_buffers;
+    bool busy = false; // The encoder is coding a snapshot.
+    bool stop = false;
+    std::string error; // First write error, reported by record and flush.
+    uint64_t bytes = 0; // Bytes written so far.
+    long frames = 0;
+    std::mutex mutex;
+    std::condition_variable changed;
+
+    // Owned by the encoder thread.
+    std::ofstream file;
+    std::unique_ptr<bool[]> last; // Grid of the newest frame.
+    long last_coded = -1; // Generation of last.
+    int since_keyframe = 0;
+    std::vector<LogRun> runs;
+    std::vector<uint8_t> buffer;
+
+    std::thread encoder;
+
+    void encoder_loop();
+
+    /**
+     * @brief Write bytes at the end of the file and count them.
+     */
+    void write(const std::vector<uint8_t>& data);
+
+    /**
+     * @brief Wait until all recorded grids are written, then throw std::runtime_error if a write failed.
+     * The lock has to be held.
+     */
+    void wait_idle(std::unique_lock<std::mutex>& lock);
+
+public:
+    /**
+     * @brief Create (or overwrite) a log file and start the encoder thread.
+     * Throws std::runtime_error if the file can't be created.
+     *
+     * @param file_name The log file.
+     * @param height Rows of the grids.
+     * @param width Columns of the grids.
+     * @param keyframe_interval Generations between two keyframes (at least 1), bounds the work of a seek.
+     */
+    DeltaLogWriter(const std::string& file_name, int height, int width, int keyframe_interval);
+
+    /**
+     * @brief Write the remaining grids and the seek index, and stop the encoder thread.
+     */
+    ~DeltaLogWriter();
+
+    /**
+     * @brief Record a generation. Copies the grid and returns, the grid is coded and written in the background.
+     * Throws std::runtime_error if an earlier write failed.
+     *
+     * @param generation The generation. A generation that doesn't follow the last one starts a new run.
+     * @param grid The grid.
+     */
+    void record(long generation, const bool* grid);
+
+    /**
+     * @brief Wait until all recorded grids are written and flush the file.
+     * Throws std::runtime_error if a write failed.
+     */
+    void flush();
+
+    /**
+     * @brief Number of written frames and bytes.
+     */
+    long frame_count();
+    uint64_t byte_count();
+};
+
+class DeltaLogReader {
+private:
+    std::ifstream file;
+    int width = 0;
+    int height = 0;
+    int keyframe_interval = 0;
+    uint64_t end = 0; // End of the frames (start of the index, or of an incomplete last frame).
+    std::vector<LogRun> runs; // In file order.
+    std::vector<long> visible_end; // Per run: end of its generations not replaced by a later run.
+    std::vector<uint8_t> data;
+
+    // The last reconstructed generation, continued from when replaying forward.
+    std::unique_ptr<bool[]> current;
+    long current_generation = -1;
+    size_t current_run = 0;
+    uint64_t next_offset = 0; // Offset of the frame after current_generation.
+
+    /**
+     * @brief Rebuild the runs by reading the frame headers, up to the first incomplete frame.
+     *
+     * @param begin Offset of the first frame.
+     * @param size Size of the file.
+     */
+    void scan(uint64_t begin, uint64_t size);
+
+    /**
+     * @brief Fill visible_end from the runs.
+     */
+    void resolve_runs();
+
+    /**
+     * @brief Read a frame at offset into data.
+     *
+     * @return The offset of the next frame.
+     */
+    uint64_t read_frame(uint64_t offset, bool& keyframe, long& generation);
+
+public:
+    /**
+     * @brief Open a log and load (or rebuild) its seek index.
+     * Throws std::runtime_error if the file can't be read or isn't a log.
+     *
+     * @param file_name The log file.
+     */
+    explicit DeltaLogReader(const std::string& file_name);
+
+    int getHeight() const { return height; }
+    int getWidth() const { return width; }
+
+    /**
+     * @brief The seek index, one entry per run in file order.
+     */
+    const std::vector<LogRun>& getRuns() const { return runs; }
+
+    /**
+     * @brief Lowest and highest recorded generation of the last timeline (-1 if the log is empty).
+     */
+    long first_generation() const;
+    long last_generation() const;
+
+    /**
+     * @brief Reconstruct a generation: from the keyframe of its run, or from the last reconstructed
+     * generation if that is earlier in the same run (replaying forward applies one delta per generation).
+     * Throws std::runtime_error if the log is corrupt.
+     *
+     * @param generation The generation.
+     * @param grid Receives the cells (height * width).
+     *
+     * @return False if the generation isn't in the log.
+     */
+    bool read(long generation, bool* grid);
+};
+
+#endif // DELTALOG_H
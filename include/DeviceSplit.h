@@ -0,0 +1,102 @@
+/*
+* Split of one world over several OpenCL devices (or sub-devices of one device).
+* Every device keeps a band of rows with one halo row above and below; after each step only the
+* halo rows are exchanged through the host, and the row counts follow the measured kernel times.
+* The host grid only gets the first and last row of every band per step, the whole bands are
+* downloaded when the host reads the grid (see World::sync_grid).
+*/
+
+#ifndef DEVICESPLIT_H
+#define DEVICESPLIT_H
+
+#include "OpenCLWrapper.h"
+
+#include <string>
+#include <vector>
+
+class World;
+
+class DeviceSplit {
+public:
+    // Number of generations between two rebalancing decisions.
+    static const int BALANCE_INTERVAL = 16;
+
+    /**
+     * @brief One device and the band of rows it computes.
+     */
+    struct Part {
+        std::string name;
+        cl_device_id device;
+        cl_context context;
+        cl_command_queue queue;
+        cl_program program;
+        cl_kernel kernel;
+        cl_mem buffer_band[2]; // rows + 2 rows (halo, band, halo), ping-pong.
+        int current = 0; // buffer_band[current] holds the current generation.
+        int capacity = 0; // Rows the buffers were allocated for.
+        int y_begin = 0; // First row of the band.
+        int rows = 0; // Rows of the band.
+        double seconds = 0; // Kernel time since the last rebalancing.
+    };
+
+    /**
+     * @brief Create contexts, kernels and buffers on all devices and split the rows evenly.
+     * A selection with sub_devices > 0 is partitioned with clCreateSubDevices, every sub-device is one part.
+     * Throws std::runtime_error if a device doesn't exist or the program doesn't build (with the build log),
+     * std::invalid_argument if there are more parts than rows.
+     *
+     * @param world The world, its rule and size are compiled into the kernels.
+     * @param selections The devices.
+     */
+    DeviceSplit(World& world, const std::vector<DeviceSelection>& selections);
+
+    ~DeviceSplit();
+
+    /**
+     * @brief Compute the next generation of the world into its back buffer and swap it with the grid.
+     */
+    void evolve();
+
+    /**
+     * @brief The host grid was changed, upload the whole bands before the next step.
+     */
+    void invalidate();
+
+    /**
+     * @brief Read the bands into the host grid if the steps only read back their edge rows (blocking).
+     */
+    void download();
+
+    /**
+     * @brief The parts with their current bands and kernel times.
+     */
+    const std::vector<Part>& getParts();
+
+private:
+    World& world;
+    std::vector<Part> parts;
+    std::vector<cl_device_id> sub_devices; // Created by clCreateSubDevices, released in the destructor.
+    bool resident = false; // The device bands hold the grid (only the halos have to be uploaded).
+    bool host_stale = false; // The host grid only holds the band edges of the current generation.
+    const bool* resident_grid = NULL; // Grid and generation after the last step, to notice other engines.
+    long resident_generation = -1;
+    long steps = 0; // Steps since the last rebalancing.
+
+    /**
+     * @brief Allocate the band buffers of a part for at least the given number of rows.
+     */
+    void allocate(Part& part, int rows);
+
+    /**
+     * @brief Set the bands to the given row counts (contiguous, in part order).
+     */
+    void assign_rows(const std::vector<int>& rows);
+
+    /**
+     * @brief Move rows to the faster devices, proportional to rows per kernel second.
+     * Only applied if a band changes by more than 2% of the height, so noise doesn't cause uploads.
+     */
+    void balance();
+};
+
+#endif // DEVICESPLIT_H
@@ -0,0 +1,127 @@
+/*
+* Adaptive engine selection: picks the fastest engine for the current state of a world while it runs.
+* Every interval generations the selector samples the density (live cells per cell), the activity (fraction
+* of the fingerprint tiles changed by the last step) and the measured step time of the running engine.
+* Density and activity select a regime. The first time a regime is seen (and again once its measurements
+* are stale), every other candidate engine runs for a short trial on the live world, and its step time is
+* stored for the regime. The world then moves to the engine with the lowest step time, but only if it is
+* faster by a margin and the last switch is a few samples back (hysteresis), so noise and regimes on the
+* edge of two buckets don't make it thrash. Every switch is logged.
+*/
+
+#ifndef ENGINESELECTOR_H
+#define ENGINESELECTOR_H
+
+#include <cstdint>
+#include <map>
+#include <utility>
+#include <vector>
+
+class World;
+enum class Engine;
+
+/**
+ * @brief Settings of the adaptive engine selection (see World::set_adaptive).
+ */
+struct AdaptiveOptions {
+    long interval = 256; // Generations between two samples.
+    long trial = 16; // Generations a candidate runs when it is measured (the first one is not timed).
+    double margin = 0.15; // Speedup the predicted engine needs over the running one to switch.
+    int dwell = 2; // Samples after a switch before the next switch.
+    long stale = 32; // Samples after which the measurements of a regime are repeated.
+    std::vector<Engine> engines; // Candidates, empty for scalar, lookup, blocked and (if initialized) OpenCL.
+};
+
+/**
+ * @brief A switch of the adaptive engine selection.
+ */
+struct EngineSwitch {
+    long generation;
+    Engine from;
+    Engine to;
+    double density; // Live cells per cell at the sample.
+    double activity; // Fraction of the tiles changed by the step before the sample.
+    double speedup; // Predicted: step time of from over step time of to.
+};
+
+class EngineSelector {
+private:
+    // Step time of an engine in a regime.
+    struct Cost {
+        double seconds; // Per generation.
+        long sample; // Sample it was measured at.
+    };
+
+    AdaptiveOptions options;
+    std::vector<Engine> candidates;
+    std::map<std::pair<int, int>, Cost> costs; // By regime and engine.
+    std::vector<EngineSwitch> log;
+
+    long samples = 0;
+    long next_sample; // Generation of the next sample.
+    long last_switch; // Sample of the last switch.
+    int regime = -1; // Of the last sample.
+    double density = 0;
+    double activity = 0;
+    std::vector<uint64_t> tiles; // Tile fingerprints before the last step of the interval.
+    long captured = -1; // Generation of tiles, -1 if not captured.
+
+    double seconds = 0; // Timed steps of the running engine since the last sample or trial start.
+    long generations = 0;
+    bool warm = false; // The first step after a change of engine is not timed (tables, uploads, page placement).
+
+    std::vector<Engine> trials; // Candidates still to be measured, the first one is running.
+    long trial_end = 0; // Generation the running trial ends.
+    Engine home; // Engine running before the trials.
+    long trial_count = 0;
+
+    static int regime_of(double density, double activity);
+
+    /**
+     * @brief Sample density, activity and the step time of the running engine, and start the trials
+     * of the regime or decide.
+     */
+    void sample(World& world);
+
+    void start_trial(World& world);
+
+    /**
+     * @brief Move to the fastest candidate of the regime if it beats the home engine by the margin,
+     * otherwise go back to the home engine.
+     */
+    void decide(World& world);
+
+    void use(World& world, Engine engine);
+
+public:
+    /**
+     * @brief Start with the current engine of the world, the first sample is one interval ahead.
+     */
+    EngineSelector(World& world, const AdaptiveOptions& options);
+
+    /**
+     * @brief Account a step of the engine and sample, measure or switch if it is time to.
+     *
+     * @param generations Generations of the step.
+     * @param seconds Wall time of the step.
+     */
+    void record(World& world, long generations, double seconds);
+
+    /**
+     * @brief Switches of the selection, in order (trials are not switches).
+     */
+    const std::vector<EngineSwitch>& switches() const { return log; }
+
+    /**
+     * @brief Density and activity at the last sample.
+     */
+    double getDensity() const { return density; }
+    double getActivity() const { return activity; }
+
+    /**
+     * @brief Candidates measured in trials so far.
+     */
+    long trial_runs() const { return trial_count; }
+};
+
+#endif // ENGINESELECTOR_H
@@ -0,0 +1,32 @@
+/*
+* Scalar engine specialised for fixed grid sizes.
+* Height, width and (for B3/S23) the rule are template parameters, so the torus wrap, the row strides and
+* the loop bounds are constants, and the rule is folded into the 8-cells-per-word update.
+* The sizes are set at build time (FIXED_WORLD_SIZES, pairs of height and width, e.g.
+* -DFIXED_WORLD_SIZES=64,64,96,96); worlds of other sizes use the generic scalar loop.
+*/
+
+#ifndef FIXEDENGINE_H
+#define FIXEDENGINE_H
+
+#include "Rule.h"
+
+// Default sizes: census soups and small test worlds.
+#ifndef FIXED_WORLD_SIZES
+#define FIXED_WORLD_SIZES 16, 16, 32, 32, 64, 64, 96, 96, 128, 128, 256, 256
+#endif
+
+/**
+ * @brief One generation of a grid of a fixed size: next receives the successor of grid (both height * width).
+ */
+typedef void (*FixedStep)(const bool* grid, bool* next, const Rule& rule);
+
+/**
+ * @brief The step compiled for a size and rule: B3/S23 with the rule folded in, other rules with the
+ * rule read at run time.
+ *
+ * @return NULL if the size isn't one of FIXED_WORLD_SIZES.
+ */
+FixedStep find_fixed_step(int height, int width, const Rule& rule);
+
+#endif // FIXEDENGINE_H
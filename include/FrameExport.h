@@ -0,0 +1,124 @@
+/*
+* Export of generations as images (binary PGM or PNG), for reports and videos.
+* The simulation only copies the grid of an exported generation (and keeps the cell ages if they are
+* shown); downscaling, colouring, compression and writing run on a set of encoder threads that take
+* the snapshots from a bounded queue, one image per thread at a time.
+* PNG images are compressed with a small deflate encoder (fixed Huffman codes, matches at the
+* previous pixel, the pixel above and the last position of the same three bytes), no zlib needed.
+*/
+
+#ifndef FRAMEEXPORT_H
+#define FRAMEEXPORT_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum class ImageFormat { PGM, PNG };
+
+struct ExportOptions {
+    ImageFormat format = ImageFormat::PNG;
+    int scale = 1; // Cells per pixel in both directions, a pixel shows the share of living cells.
+    bool ages = false; // Colour the living cells by the generations they have been alive (PNG palette, PGM grey).
+    long every = 1; // Export the generations that are multiples of every.
+    int threads = 0; // Encoder threads, 0 for one per hardware thread.
+};
+
+class FrameExporter {
+private:
+    struct Snapshot {
+        long generation;
+        std::unique_ptr<bool[]> cells;
+        std::unique_ptr<uint16_t[]> ages; // Only with options.ages.
+    };
+
+    std::string prefix;
+    int height;
+    int width;
+    size_t cells;
+    ExportOptions options;
+
+    // Owned by the simulation thread.
+    std::vector<uint16_t> ages; // Generations every cell has been alive (saturating), 0 if dead.
+    long aged_generation = -1; // Generation ages refers to.
+
+    // Shared with the encoder threads, guarded by mutex.
+    std::deque<Snapshot> pending;
+    std::vector<Snapshot> free_snapshots;
+    int busy = 0; // Encoders working on a snapshot.
+    bool stop = false;
+    std::string error; // First write error, reported by submit and flush.
+    long written = 0; // Images written.
+    std::mutex mutex;
+    std::condition_variable changed;
+
+    std::vector<std::thread> encoders;
+
+    void encoder_loop();
+
+    /**
+     * @brief Downscale (and colour) a snapshot into one byte per pixel: grey levels, or palette
+     * indices with options.ages and PNG.
+     */
+    void convert(const Snapshot& snapshot, std::vector<uint8_t>& pixels, int& image_height, int& image_width) const;
+
+    /**
+     * @brief Name of the image of a generation: prefix, the generation with 8 digits, extension.
+     */
+    std::string file_name(long generation) const;
+
+public:
+    /**
+     * @brief Start the encoder threads.
+     *
+     * @param prefix Path and name prefix of the images, e.g. frames/run.
+     * @param height Rows of the grids.
+     * @param width Columns of the grids.
+     * @param options Format, downscaling, age colouring, selection and threads.
+     */
+    FrameExporter(const std::string& prefix, int height, int width, const ExportOptions& options);
+
+    /**
+     * @brief Write the remaining images and stop the encoder threads.
+     */
+    ~FrameExporter();
+
+    /**
+     * @brief Hand over a generation. Updates the cell ages (if shown), and copies the grid if the generation
+     * is exported; blocks only while the queue is full. Throws std::runtime_error if an earlier write failed.
+     *
+     * @param generation The generation.
+     * @param grid The grid.
+     */
+    void submit(long generation, const bool* grid);
+
+    /**
+     * @brief Wait until all submitted images are written. Throws std::runtime_error if a write failed.
+     */
+    void flush();
+
+    /**
+     * @brief Number of written images.
+     */
+    long image_count();
+
+    /**
+     * @brief Encode one byte per pixel as a PNG file: greyscale, or with a palette of palette.size() / 3
+     * RGB entries.
+     */
+    static std::vector<uint8_t> encode_png(const std::vector<uint8_t>& pixels, int height, int width,
+                                           const std::vector<uint8_t>& palette);
+
+    /**
+     * @brief Encode greyscale pixels as a binary PGM (P5) file.
+     */
+    static std::vector<uint8_t> encode_pgm(const std::vector<uint8_t>& pixels, int height, int width);
+};
+
+#endif // FRAMEEXPORT_H
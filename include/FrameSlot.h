@@ -0,0 +1,77 @@
+/*
+* Lock-free handoff of the latest generation from one producer (simulation) to one consumer (display).
+* A triple buffer: the producer and the consumer each own one frame, the third frame is exchanged
+* through an atomic index. The producer never waits, the consumer always gets the newest frame
+* and frames it didn't take in time are overwritten (skipped).
+*/
+
+#ifndef FRAMESLOT_H
+#define FRAMESLOT_H
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+class FrameSlot {
+private:
+    struct Frame {
+        std::unique_ptr<bool[]> cells;
+        long generation = -1;
+    };
+    // Set in exchange while it holds a frame the consumer hasn't taken yet.
+    static const int FRESH = 4;
+
+    Frame frames[3];
+    std::atomic<int> exchange{2}; // Index of the exchanged frame, plus FRESH.
+    int write_index = 0; // Owned by the producer.
+    int read_index = 1; // Owned by the consumer.
+
+public:
+    /**
+     * @brief Allocate the three frames.
+     *
+     * @param cells Cells per frame (the size of the grid).
+     */
+    explicit FrameSlot(size_t cells) {
+        for (Frame& frame : frames) frame.cells.reset(new bool[cells]());
+    }
+
+    /**
+     * @brief Producer: the frame to fill before publish.
+     */
+    bool* write_buffer() { return frames[write_index].cells.get(); }
+
+    /**
+     * @brief Producer: hand the filled frame to the consumer and continue with the exchanged one.
+     *
+     * @param generation The generation of the frame.
+     */
+    void publish(long generation) {
+        frames[write_index].generation = generation;
+        // Release: the cells are visible to the consumer that takes the index.
+        write_index = exchange.exchange(write_index | FRESH, std::memory_order_acq_rel) & ~FRESH;
+    }
+
+    /**
+     * @brief Consumer: take the newest published frame, if there is one it doesn't have yet.
+     *
+     * @return Whether a new frame was taken (see cells and generation).
+     */
+    bool acquire() {
+        if (!(exchange.load(std::memory_order_relaxed) & FRESH)) return false;
+        read_index = exchange.exchange(read_index, std::memory_order_acq_rel) & ~FRESH;
+        return true;
+    }
+
+    /**
+     * @brief Consumer: cells of the taken frame, valid until the next acquire.
+     */
+    const bool* cells() const { return frames[read_index].cells.get(); }
+
+    /**
+     * @brief Consumer: generation of the taken frame (-1 before the first frame).
+     */
+    long generation() const { return frames[read_index].generation; }
+};
+
+#endif // FRAMESLOT_H
@@ -0,0 +1,123 @@
+/*
+* History of past generations for rewinding: every keyframe_interval generations a keyframe,
+* in between XOR deltas to the previous generation (see DeltaCodec.h).
+* The grids are coded on a background thread, the simulation only copies the grid.
+*/
+
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class History {
+private:
+    struct Frame {
+        long generation;
+        bool keyframe; // Coded against an empty grid instead of the previous generation.
+        std::vector<uint8_t> data;
+    };
+    struct Snapshot {
+        long generation;
+        std::unique_ptr<bool[]> cells;
+    };
+    // Recorded grids waiting for the encoder, record blocks when there are more.
+    static const size_t MAX_PENDING = 8;
+
+    size_t cells;
+    int keyframe_interval;
+    size_t max_bytes;
+
+    // Shared with the encoder thread, guarded by mutex.
+    std::deque<Frame> frames; // Ascending generations, the first one and every one after a gap is a keyframe.
+    size_t bytes = 0; // Coded bytes of all frames.
+    std::deque<Snapshot> pending;
+    std::vector<std::unique_ptr<bool[]> > free_buffers;
+    bool busy = false; // The encoder is coding a snapshot.
+    bool restart = false; // The next frame has to be a keyframe (after truncate).
+    bool stop = false;
+    std::mutex mutex;
+    std::condition_variable changed;
+
+    // Owned by the encoder thread.
+    std::unique_ptr<bool[]> last; // Grid of the newest frame.
+    long last_coded = -1; // Generation of last.
+    int since_keyframe = 0;
+
+    std::thread encoder;
+
+    void encoder_loop();
+
+    /**
+     * @brief Drop the oldest keyframe groups while more than max_bytes are used (at least one group is kept).
+     */
+    void trim();
+
+    /**
+     * @brief Wait until all recorded grids are coded. The lock has to be held.
+     */
+    void wait_idle(std::unique_lock<std::mutex>& lock);
+
+public:
+    /**
+     * @brief Start the encoder thread.
+     *
+     * @param cells Number of cells of the grids.
+     * @param keyframe_interval Generations between two keyframes (at least 1).
+     * @param max_bytes Bound of the coded frames, old generations are dropped beyond it.
+     */
+    History(size_t cells, int keyframe_interval, size_t max_bytes);
+
+    /**
+     * @brief Code the remaining grids and stop the encoder thread.
+     */
+    ~History();
+
+    /**
+     * @brief Record a generation. Copies the grid and returns, the grid is coded in the background.
+     *
+     * @param generation The generation, usually the one after the last recorded one.
+     * @param grid The grid.
+     */
+    void record(long generation, const bool* grid);
+
+    /**
+     * @brief Reconstruct a recorded generation from the nearest keyframe before it.
+     *
+     * @param generation The generation.
+     * @param grid Receives the cells.
+     *
+     * @return False if the generation isn't (or no longer) recorded.
+     */
+    bool restore(long generation, bool* grid);
+
+    /**
+     * @brief Forget the generations after the given one, e.g. after seeking back before evolving again.
+     */
+    void truncate(long generation);
+
+    /**
+     * @brief Oldest and newest recorded generation (-1 if nothing is recorded).
+     */
+    long first_generation();
+    long last_generation();
+
+    /**
+     * @brief Number of recorded generations and keyframes.
+     */
+    size_t frame_count();
+    size_t keyframe_count();
+
+    /**
+     * @brief Memory in use: coded frames plus the grid buffers of the encoder.
+     */
+    size_t memory_usage();
+};
+
+#endif // HISTORY_H
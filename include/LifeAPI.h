@@ -0,0 +1,107 @@
+/*
+* C interface of the simulation library (libgameoflife), for programs that drive worlds in-process.
+* A world is an opaque handle. Views point into the memory of the world (no copy) and stay valid
+* until the world is stepped, changed or destroyed. Functions returning int return 0 on success and
+* -1 on failure; gol_last_error then describes the failure (per thread).
+* C++ programs can use World directly (World.h: view, packed_view, set_cells, set_region).
+*/
+
+#ifndef LIFEAPI_H
+#define LIFEAPI_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Incremented when the interface changes incompatibly.
+#define GOL_API_VERSION 1
+
+typedef struct gol_world gol_world;
+
+// One byte per cell (0 = dead, 1 = alive), row-major, rows stride bytes apart.
+typedef struct {
+    const uint8_t* cells;
+    int height;
+    int width;
+    size_t stride;
+    long generation;
+} gol_grid_view;
+
+// 64 cells per word: bit i of word j of a row is column 64 * j + i, rows words_per_row words apart.
+typedef struct {
+    const uint64_t* words;
+    int height;
+    int width;
+    size_t words_per_row;
+    long generation;
+} gol_packed_view;
+
+/**
+ * @brief GOL_API_VERSION of the library, to check against the header.
+ */
+int gol_api_version(void);
+
+/**
+ * @brief Create an empty world.
+ *
+ * @param height Rows.
+ * @param width Columns.
+ * @param engine Engine name as on the command line ("scalar", "lookup", "blocked", "opencl", "split"),
+ * NULL for "lookup".
+ *
+ * @return The world, NULL on failure.
+ */
+gol_world* gol_create(int height, int width, const char* engine);
+
+void gol_destroy(gol_world* world);
+
+/**
+ * @brief Set the rule, e.g. "B3/S23".
+ */
+int gol_set_rule(gol_world* world, const char* rule);
+
+/**
+ * @brief Worker threads of the CPU engines.
+ */
+int gol_set_threads(gol_world* world, int threads);
+
+/**
+ * @brief Advance the world by generations.
+ */
+int gol_step(gol_world* world, long generations);
+
+long gol_generation(gol_world* world);
+
+/**
+ * @brief View of the cells without copying.
+ */
+int gol_get_view(gol_world* world, gol_grid_view* view);
+
+/**
+ * @brief View of the cells as 64-bit words, packed once per generation into a buffer of the world.
+ */
+int gol_get_packed_view(gol_world* world, gol_packed_view* view);
+
+/**
+ * @brief Replace the cells of a rectangle (0 = dead, any other value alive), rows stride bytes apart.
+ */
+int gol_set_region(gol_world* world, int y, int x, int rows, int columns, const uint8_t* cells, size_t stride);
+
+/**
+ * @brief Replace all cells (height * width bytes, row-major).
+ */
+int gol_set_cells(gol_world* world, const uint8_t* cells);
+
+/**
+ * @brief Message of the last failure of the calling thread ("" if none).
+ */
+const char* gol_last_error(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LIFEAPI_H
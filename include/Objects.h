@@ -0,0 +1,71 @@
+/*
+* Helpers for analysing isolated objects (still lifes, oscillators, spaceships) on the infinite plane.
+* Objects are given as lists of living cells (x, y), independent of any World.
+*/
+
+#ifndef OBJECTS_H
+#define OBJECTS_H
+
+#include "Rule.h"
+
+#include <string>
+#include <utility>
+#include <vector>
+
+typedef std::vector<std::pair<int, int> > CellList; // Living cells as (x, y) pairs.
+
+/**
+ * @brief Result of classifying an object.
+ */
+struct ObjectInfo {
+    std::string code; // Canonical name, e.g. "xs4_..." (still life), "xp2_..." (oscillator), "xq4_..." (spaceship).
+    int period;       // 0 if no period was found.
+    int dx, dy;       // Displacement per period (0, 0 for still lifes and oscillators).
+    int population;
+};
+
+/**
+ * @brief Calculates the next generation of an object on the infinite plane.
+ * Rules with B0 are not supported (the plane would fill up).
+ *
+ * @param cells The living cells.
+ * @param rule The Life-like rule.
+ *
+ * @return The living cells of the next generation, sorted.
+ */
+CellList step_cells(const CellList& cells, const Rule& rule = Rule());
+
+/**
+ * @brief Shift the cells so that the bounding box starts at (0, 0) and sort them.
+ *
+ * @param cells The living cells.
+ * @param min_x Receives the original left edge of the bounding box.
+ * @param min_y Receives the original top edge of the bounding box.
+ *
+ * @return The normalised cells.
+ */
+CellList normalise_cells(const CellList& cells, int& min_x, int& min_y);
+
+/**
+ * @brief Translation, rotation and reflection invariant code of a single phase.
+ * The smallest bitmap encoding among the 8 symmetries.
+ *
+ * @param cells The living cells.
+ *
+ * @return The code (rows as hex digits, separated by 'z').
+ */
+std::string phase_code(const CellList& cells);
+
+/**
+ * @brief Evolve an object until it repeats (possibly translated) and name it by canonical form.
+ * The code is the smallest phase code over all phases with an apgcode-like prefix.
+ *
+ * @param cells The living cells of the object.
+ * @param max_period The maximum period to search for.
+ * @param rule The Life-like rule.
+ *
+ * @return The classification. Objects without period get the prefix "zz_".
+ */
+ObjectInfo classify_object(const CellList& cells, int max_period, const Rule& rule = Rule());
+
+#endif // OBJECTS_H
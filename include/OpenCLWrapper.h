@@ -11,6 +11,47 @@ class World;
 #include <gegl-0.4/opencl/cl.h>
 
 #include <string>
+#include <vector>
+
+/**
+ * @brief Which OpenCL device to use, written as type[:index][/sub_devices] (e.g. "gpu", "cpu:1", "cpu/4").
+ */
+struct DeviceSelection {
+    cl_device_type type = CL_DEVICE_TYPE_GPU;
+    int index = 0; // Index among the devices of this type over all platforms.
+    int sub_devices = 0; // Split the device into this many sub-devices (DeviceSplit only), 0 = whole device.
+    bool fallback = true; // Take the first device of any type if there is no matching device (default selection only).
+
+    /**
+     * @brief Parse a selection. The type is gpu, cpu, accelerator or any.
+     * Throws std::invalid_argument for malformed selections.
+     */
+    static DeviceSelection parse(const std::string& text);
+
+    std::string to_string() const;
+};
+
+/**
+ * @brief An OpenCL device found on one of the platforms.
+ */
+struct DeviceInfo {
+    cl_platform_id platform;
+    cl_device_id device;
+    cl_device_type type;
+    std::string name;
+};
+
+/**
+ * @brief Whether the grid buffers are allocated in host-visible memory and mapped instead of copied.
+ */
+enum class ZeroCopy {
+    Auto,    // Enabled if the device reports unified host memory or is a CPU device.
+    Enabled,
+    Disabled
+};
+
+// Largest number of generations per launch of evolve_multi (its tiles have a halo of this many cells).
+static const int MAX_MULTI_STEPS = 16;
 
 class OpenCLWrapper {
 public:
@@ -18,24 +59,42 @@ public:
     cl_uint platformCount;
     cl_platform_id platform;
     cl_uint deviceCount;
-    cl_command_queue queue;
-    cl_kernel kernel_evolve;
-    cl_kernel kernel_compare;
+    cl_command_queue queue = NULL;
+    cl_kernel kernel_evolve = NULL;
+    cl_kernel kernel_compare = NULL;
+    cl_kernel kernel_evolve_stats = NULL;
+    cl_kernel kernel_multi = NULL; // evolve_multi, several generations per launch (see World::evolve_opencl_multi).
+    int multi_steps; // Halo of the evolve_multi tiles, maximum generations per launch.
     // Buffers for evolve
-    cl_mem buffer_grid;
-    cl_mem buffer_newGrid;
+    cl_mem buffer_grid = NULL;
+    cl_mem buffer_newGrid = NULL;
+    // Buffers for evolve_stats (in addition to the evolve buffers)
+    cl_mem buffer_counters = NULL;
+    cl_mem buffer_tiles = NULL;
     // Buffers for compare
-    cl_mem buffer_grid1;
-    cl_mem buffer_grid2;
-    cl_mem buffer_result;
+    cl_mem buffer_grid1 = NULL;
+    cl_mem buffer_grid2 = NULL;
+    cl_mem buffer_result = NULL;
     
     size_t evolve_global_work_size[2];
     size_t compare_global_work_size[1];
     size_t evolve_local_work_size[2];
     size_t compare_local_work_size[1];
+    size_t stats_global_work_size[2]; // Rounded up to whole tiles.
+    size_t stats_local_work_size[2]; // One tile per work group.
+    size_t tile_count;
+    // Zero-copy mode: buffer_grid and buffer_newGrid are host-visible (CL_MEM_ALLOC_HOST_PTR) and used
+    // as ping-pong buffers, World::grid is the mapped pointer of mapped_buffer.
+    bool zero_copy;
+    cl_mem mapped_buffer;
+    // Pipelined mode (see World::evolve_pipelined), created by init_pipeline on first use.
+    bool pipeline_initialized = false;
+    cl_command_queue queue_transfer; // Readbacks, so they overlap with the kernels on queue.
+    cl_kernel kernel_pipeline; // evolve kernel with arguments pointing into buffer_ring.
+    cl_mem buffer_ring[3]; // Generation g is computed into buffer_ring[g % 3].
 
-    cl_program program;
-    cl_context context;
+    cl_program program = NULL;
+    cl_context context = NULL;
     cl_device_id device;
 
     /**
@@ -46,20 +105,73 @@ public:
     /**
      * @brief Construct a new OpenCL object.
      * Initializes everything needed for OpenCL computation in order to allow recurrent use without overhead.
+     * Uses the device selected by World::set_device, throws std::runtime_error if it doesn't exist
+     * or the setup fails (e.g. the program doesn't build), after releasing what was already created.
      *
      */
     OpenCLWrapper(World& world);
 
     ~OpenCLWrapper();
 
-    std::string readKernelSource(const char* filename);
+    /**
+     * @brief Create the transfer queue, ring buffers and kernel of the pipelined mode (once).
+     */
+    void init_pipeline(World& world);
+
+    /**
+     * @brief Map a buffer of the grid size for reading and writing (blocking).
+     *
+     * @return The host pointer.
+     */
+    bool* mapGrid(cl_mem buffer, size_t bytes);
+
+    /**
+     * @brief Unmap a pointer returned by mapGrid, so the device may use the buffer.
+     */
+    void unmapGrid(cl_mem buffer, bool* pointer);
+
+    /**
+     * @brief Point arguments 0 and 1 of evolve and evolve_stats at buffer_grid and buffer_newGrid again,
+     * after zero-copy steps swapped them.
+     */
+    void bind_grid_buffers();
+
+    /**
+     * @brief All devices of all platforms. Empty if there is no OpenCL runtime.
+     */
+    static std::vector<DeviceInfo> list_devices();
+
+    /**
+     * @brief The device for a selection. Throws std::runtime_error if there is no matching device.
+     */
+    static DeviceInfo select_device(const DeviceSelection& selection);
+
+    /**
+     * @brief Build options of the kernel program for a world (rule, statistics tile size and evolve_multi halo).
+     */
+    static std::string build_options(World& world);
+
+    static std::string readKernelSource(const char* filename);
+
+    static void checkError(cl_int err, const char* operation);
 
-    void checkError(cl_int err, const char* operation);
+    /**
+     * @brief Like checkError, but throws std::runtime_error, for the setup a caller can recover from.
+     */
+    static void checkSetup(cl_int err, const char* operation);
 
     void printAttributes(cl_platform_id platform, cl_device_id device);
 
 private:
-    
+    /**
+     * @brief The setup of the constructor.
+     */
+    void create(World& world);
+
+    /**
+     * @brief Release everything created so far.
+     */
+    void release();
 };
 
 #endif // WORLD_H
@@ -0,0 +1,101 @@
+/*
+* Pattern library: patterns are packed bitmaps (64 cells per word), loaded once from RLE or
+* plaintext files and stamped into worlds with any of the 8 rotations/reflections.
+*/
+
+#ifndef PATTERNS_H
+#define PATTERNS_H
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+struct Pattern {
+    std::string name;
+    int height = 0;
+    int width = 0;
+    int words = 0; // 64 bit words per row.
+    std::vector<uint64_t> bits; // Row-major, bit x % 64 of word y * words + x / 64 is the cell (x, y).
+
+    Pattern() { };
+
+    /**
+     * @brief An empty (all dead) pattern.
+     */
+    Pattern(const std::string& name, int height, int width);
+
+    bool get(int y, int x) const { return (bits[y * words + x / 64] >> (x % 64)) & 1; }
+    void set(int y, int x) { bits[y * words + x / 64] |= (uint64_t)1 << (x % 64); }
+
+    /**
+     * @brief Number of living cells.
+     */
+    uint64_t population() const;
+
+    /**
+     * @brief One of the 8 symmetries of the pattern: the pattern is reflected horizontally
+     * if bit 2 of transform is set, then rotated clockwise by 90 degrees (transform & 3) times.
+     *
+     * @param transform 0 to 7, 0 is the identity.
+     */
+    Pattern transformed(int transform) const;
+
+    /**
+     * @brief Parse a pattern in run length encoding (x = ..., y = ... header, b/o cells, $ rows, ! end).
+     * Throws std::invalid_argument if the header is missing.
+     */
+    static Pattern from_rle(const std::string& name, const std::string& text);
+
+    /**
+     * @brief Parse a plaintext pattern (lines starting with ! are comments, O or * alive, . dead).
+     */
+    static Pattern from_plaintext(const std::string& name, const std::string& text);
+};
+
+class PatternLibrary {
+private:
+    std::map<std::string, Pattern> patterns;
+
+public:
+    /**
+     * @brief Construct a library with the built-in patterns (glider, toad, beacon, methuselah, ...).
+     */
+    PatternLibrary();
+
+    /**
+     * @brief Add or replace a pattern (by name).
+     */
+    void add(const Pattern& pattern);
+
+    /**
+     * @brief Load a .rle or .cells file, the pattern is named after the file (without extension).
+     * Throws std::runtime_error if the file can't be read.
+     */
+    void load_file(const std::string& file_name);
+
+    /**
+     * @brief Load all .rle and .cells files of a directory.
+     *
+     * @return The number of loaded patterns (0 if the directory doesn't exist).
+     */
+    int load_directory(const std::string& directory);
+
+    /**
+     * @brief The pattern with the given name. Throws std::invalid_argument for unknown names.
+     */
+    const Pattern& get(const std::string& name) const;
+
+    /**
+     * @brief Names of all patterns in alphabetical order.
+     */
+    std::vector<std::string> names() const;
+
+    /**
+     * @brief The library shared by all worlds: the built-in patterns and the files in the patterns folder,
+     * loaded on first use.
+     */
+    static const PatternLibrary& shared();
+};
+
+#endif // PATTERNS_H
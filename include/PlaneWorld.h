@@ -0,0 +1,125 @@
+/*
+* Unbounded plane: a world without wrap-around that only stores the non-empty parts.
+* The plane is split into fixed-size chunks kept in a hash map keyed by chunk coordinate,
+* so memory and step time grow with the live area and not with a preallocated rectangle.
+*/
+
+#ifndef PLANEWORLD_H
+#define PLANEWORLD_H
+
+#include "Rule.h"
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+
+class World;
+
+class PlaneWorld {
+public:
+    static const int CHUNK_SIZE = 64; // Edge length of a chunk in cells (one 64 bit word per row).
+
+private:
+    /**
+     * @brief 64x64 cells, bit x of rows[y] is the cell (x, y) relative to the chunk origin.
+     */
+    struct Chunk {
+        uint64_t rows[CHUNK_SIZE];
+    };
+
+    struct KeyHash {
+        size_t operator()(int64_t key) const {
+            uint64_t z = (uint64_t)key * 0x9E3779B97F4A7C15ULL;
+            return (size_t)(z ^ (z >> 32));
+        }
+    };
+
+    std::unordered_map<int64_t, Chunk, KeyHash> chunks; // Only non-empty chunks are stored.
+    long int generation;
+    Rule rule;
+    // Bounding box of the living cells (inclusive), only valid if the plane is not empty.
+    long min_x, min_y, max_x, max_y;
+
+    static int64_t key(int32_t cx, int32_t cy) { return ((int64_t)cy << 32) | (uint32_t)cx; }
+    static int32_t key_x(int64_t key) { return (int32_t)(uint32_t)key; }
+    static int32_t key_y(int64_t key) { return (int32_t)(key >> 32); }
+
+    /**
+     * @brief Calculate the next state of one chunk from its 3x3 chunk neighborhood.
+     *
+     * @param n The neighborhood, n[4] is the chunk itself. Missing chunks are NULL.
+     * @param out The new chunk.
+     *
+     * @return True if the new chunk has living cells.
+     */
+    template <bool Conway>
+    bool evolve_chunk(const Chunk* n[9], Chunk& out) const;
+
+    /**
+     * @brief Recalculate the bounding box from the stored chunks.
+     */
+    void update_bounding_box();
+
+public:
+    /**
+     * @brief Construct an empty plane.
+     *
+     * @param rule The Life-like rule. Rules with B0 are rejected (std::invalid_argument),
+     * as they would fill the whole plane.
+     */
+    PlaneWorld(const Rule& rule = Rule());
+
+    /**
+     * @brief Construct a plane from the living cells of a (torus) world.
+     * The cells keep their coordinates, the rule of the world is used.
+     *
+     * @param world The world to copy.
+     */
+    PlaneWorld(World& world);
+
+    /**
+     * @brief Calculates a new generation. Chunks are allocated when activity reaches their border
+     * and freed when they become empty.
+     */
+    void evolve();
+
+    /**
+     * @brief Get a cell state, any coordinate is valid.
+     *
+     * @return 1 if alive, 0 if dead.
+     */
+    int get_cell_state(long y, long x) const;
+
+    /**
+     * @brief Set a cell state, any coordinate is valid.
+     */
+    void set_cell_state(int state, long y, long x);
+
+    /**
+     * @brief Number of living cells.
+     */
+    uint64_t population() const;
+
+    /**
+     * @brief Number of allocated chunks.
+     */
+    size_t chunk_count() const { return chunks.size(); }
+
+    /**
+     * @brief Get the bounding box of the living cells (inclusive coordinates).
+     *
+     * @return False if the plane is empty.
+     */
+    bool bounding_box(long& min_x, long& min_y, long& max_x, long& max_y) const;
+
+    /**
+     * @brief Save the bounding box of the plane in the world file format, shifted to (0, 0).
+     *
+     * @param file_name The file name (excluding extension).
+     */
+    void save_gamestate(std::string file_name) const;
+
+    long getGeneration() const { return generation; }
+};
+
+#endif // PLANEWORLD_H
@@ -0,0 +1,44 @@
+/*
+* Counter-based random number generation.
+* Every value is a pure function of (key, counter), so any number of threads can draw
+* independent streams without shared state or locking, and a soup can be regenerated from its index.
+*/
+
+#ifndef RANDOM_H
+#define RANDOM_H
+
+#include <cstdint>
+
+class CounterRNG {
+public:
+    uint64_t key;
+
+    /**
+     * @brief Construct a new generator for the given key (seed).
+     *
+     * @param key The seed of the stream family.
+     */
+    explicit CounterRNG(uint64_t key) : key(key) { };
+
+    /**
+     * @brief Get the random value at a given position of a stream.
+     * Two rounds of the SplitMix64 finalizer over key, stream and counter.
+     *
+     * @param stream The stream (e.g. soup index).
+     * @param counter The position inside the stream.
+     *
+     * @return 64 random bits.
+     */
+    uint64_t at(uint64_t stream, uint64_t counter) const {
+        return mix(mix(key ^ (stream * 0x9E3779B97F4A7C15ULL)) + counter * 0xD1B54A32D192ED03ULL);
+    }
+
+    static uint64_t mix(uint64_t z) {
+        z += 0x9E3779B97F4A7C15ULL;
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+};
+
+#endif // RANDOM_H
@@ -0,0 +1,44 @@
+/*
+* Life-like cellular automaton rules in B/S notation (e.g. B3/S23 for Conway's Game of Life).
+*/
+
+#ifndef RULE_H
+#define RULE_H
+
+#include <cstdint>
+#include <string>
+
+struct Rule {
+    uint16_t birth = 1 << 3; // Bit n set: a dead cell with n living neighbors comes to life.
+    uint16_t survive = (1 << 2) | (1 << 3); // Bit n set: a living cell with n living neighbors survives.
+
+    /**
+     * @brief Parse a rulestring in B/S notation, e.g. "B3/S23", "B36/S23" (HighLife) or "B2/S" (Seeds).
+     * The order of the two parts and the case of the letters do not matter.
+     *
+     * @param rulestring The rulestring.
+     *
+     * @return The rule. Throws std::invalid_argument if the rulestring is malformed.
+     */
+    static Rule parse(const std::string& rulestring);
+
+    /**
+     * @brief The rule in B/S notation.
+     */
+    std::string to_string() const;
+
+    /**
+     * @brief Whether this is B3/S23, which the engines have a specialised fast path for.
+     */
+    bool is_conway() const { return birth == (1 << 3) && survive == ((1 << 2) | (1 << 3)); }
+
+    /**
+     * @brief Next state of a cell given its state and number of living neighbors.
+     */
+    bool next(bool alive, int neighbors) const { return ((alive ? survive : birth) >> neighbors) & 1; }
+
+    bool operator==(const Rule& other) const { return birth == other.birth && survive == other.survive; }
+    bool operator!=(const Rule& other) const { return !(*this == other); }
+};
+
+#endif // RULE_H
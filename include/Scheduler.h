@@ -0,0 +1,144 @@
+/*
+* Runs many worlds concurrently on one OpenCL device with a shared context.
+* Worlds with the same rule share one program, every world has its own buffers and kernels. The worlds
+* are spread over several in-order command queues, so the device can overlap kernels of different worlds.
+* A job (advance a world by some generations) is enqueued in batches: when a batch completes, an event
+* callback hands the world back to a small pool of host threads, which enqueue the next batch. No host
+* thread ever blocks on the device, and long jobs don't hold up the other worlds of their queue.
+*/
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include "OpenCLWrapper.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class World;
+
+class WorldScheduler {
+public:
+    /**
+     * @brief Completed jobs of one world.
+     */
+    struct WorldReport {
+        long jobs = 0;
+        long generations = 0;
+        double mean_latency = 0; // Seconds from submit to completion.
+        double max_latency = 0;
+    };
+
+private:
+    struct Job {
+        long generations;
+        std::chrono::steady_clock::time_point submitted;
+    };
+
+    struct Slot {
+        WorldScheduler* owner;
+        int index;
+        World* world;
+        cl_command_queue queue; // One of queues.
+        cl_mem buffers[2];
+        cl_kernel kernels[2]; // kernels[i] computes buffers[1 - i] from buffers[i].
+        int current = 0; // Buffer with the newest generation on the device.
+
+        // Guarded by the mutex of the scheduler.
+        std::deque<Job> jobs; // The first one is running.
+        bool running = false; // Has a job, then it is either in flight or in ready.
+        WorldReport report;
+        double latency_sum = 0;
+
+        // Owned by the host thread that advances the world.
+        long remaining = 0; // Generations of the running job not yet enqueued.
+        bool reading = false; // The batch in flight ends with the readback of the job result.
+        cl_event event = NULL; // Last command of the batch in flight.
+    };
+
+    cl_device_id device;
+    cl_context context;
+    std::vector<cl_command_queue> queues;
+    std::map<std::string, cl_program> programs; // By build options (rule and halo), guarded by mutex.
+    int batch; // Generations per batch.
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::vector<std::unique_ptr<Slot> > slots;
+    std::deque<Slot*> ready; // Worlds whose next batch is to be enqueued.
+    int active = 0; // Worlds with a job.
+    bool stop = false;
+    std::string error; // First failed command, reported by wait and wait_all.
+    std::chrono::steady_clock::time_point busy_since; // Start of the current period with active worlds.
+    double busy_seconds = 0;
+    double cell_generations = 0; // Of the completed jobs.
+
+    std::vector<std::thread> hosts;
+
+    void host_loop();
+
+    /**
+     * @brief Enqueue the next batch of a world (the upload first for a new job), or complete its job
+     * if the result is read back.
+     */
+    void advance(Slot& slot);
+
+    static void CL_CALLBACK completed(cl_event event, cl_int status, void* data);
+
+public:
+    /**
+     * @brief Create the context and command queues and start the host threads.
+     * Throws std::runtime_error if the device doesn't exist.
+     *
+     * @param selection The device.
+     * @param queues Command queues, the worlds are assigned round-robin.
+     * @param host_threads Threads that enqueue the batches.
+     * @param batch Generations per batch, bounds how long one world occupies its queue.
+     */
+    WorldScheduler(const DeviceSelection& selection, int queues, int host_threads, int batch);
+
+    /**
+     * @brief Wait for all jobs and release the device objects.
+     */
+    ~WorldScheduler();
+
+    /**
+     * @brief Add a world. Builds the program for its rule if no earlier world has the same rule.
+     * The world has to outlive the scheduler.
+     *
+     * @return Handle of the world for submit, wait and report.
+     */
+    int add(World& world);
+
+    /**
+     * @brief Advance a world by some generations, asynchronously. Jobs of one world run in submit order.
+     * The world must not be used until its jobs are done (see wait).
+     */
+    void submit(int world, long generations);
+
+    /**
+     * @brief Wait until the jobs of a world, or of all worlds, are done.
+     * Throws std::runtime_error if a device command failed.
+     */
+    void wait(int world);
+    void wait_all();
+
+    /**
+     * @brief Latency of the completed jobs of a world.
+     */
+    WorldReport report(int world);
+
+    /**
+     * @brief Cells times generations per second of the completed jobs, over the time any world had a job.
+     */
+    double throughput();
+};
+
+#endif // SCHEDULER_H
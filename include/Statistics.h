@@ -0,0 +1,52 @@
+/*
+* Per-generation statistics, computed as a by-product of the evolve step.
+*/
+
+#ifndef STATISTICS_H
+#define STATISTICS_H
+
+#include <climits>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Edge length of the tiles for the density map (matches the OpenCL work group size of evolve_stats).
+static const int STATS_TILE = 16;
+
+struct GenerationStats {
+    long generation = 0;
+    uint64_t population = 0; // Living cells after the step.
+    uint64_t births = 0;     // Cells that came to life in the step.
+    uint64_t deaths = 0;     // Cells that died in the step.
+    // Bounding box of the living cells (inclusive). min > max if there are no living cells.
+    int min_x = INT_MAX, min_y = INT_MAX, max_x = INT_MIN, max_y = INT_MIN;
+    std::vector<uint16_t> tiles; // Living cells per STATS_TILE x STATS_TILE tile, row-major.
+
+    /**
+     * @brief Add the counts and bounding box of a partial result (e.g. one row band).
+     * Tiles are not merged, the bands write disjoint tile rows.
+     */
+    void merge(const GenerationStats& partial) {
+        population += partial.population;
+        births += partial.births;
+        deaths += partial.deaths;
+        if (partial.min_x < min_x) min_x = partial.min_x;
+        if (partial.min_y < min_y) min_y = partial.min_y;
+        if (partial.max_x > max_x) max_x = partial.max_x;
+        if (partial.max_y > max_y) max_y = partial.max_y;
+    }
+};
+
+/**
+ * @brief Write a time series of statistics as CSV, one generation per line.
+ * The tile densities are the last column, separated by spaces.
+ *
+ * @param file_name The file name (including extension).
+ * @param series The statistics.
+ * @param tiles_x Number of tiles per row.
+ * @param tiles_y Number of tile rows.
+ */
+void write_statistics(const std::string& file_name, const std::vector<GenerationStats>& series,
+                      int tiles_x, int tiles_y);
+
+#endif // STATISTICS_H
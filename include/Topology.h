@@ -0,0 +1,46 @@
+/*
+* NUMA topology of the host, read from /sys/devices/system/node (Linux).
+* Used to pin the workers of the CPU engines and to check where the pages of the grid live.
+* Hosts without the sysfs node directory are treated as one node with all allowed cpus.
+*/
+
+#ifndef TOPOLOGY_H
+#define TOPOLOGY_H
+
+#include <cstddef>
+#include <vector>
+
+struct NumaNode {
+    int id = 0;
+    std::vector<int> cpus; // Cpus of the node the process may run on.
+};
+
+class Topology {
+public:
+    /**
+     * @brief Nodes with at least one allowed cpu, read once.
+     */
+    static const std::vector<NumaNode>& nodes();
+
+    /**
+     * @brief Pin the calling thread to a cpu.
+     *
+     * @return Whether the affinity was set.
+     */
+    static bool pin_current_thread(int cpu);
+
+    /**
+     * @brief Node of the page of every stride-th byte of [address, address + bytes), without moving them.
+     * Pages that are not yet touched (or on hosts without NUMA support) are reported as -1.
+     *
+     * @param stride Distance of the queried addresses, usually the page size.
+     */
+    static std::vector<int> page_nodes(const void* address, size_t bytes, size_t stride);
+
+    /**
+     * @brief Size of a memory page.
+     */
+    static size_t page_size();
+};
+
+#endif // TOPOLOGY_H
@@ -0,0 +1,157 @@
+/*
+* Object tracking: the living cells are segmented into objects (cells within a distance of two
+* are linked, as in the census), every object gets a translation-invariant hash of its shape,
+* and objects are followed across generations. An object whose shape appeared p generations
+* earlier within p cells of its position has period p and that displacement (oscillators: 0,
+* spaceships: the distance travelled per period).
+* The analysis is incremental: objects whose surroundings are in unchanged tiles (see
+* World::tile_fingerprints) are carried over, from the newest analysis or, for tiles that returned
+* to an earlier state (oscillators), from an older one. Only the other regions are segmented again.
+*/
+
+#ifndef TRACKER_H
+#define TRACKER_H
+
+#include "Objects.h"
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+class World;
+
+struct TrackedObject {
+    long id; // Same id for the same object across generations.
+    uint64_t hash; // Shape of the object, independent of its position.
+    int x, y; // Top left corner of the bounding box, inside the world.
+    int width, height; // Size of the bounding box.
+    int population;
+    int period = 0; // 0 if the shape didn't repeat within max_period.
+    int dx = 0, dy = 0; // Displacement per period.
+    long first_generation; // Generation the object was first seen.
+    // Living cells in unwrapped coordinates (objects on the seam stay in one piece), shared by the
+    // analyses the object is carried over to.
+    std::shared_ptr<const CellList> cells;
+};
+
+class ObjectTracker {
+private:
+    struct Analysis {
+        long generation;
+        std::vector<TrackedObject> objects;
+        std::vector<uint64_t> fingerprints; // Tile fingerprints of the generation.
+        // Indices of the objects by the tile of their top left corner: by_tile[tile_first[t]] to
+        // by_tile[tile_first[t + 1] - 1]. Objects that may reach beyond the next tiles are in large.
+        std::vector<int> tile_first;
+        std::vector<int> by_tile;
+        std::vector<int> large;
+    };
+    struct Shape {
+        uint64_t hash;
+        long generation;
+        int x, y;
+    };
+
+    int max_period;
+    std::deque<Analysis> past; // The last analysed generations, oldest first, at most max_period + 1.
+    std::unordered_map<uint64_t, std::vector<Shape> > shapes; // Objects of all past analyses by shape_key.
+    std::vector<uint8_t> visited; // Per cell, set during the segmentation and cleared afterwards.
+    long next_id = 0;
+    double seconds = 0; // Time spent in analyse.
+    long reused = 0; // Objects carried over without segmentation.
+    long segmented = 0; // Objects segmented again.
+    // Objects are indexed by shape and bucket of their position. Buckets are at least max_period + 1
+    // cells wide, so an object within max_period cells is in the same or a neighboring bucket.
+    int buckets_x = 1;
+    int buckets_y = 1;
+
+    /**
+     * @brief Index key of a shape (hash) in a bucket.
+     */
+    uint64_t shape_key(uint64_t hash, int bucket_x, int bucket_y) const;
+
+    /**
+     * @brief Bucket of a position (the last bucket takes the remainder).
+     */
+    int bucket(int position, int buckets, int size) const;
+
+    /**
+     * @brief Add the objects of an analysis to shapes, or remove them.
+     */
+    void index_shapes(World& world, const Analysis& analysis, bool add);
+
+    /**
+     * @brief Fill tile_first, by_tile and large of an analysis.
+     */
+    void index_tiles(World& world, Analysis& analysis);
+
+    /**
+     * @brief Flood fill the object of a living cell (unwrapped coordinates).
+     */
+    CellList fill_object(World& world, int x, int y, std::vector<int>& marked);
+
+    /**
+     * @brief Bounding box, position and hash of an object from its cells.
+     */
+    void describe(World& world, TrackedObject& object);
+
+    /**
+     * @brief Tiles (see World::tiles_x) under the bounding box of an object, grown by margin cells.
+     */
+    void covered_tiles(World& world, const TrackedObject& object, int margin, std::vector<int>& tiles);
+
+    /**
+     * @brief Whether a tile under the bounding box of an object, grown by the link distance, changed.
+     */
+    bool touches_changed(World& world, const TrackedObject& object, const std::vector<uint8_t>& changed);
+
+    /**
+     * @brief Period and displacement of an object from the shapes of the past generations.
+     */
+    void find_period(World& world, TrackedObject& object, long generation);
+
+    /**
+     * @brief Give an object the id of an overlapping object of the previous analysis that wasn't
+     * carried over (the same shape first, then the largest), or a new id.
+     *
+     * @param candidates Indices of these previous objects by the tiles they cover.
+     * @param claimed Ids already given in this analysis.
+     */
+    void assign_id(World& world, TrackedObject& object, const std::unordered_map<int, std::vector<int> >& candidates,
+                   std::unordered_set<long>& claimed, long generation);
+
+public:
+    /**
+     * @brief Construct a tracker.
+     *
+     * @param max_period Longest period (and number of past generations) searched.
+     */
+    explicit ObjectTracker(int max_period);
+
+    /**
+     * @brief Analyse the current generation of a world. Call it after every step (or pass) of the world;
+     * periods are found among the analysed generations. Uses the worker pool of the world.
+     */
+    void analyse(World& world);
+
+    /**
+     * @brief Objects of the newest analysed generation.
+     */
+    const std::vector<TrackedObject>& objects() const;
+
+    /**
+     * @brief Time spent analysing, in seconds.
+     */
+    double analysis_seconds() const { return seconds; }
+
+    /**
+     * @brief Objects carried over unchanged and objects segmented again, over all analyses.
+     */
+    long reused_objects() const { return reused; }
+    long segmented_objects() const { return segmented; }
+};
+
+#endif // TRACKER_H
@@ -0,0 +1,99 @@
+/*
+* A fixed set of persistent worker threads for the CPU engines.
+* Every job runs once on every worker, and worker i always gets index i,
+* so the row band a worker computes stays the same across generations.
+* Optionally every worker is pinned to a cpu, workers in contiguous groups per NUMA node,
+* so neighboring bands (which share halo rows) are computed on the same node.
+*/
+
+#ifndef WORKERPOOL_H
+#define WORKERPOOL_H
+
+#include "Counters.h"
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class WorkerPool {
+private:
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable start;
+    std::condition_variable done;
+    const std::function<void(int)>* job = nullptr;
+    unsigned long epoch = 0; // Incremented for every job, so workers notice a new job.
+    int pending = 0; // Workers that have not finished the current job.
+    bool stop = false;
+    std::vector<int> worker_cpus; // Cpu of every worker, -1 if not pinned.
+    std::vector<int> worker_nodes; // NUMA node of every worker, -1 if not pinned.
+    std::vector<double> busy_seconds; // Time every worker spent in jobs.
+    double wall_seconds = 0; // Time spent in run.
+    StepCounters* counters = nullptr; // Counts the jobs of workers 1 and up, NULL if not counting.
+
+    void worker_loop(int index);
+
+    /**
+     * @brief Run the job of one worker and add its time to busy_seconds.
+     */
+    void run_timed(const std::function<void(int)>& job, int index);
+
+public:
+    /**
+     * @brief Start the workers.
+     *
+     * @param size Number of workers, including the calling thread (which runs index 0).
+     * @param pin Pin the workers to cpus, spread over the NUMA nodes (see Topology). The calling thread
+     * is pinned to the cpu of worker 0 while it runs a job, its own affinity is restored when run returns.
+     */
+    WorkerPool(int size, bool pin = false);
+
+    /**
+     * @brief Stop and join the workers.
+     */
+    ~WorkerPool();
+
+    /**
+     * @brief Number of workers, including the calling thread.
+     */
+    int size() const { return (int)threads.size() + 1; }
+
+    /**
+     * @brief NUMA node of a worker, -1 if the workers are not pinned.
+     */
+    int node(int index) const { return worker_nodes[index]; }
+
+    /**
+     * @brief Cpu of a worker, -1 if the workers are not pinned.
+     */
+    int cpu(int index) const { return worker_cpus[index]; }
+
+    /**
+     * @brief Time a worker spent in jobs since the last reset_timing.
+     */
+    double busy(int index) const { return busy_seconds[index]; }
+
+    /**
+     * @brief Time spent in run since the last reset_timing.
+     */
+    double wall() const { return wall_seconds; }
+
+    void reset_timing();
+
+    /**
+     * @brief Count the hardware events of the following jobs on the workers (not on the calling thread,
+     * which its caller counts), or stop counting with NULL.
+     */
+    void set_counters(StepCounters* counters) { this->counters = counters; }
+
+    /**
+     * @brief Run job(index) for every worker index and wait until all are finished.
+     *
+     * @param job The job, called with the worker index (0 to size()-1).
+     */
+    void run(const std::function<void(int)>& job);
+};
+
+#endif // WORKERPOOL_H
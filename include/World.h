@@ -2,7 +2,101 @@
 #define WORLD_H
 
 #include "OpenCLWrapper.h"
+#include "DeviceSplit.h"
+#include "DeltaLog.h"
+#include "EngineSelector.h"
+#include "FrameExport.h"
+#include "History.h"
+#include "Patterns.h"
+#include "Rule.h"
+#include "Statistics.h"
+#include "Tracker.h"
+#include "WorkerPool.h"
 #include <vector>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+/**
+ * @brief The backends that can compute a new generation of the world.
+ */
+enum class Engine {
+    OpenCL, // evolve kernel on the OpenCL device (default)
+    Scalar, // CPU loop, split into row bands on the worker pool
+    Lookup, // CPU table lookups over bit-packed rows, 2x2 cells per lookup
+    Split,  // bands of rows on several OpenCL devices or sub-devices (DeviceSplit)
+    Blocked // CPU temporal blocking, cache-sized tiles advanced several generations at a time
+};
+
+/**
+ * @brief Name of an engine as used on the command line (e.g. "scalar").
+ */
+std::string engine_name(Engine engine);
+
+/**
+ * @brief Engine for a name (see engine_name). Throws std::invalid_argument for unknown names.
+ */
+Engine parse_engine(const std::string& name);
+
+/**
+ * @brief Hash of a full grid (used to detect repeated or differing states).
+ */
+uint64_t grid_hash(const bool* grid, ulong N);
+
+/**
+ * @brief One pattern instance for World::stamp_all.
+ */
+struct Placement {
+    const Pattern* pattern;
+    int y; // Row of the top left corner (after the transform).
+    int x; // Column of the top left corner.
+    int transform = 0; // See Pattern::transformed.
+};
+
+/**
+ * @brief Memory traffic of the CPU engines on one NUMA node, see World::bandwidth_report.
+ */
+struct NodeBandwidth {
+    int node; // NUMA node, -1 for unpinned workers.
+    int workers = 0;
+    long rows = 0; // Rows of the bands of the workers.
+    double local_pages = 0; // Fraction of the pages of these bands (grid and nextGrid) that are on the node.
+    double bytes = 0; // Grid bytes read and written by the workers (2 per cell and pass).
+    double seconds = 0; // Wall time of the CPU engines.
+    double busy = 0; // Average fraction of the wall time the workers were computing.
+};
+
+/**
+ * @brief Read-only view of the cells of a world, one bool per cell, row-major (no copy).
+ * Valid until the world is stepped, changed or destroyed.
+ */
+struct GridView {
+    const bool* cells;
+    int height;
+    int width;
+    long generation;
+
+    const bool* row(int y) const { return cells + (size_t)y * width; }
+    bool at(int y, int x) const { return cells[(size_t)y * width + x]; }
+    size_t size() const { return (size_t)height * width; }
+    const bool* begin() const { return cells; }
+    const bool* end() const { return cells + size(); }
+};
+
+/**
+ * @brief Read-only view of the cells of a world, 64 cells per word: bit i of word j of a row is
+ * column 64 * j + i, the bits past the width are 0. Valid until the world is stepped, changed or destroyed.
+ */
+struct PackedView {
+    const uint64_t* words;
+    int height;
+    int width;
+    size_t words_per_row;
+    long generation;
+
+    const uint64_t* row(int y) const { return words + (size_t)y * words_per_row; }
+    bool at(int y, int x) const { return (row(y)[x / 64] >> (x % 64)) & 1; }
+};
 
 class World {
 private:
@@ -11,21 +105,253 @@ private:
     ulong N; // Total number of cells (Height * Width).
     long int generation; // Generation of the Game of Life.
     bool* grid; // 2-dimensional Grid of Cells, Alive = 1, Dead = 0
+    bool* nextGrid; // Back buffer of the CPU engines, swapped with grid after each generation.
     OpenCLWrapper* cl;
-    std::vector<char> patterns; // list of patterns, instertable into the world
+    DeviceSelection device_selection; // Device of cl (first GPU, or any device if there is none).
+    std::vector<DeviceSelection> split_devices; // Devices of the split engine, device_selection if empty.
+    DeviceSplit* split = NULL; // Created by the split engine on first use.
+    ZeroCopy zero_copy = ZeroCopy::Auto;
+    bool grid_mapped = false; // grid is a mapped OpenCL buffer (zero-copy), not owned by new[].
+    Engine engine = Engine::OpenCL;
+    Rule rule; // Life-like rule, B3/S23 unless set otherwise.
+    uint64_t random_calls = 0; // Counter for the counter-based RNG used by randomize.
+    WorkerPool* pool = NULL; // Workers of the CPU engines, NULL if single threaded.
+    bool pin_threads = true; // Pin the workers to cpus of the NUMA nodes (see WorkerPool).
+    bool fixed_sizes = true; // Single-threaded scalar uses FixedEngine for its sizes (see set_fixed_sizes).
+    long band_passes = 0; // Passes of the CPU engines over the grid since the last bandwidth reset.
+    bool track_tiles = false; // The CPU engines mark the tiles they change (see set_fingerprints).
+    bool tiles_valid = false; // tile_hashes match the grid of tracked_generation, except the dirty tiles.
+    long tracked_generation = -1; // Generation tile_hashes and tile_dirty refer to.
+    std::vector<uint64_t> tile_hashes; // Hash of every STATS_TILE x STATS_TILE tile, row-major.
+    std::vector<uint8_t> tile_dirty; // Tiles changed since their hash was computed.
+    uint64_t tile_hash_sum = 0; // Sum of the mixed tile hashes, the world fingerprint.
+    std::vector<uint8_t> lookup_table; // Lookup engine: next state of the inner 2x2 cells for every 4x4 neighborhood.
+    Rule lookup_rule; // Rule the lookup table was built for.
+    std::vector<uint8_t> packed; // Lookup engine: bit-packed rows with wrapped border bits.
+    size_t packed_stride = 0; // Bytes per packed row.
+    int block_steps = 1; // Blocked and OpenCL engine: generations per pass of evolve_generations (more is opt-in).
+    std::vector<std::vector<uint8_t> > block_scratch; // Blocked engine: tile buffers per worker.
+    bool collect_statistics = false;
+    std::vector<GenerationStats> statistics; // Time series, one entry per evolve while collect_statistics is set.
+    History* history = NULL; // Recorded generations for seek, NULL if disabled.
+    DeltaLogWriter* log = NULL; // Every generation is appended to a file, NULL if disabled.
+    FrameExporter* exporter = NULL; // Generations are written as images, NULL if disabled.
+    ObjectTracker* tracker = NULL; // Object analysis after every step, NULL if disabled.
+    StepCounters* counters = NULL; // Hardware counters of every step, NULL if disabled.
+    EngineSelector* selector = NULL; // Adaptive engine selection, NULL if the engine is fixed.
+    std::vector<std::string> patterns; // Names of the library patterns randomize chooses from.
+    std::vector<uint64_t> packed_words; // Cells of packed_view, packed on demand.
+    long packed_generation = -1; // Generation packed_words holds, -1 if outdated.
     bool memory_safety = true;
 
     friend class CommandLineInterface;
     friend class OpenCLWrapper;
+    friend class Census;
+    friend class PlaneWorld;
+    friend class DeviceSplit;
+    friend class Conformance;
+    friend class ObjectTracker;
+    friend class Daemon;
+    friend class WorldScheduler;
+    friend class EngineSelector;
+
+    /**
+     * @brief Hand the current generation to the history, the delta log, the image export and the tracker, if enabled.
+     */
+    void record_generation();
+
+    /**
+     * @brief Start and stop the hardware counters around an engine step, if enabled: the calling thread
+     * here, the workers in the worker pool.
+     */
+    void start_counters();
+    void stop_counters(long generations);
 
     /**
      * @brief Calculates a new generation of the world/grid to simulate an evolution of the cells.
-     * The rules are from the wikipedia article.
+     * The rules are from the wikipedia article. Dispatches to the selected engine.
      * 
      * @returns The grid of the world after the evolution.
     */
     bool* evolve();
 
+    /**
+     * @brief OpenCL version of evolve. Requires init_OpenCL to be called first.
+     *
+     * @returns The grid of the world after the evolution.
+    */
+    bool* evolve_opencl();
+
+    /**
+     * @brief Advance the world several generations on the OpenCL device with the evolve_multi kernel,
+     * up to cl->multi_steps generations per launch in local memory. The grid is uploaded once,
+     * the launches ping-pong between the two device buffers, and the result is read back once.
+     *
+     * @param generations Number of generations.
+     *
+     * @returns The grid of the world after the evolution.
+    */
+    bool* evolve_opencl_multi(long generations);
+
+    /**
+     * @brief Zero-copy version of evolve_opencl: the grid is unmapped, evolved in place on the device
+     * into the other host-visible buffer, and that buffer is mapped as the new grid. No copies.
+     *
+     * @returns The grid of the world after the evolution.
+    */
+    bool* evolve_zero_copy();
+
+    /**
+     * @brief If the grid is a mapped buffer, unmap it and move the cells into host memory owned by the world.
+     *
+     * @param keep_cells Whether to copy the cells (false when the world is destroyed).
+    */
+    void release_mapping(bool keep_cells = true);
+
+    /**
+     * @brief If OpenCL runs zero-copy and the grid is in host memory, move the cells into the mapped buffer.
+     */
+    void map_grid();
+
+    /**
+     * @brief Split version of evolve: every device computes a band of rows (see DeviceSplit).
+     * Falls back to evolve_scalar when statistics are collected.
+     *
+     * @returns The grid of the world after the evolution.
+    */
+    bool* evolve_split();
+
+    /**
+     * @brief Called after the grid was changed from the host, so device copies are uploaded again.
+    */
+    void grid_changed();
+
+    /**
+     * @brief Make the host grid current before it is read or partly written: the split engine only
+     * reads back the band edges per step (see DeviceSplit::download).
+    */
+    void sync_grid();
+
+    /**
+     * @brief Scalar CPU version of evolve. Writes into the back buffer and swaps it with the grid.
+     *
+     * @returns The grid of the world after the evolution.
+    */
+    bool* evolve_scalar();
+
+    /**
+     * @brief Scalar CPU loop specialised on the rule at compile time.
+     *
+     * @param next Callable (alive, neighbors) -> new state, inlined into the loop.
+     *
+     * @returns The grid of the world after the evolution.
+    */
+    template <class NextState>
+    bool* evolve_scalar_rule(NextState next);
+
+    /**
+     * @brief Lookup table version of evolve. Packs the grid into bit rows, then looks up the next state
+     * of every 2x2 block from its 4x4 neighborhood. Falls back to evolve_scalar when statistics are collected.
+     *
+     * @returns The grid of the world after the evolution.
+    */
+    bool* evolve_lookup();
+
+    /**
+     * @brief Temporal blocking version of evolve: advances the world several generations in one pass
+     * over cache-sized tiles (see BlockedEngine.cpp). Falls back to evolve_scalar when statistics are collected.
+     *
+     * @param steps Number of generations.
+     *
+     * @returns The grid of the world after the evolution.
+    */
+    bool* evolve_blocked(int steps);
+
+    /**
+     * @brief One pass of the blocked engine with the rule as 8-cell word operation (Step::word, Step::cell).
+     * Marks the changed fingerprint tiles if tracking.
+    */
+    template <class Step>
+    void evolve_blocked_rule(const Step& step, int steps, bool tracking);
+
+    /**
+     * @brief Advance one tile (th x tw cells at ty, tx) from grid into nextGrid by steps generations,
+     * using the two scratch buffers of (th + 2 steps) x (tw + 2 steps) bytes.
+    */
+    template <class Step>
+    void block_tile(const Step& step, int ty, int tx, int th, int tw, int steps, bool tracking, uint8_t* cur, uint8_t* nxt);
+
+    /**
+     * @brief Build lookup_table for the current rule (if not built yet).
+    */
+    void build_lookup_table();
+
+    /**
+     * @brief Pack the rows [y_begin, y_end) of grid into packed.
+    */
+    void pack_rows(int y_begin, int y_end);
+
+    /**
+     * @brief Look up the next state of the row pairs starting in [y_begin, y_end) (y_begin even) into nextGrid.
+    */
+    void lookup_rows(int y_begin, int y_end);
+
+    /**
+     * @brief Evolve the rows [y_begin, y_end) from grid into nextGrid.
+     *
+     * @param next Callable (alive, neighbors) -> new state.
+     * @param y_begin First row.
+     * @param y_end Row after the last row.
+     * @param partial Receives population, births, deaths and bounding box of the rows (if Stats).
+     * @param tiles Tile densities of the whole world, only the tiles of these rows are written (if Stats).
+    */
+    template <bool Stats, class NextState>
+    void evolve_rows(NextState next, int y_begin, int y_end, GenerationStats* partial, uint16_t* tiles);
+
+    /**
+     * @brief Rows of the band of a worker of the CPU engines: whole tile rows, the same for every generation.
+     *
+     * @param band Worker index.
+     * @param bands Number of workers.
+     * @param y_begin Receives the first row.
+     * @param y_end Receives the row after the last row.
+    */
+    void band_range(int band, int bands, int& y_begin, int& y_end);
+
+    /**
+     * @brief Whether the CPU engine step that starts now marks the tiles it changes: fingerprints are
+     * enabled and up to date for the current generation.
+    */
+    bool track_step();
+
+    /**
+     * @brief Mark the tiles of row y in the columns [x_begin, x_end) whose cells differ between grid
+     * and nextGrid. x_begin is a multiple of STATS_TILE. Workers call it for rows of their own tiles only.
+    */
+    void mark_changed_tiles(int y, int x_begin, int x_end);
+
+    /**
+     * @brief Hash of the cells of one tile.
+    */
+    uint64_t hash_tile(int tile);
+
+    /**
+     * @brief Reallocate grid and nextGrid and let every worker touch its band first,
+     * so the pages of a band are placed on the NUMA node of the worker that computes it.
+    */
+    void first_touch();
+
+    /**
+     * @brief Statistics of the OpenCL evolve_stats kernel, read back after the step.
+    */
+    GenerationStats read_opencl_statistics();
+
+    /**
+     * @brief Set the living cells of a pattern whose rows fall into [y_begin, y_end).
+     * The pattern has to fit into the world unless wrap is set.
+    */
+    void stamp_rows(const Pattern& pattern, int y, int x, bool wrap, int y_begin, int y_end);
+
     /**
      * @brief Create a random pattern in a random location (cell) of the world.
      * The starting position i.e. the chosen cell will be the bottom left corner of the generated cell.
@@ -45,7 +371,8 @@ public:
      * @brief Construct a new World object given file
      * (that includes height, width and a start distribution of living cells)
      *
-     * The file should be in the configurations folder.
+     * The file should be in the configurations folder. Throws std::runtime_error if it doesn't exist
+     * or its rule is invalid.
      *
      * @param file_name The name of the configuration file in the configurations
      * folder.
@@ -57,6 +384,272 @@ public:
      */
     ~World();
 
+    /**
+     * @brief Select the OpenCL device. Re-initializes OpenCL if initialized.
+     *
+     * @param selection The device (see DeviceSelection::parse).
+     */
+    void set_device(const DeviceSelection& selection);
+
+    /**
+     * @brief Select the devices of the split engine. The split is created again on the next evolve.
+     *
+     * @param selections The devices, each with an optional number of sub-devices.
+     */
+    void set_split_devices(const std::vector<DeviceSelection>& selections);
+
+    /**
+     * @brief Enable the history: every evolved generation is recorded (keyframes plus XOR deltas,
+     * coded on a background thread), so the world can seek back to it. Starts with the current generation.
+     *
+     * @param keyframe_interval Generations between two keyframes, 0 disables the history.
+     * @param max_bytes Bound of the coded history, the oldest generations are dropped beyond it.
+     */
+    void set_history(int keyframe_interval, size_t max_bytes);
+
+    /**
+     * @brief Getter function of the history (NULL if disabled).
+     */
+    History* getHistory();
+
+    /**
+     * @brief Append every evolved generation to a delta log file for replay (see DeltaLog.h), coded and
+     * written on a background thread. Starts with the current generation. The file is completed
+     * (seek index) when the log is disabled or the world is destroyed.
+     * Throws std::runtime_error if the file can't be created.
+     *
+     * @param file_name The log file, empty to disable the log.
+     * @param keyframe_interval Generations between two keyframes.
+     */
+    void set_log(const std::string& file_name, int keyframe_interval);
+
+    /**
+     * @brief Getter function of the delta log (NULL if disabled).
+     */
+    DeltaLogWriter* getLog();
+
+    /**
+     * @brief Write evolved generations as images (see FrameExport.h), encoded on background threads.
+     * Starts with the current generation. The remaining images are written when the export is disabled
+     * or the world is destroyed.
+     *
+     * @param prefix Path and name prefix of the images, empty to disable the export.
+     * @param options Format, downscaling, age colouring, selection and threads.
+     */
+    void set_export(const std::string& prefix, const ExportOptions& options);
+
+    /**
+     * @brief Getter function of the image export (NULL if disabled).
+     */
+    FrameExporter* getExporter();
+
+    /**
+     * @brief Enable or disable the hardware counters (cycles, instructions, last level cache misses) of
+     * the engine steps, per step and per thread (see Counters.h).
+     *
+     * @param enabled Whether to count. Enabling again starts a new measurement.
+     */
+    void set_counters(bool enabled);
+
+    /**
+     * @brief Getter function of the hardware counters (NULL if disabled).
+     */
+    StepCounters* getCounters();
+
+    /**
+     * @brief Let the world switch engines by itself, based on sampled density, activity and measured
+     * step times (see EngineSelector.h). Starts with the current engine. Disabling keeps the current engine.
+     *
+     * @param enabled Whether to select adaptively.
+     * @param options Sample interval, trials, hysteresis and candidate engines.
+     */
+    void set_adaptive(bool enabled, const AdaptiveOptions& options = AdaptiveOptions());
+
+    /**
+     * @brief Getter function of the adaptive engine selection (NULL if disabled).
+     */
+    EngineSelector* getSelector();
+
+    /**
+     * @brief Go back (or forward) to a recorded generation. The later generations are forgotten.
+     *
+     * @param generation The generation.
+     *
+     * @return False if the generation isn't recorded.
+     */
+    bool seek(long generation);
+
+    /**
+     * @brief Select whether OpenCL uses zero-copy host-mapped buffers. Re-initializes OpenCL if initialized.
+     *
+     * @param mode Auto (detect unified memory), Enabled or Disabled.
+     */
+    void set_zero_copy(ZeroCopy mode);
+
+    /**
+     * @brief Select the engine used by evolve. Initializes OpenCL for the OpenCL engine if it isn't yet,
+     * throws std::runtime_error (and keeps the engine) if that fails. Set the rule, device and block steps
+     * before, they are compiled into the program.
+     *
+     * @param engine The new engine.
+     */
+    void set_engine(Engine engine);
+
+    /**
+     * @brief Set the number of generations the blocked and OpenCL engines advance per pass over the grid.
+     * Rebuilds the OpenCL program if OpenCL is initialized, as the tile halo is compiled into evolve_multi.
+     *
+     * @param steps Generations per pass (at least 1, at most MAX_MULTI_STEPS per launch on OpenCL).
+     */
+    void set_block_steps(int steps);
+
+    /**
+     * @brief Advance the world by several generations. The blocked engine does block_steps generations
+     * per pass, the OpenCL engine block_steps generations per launch of evolve_multi (without readback
+     * in between unless the history, the delta log, the image export or the tracking is enabled). These then only
+     * see the last generation of every pass. The other engines, and all engines while statistics are collected, call evolve.
+     *
+     * @param generations Number of generations.
+     */
+    void evolve_generations(long generations);
+
+    /**
+     * @brief Run generations on the OpenCL device with compute and readback overlapped.
+     * The grid stays on the device (three rotating buffers) while generation g+1 is computed,
+     * generation g is read back without blocking into one of several host buffers and handed to the consumer
+     * on a separate thread. Kernels, readbacks and the consumer are ordered only through events,
+     * the host waits only when all host buffers are still in use by the consumer.
+     * Throws std::runtime_error if OpenCL is not initialized. With statistics or an observer (history, log,
+     * export, tracker) the generations are evolved one by one instead, so every generation is recorded.
+     *
+     * @param generations Number of generations.
+     * @param host_buffers Number of host buffers (at least 2).
+     * @param consumer Called for every generation in order with the generation number and its grid.
+     * The grid is only valid during the call.
+     */
+    void evolve_pipelined(long generations, int host_buffers,
+                          const std::function<void(long, const bool*)>& consumer);
+
+    /**
+     * @brief Set the number of worker threads of the CPU engines. The grid is placed band by band
+     * on the nodes of the workers (first touch).
+     *
+     * @param threads Number of threads (1 = no worker pool).
+     */
+    void set_threads(int threads);
+
+    /**
+     * @brief Enable or disable pinning the workers to cpus (spread over the NUMA nodes) and restart the pool.
+     */
+    void set_pinning(bool enabled);
+
+    /**
+     * @brief Enable or disable the compiled FixedEngine steps of the single-threaded scalar engine
+     * (FIXED_WORLD_SIZES), disabled the generic scalar loop runs at every size.
+     */
+    void set_fixed_sizes(bool enabled);
+
+    /**
+     * @brief Memory traffic of the CPU engines per NUMA node since the last reset_bandwidth,
+     * modelled as one read and one write of every cell of a band per pass. Empty without worker pool.
+    */
+    std::vector<NodeBandwidth> bandwidth_report();
+
+    void reset_bandwidth();
+
+    /**
+     * @brief Enable or disable the per-generation statistics (population, births, deaths,
+     * bounding box and tile densities), computed by the engines during evolve.
+     *
+     * @param enabled Whether to collect statistics.
+     */
+    void set_statistics(bool enabled);
+
+    /**
+     * @brief Save the collected statistics as CSV (see write_statistics).
+     *
+     * @param file_name The file name (excluding extension) in the configurations folder.
+     */
+    void save_statistics(std::string file_name);
+
+    /**
+     * @brief Getter function of the collected statistics.
+     */
+    const std::vector<GenerationStats>& getStatistics();
+
+    /**
+     * @brief Enable or disable the object tracking (see ObjectTracker): after every step the objects
+     * are segmented and followed, and their periods and displacements are determined.
+     * Enables the fingerprints, as the tracking only segments the changed tiles again.
+     *
+     * @param max_period Longest period searched, 0 disables the tracking.
+     */
+    void set_tracking(int max_period);
+
+    /**
+     * @brief The object tracker, NULL if the tracking is disabled.
+     */
+    ObjectTracker* getTracker();
+
+    /**
+     * @brief Let the CPU engines mark the tiles they change, so fingerprint only rehashes those tiles.
+     * Without it (and after other engines, edits or seeks) every tile is rehashed.
+     */
+    void set_fingerprints(bool enabled);
+
+    /**
+     * @brief Fingerprint of the grid, combined from the tile fingerprints: equal grids have equal
+     * fingerprints, different grids differ with probability 1 - 2^-64. O(tiles) plus the changed tiles.
+     */
+    uint64_t fingerprint();
+
+    /**
+     * @brief Fingerprint of every STATS_TILE x STATS_TILE tile (row-major, see tiles_x and tiles_y).
+     */
+    const std::vector<uint64_t>& tile_fingerprints();
+
+    /**
+     * @brief Tiles whose fingerprints differ from the ones of another world of the same size.
+     * Throws std::invalid_argument if the sizes differ.
+     *
+     * @return Tile indices, row-major.
+     */
+    std::vector<int> differing_tiles(World& other);
+
+    /**
+     * @brief Number of statistic tiles per row and per column.
+     */
+    int tiles_x() { return (this->width + STATS_TILE - 1) / STATS_TILE; }
+    int tiles_y() { return (this->height + STATS_TILE - 1) / STATS_TILE; }
+
+    /**
+     * @brief Set the Life-like rule. Rebuilds the OpenCL program if OpenCL is initialized,
+     * as the rule is compiled into the kernel.
+     *
+     * @param rule The new rule.
+     */
+    void set_rule(const Rule& rule);
+
+    /**
+     * @brief Getter function of the rule of the world.
+     *
+     * @return The rule.
+     */
+    Rule getRule();
+
+    /**
+     * @brief Fill the whole world with a random soup (reproducible for a given seed).
+     *
+     * @param density Probability of a cell to be alive.
+     * @param seed Seed of the counter-based RNG.
+     */
+    void fill_random(double density, uint64_t seed);
+
+    /**
+     * @brief Kill all cells and reset the generation counter.
+     */
+    void clear();
+
     /**
      * @brief Initializes OpenCL using the OpenCLWrapper constructor and storing it in this->cl;
      */
@@ -126,6 +719,38 @@ public:
     */
     void set_cell_state(int state, int p);
 
+    /**
+     * @brief Set the living cells of a pattern (dead cells of the pattern are left as they are).
+     *
+     * @param pattern The pattern, e.g. from PatternLibrary::shared().
+     * @param y The row of the top left corner.
+     * @param x The column of the top left corner.
+     * @param transform Rotation/reflection, see Pattern::transformed.
+     * @param wrap Whether the pattern wraps around the edges. Otherwise nothing is set if it doesn't fit.
+     *
+     * @return Whether the pattern was placed.
+    */
+    bool stamp(const Pattern& pattern, int y, int x, int transform = 0, bool wrap = true);
+
+    /**
+     * @brief Stamp many patterns in one pass. Every transform is computed once, then the worker pool
+     * (see set_threads) splits the world into row bands and each worker writes the rows of its band
+     * of all placements, so no two workers write the same cell.
+     *
+     * @param placements The pattern instances.
+     * @param wrap Whether patterns wrap around the edges, otherwise patterns that don't fit are skipped.
+    */
+    void stamp_all(const std::vector<Placement>& placements, bool wrap = true);
+
+    /**
+     * @brief Stamp randomly placed and transformed library patterns (reproducible for a given seed).
+     *
+     * @param names The pattern names to choose from (all library patterns if empty).
+     * @param count The number of patterns, throws std::invalid_argument if negative.
+     * @param seed Seed of the counter-based RNG.
+    */
+    void fill_patterns(const std::vector<std::string>& names, long count, uint64_t seed);
+
     /**
      * @brief Add a "Glider" at a given two-dimensional grid position (x, y).
      * 
@@ -163,6 +788,43 @@ public:
     */
     void print();
 
+    /**
+     * @brief Prints a grid with the dimensions of the world into the console (e.g. a pipelined generation).
+     *
+     * @param cells The grid.
+    */
+    void print(const bool* cells);
+
+    /**
+     * @brief View of the cells without copying (see GridView).
+     */
+    GridView view();
+
+    /**
+     * @brief View of the cells as 64-bit words (see PackedView). The grid is packed once per generation,
+     * on the first call, into a buffer owned by the world; later calls return the same words.
+     */
+    PackedView packed_view();
+
+    /**
+     * @brief Replace all cells.
+     *
+     * @param cells height * width cells, row-major.
+     */
+    void set_cells(const bool* cells);
+
+    /**
+     * @brief Replace the cells of a rectangle. Throws std::out_of_range if it isn't inside the world.
+     *
+     * @param y The row of the top left corner.
+     * @param x The column of the top left corner.
+     * @param rows Rows of the rectangle.
+     * @param columns Columns of the rectangle.
+     * @param cells The new cells, row-major, 0 = dead, any other value alive.
+     * @param stride Bytes from one row of cells to the next (at least columns).
+     */
+    void set_region(int y, int x, int rows, int columns, const uint8_t* cells, size_t stride);
+
     /**
      * @brief Getter function of the generation of the world.
      * 
@@ -6,18 +6,54 @@
 #include <atomic>
 
 #include "World.h"
+#include "FrameSlot.h"
 
 class CommandLineInterface {
 private:
     World* world{};
     bool print;
     int delay_in_ms;
+    std::string statistics_file; // Statistics are saved to this file on quit, empty if disabled.
 public:
     CommandLineInterface(int argc, char** argv);
     //~CommandLineInterface();
+
+    /**
+     * @brief Print how to start the program and the headless modes with their options.
+     */
+    static void usage();
+
+    /**
+     * @brief Run a mode without the interactive menus, selected by the first argument (e.g. --census).
+     *
+     * @param argc Number of command line arguments.
+     * @param argv Command line arguments, options in the form --name=value.
+     */
+    void headless(int argc, char** argv);
     void mainMenu();
     void addMenu();
-    void autoPlay(std::atomic<bool>& run);
+    // Display interval of autoPlay (about 30 frames per second).
+    static const int FRAME_INTERVAL_MS = 33;
+
+    /**
+     * @brief Display loop of evolveLoop: takes the latest generation from the slot at a fixed frame rate,
+     * generations published in between are skipped.
+     *
+     * @param run Cleared by evolveLoop to stop.
+     * @param slot Filled by simulationLoop.
+     * @param start_generation Generation of the world when the loops started, for the first rate.
+     */
+    void autoPlay(std::atomic<bool>& run, FrameSlot& slot, long start_generation);
+
+    /**
+     * @brief Simulation loop of evolveLoop: evolves as fast as possible (or once per delay_in_ms)
+     * and publishes every generation to the slot. The only thread using the world while it runs.
+     *
+     * @param run Cleared by evolveLoop to stop.
+     * @param slot Read by autoPlay.
+     */
+    void simulationLoop(std::atomic<bool>& run, FrameSlot& slot);
+
     void evolveLoop();
     void displayMenu();
     void saveMenu();
@@ -32,6 +68,14 @@ public:
     */
     long calculate_processing_time(long generations);
 
+    /**
+     * @brief Run n generations with the pipelined OpenCL mode (World::evolve_pipelined),
+     * printing every generation from the consumer thread if printing is enabled.
+     *
+     * @param generations The amount of additional generations to run.
+    */
+    void overlappedRun(long generations);
+
     //  bool create_world(int hight, int widht); <= Das wird bereits getan durch die Argumente.
     //  bool load_gamestate(std::string name); <= Das wird ebenfalls bereits durch die Argumente getan.
     //  bool save_gamestate();  <= wurde in der World Klasse gemacht.
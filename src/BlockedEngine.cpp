@@ -0,0 +1,166 @@
+/*
+* Temporal blocking engine of the World class.
+* The grid is cut into cache-sized tiles. Every tile is loaded with a halo of k cells, advanced k generations
+* in two small ping-pong buffers (the valid area shrinks by one cell per generation), and only the interior
+* is written back. The grid is read and written once per k generations instead of once per generation.
+*/
+
+#include "World.h"
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+
+// Interior size of a tile, multiples of STATS_TILE. With k = 4 two buffers of (64 + 8) x (512 + 8) bytes
+// stay well inside L2.
+static const int BLOCK_TILE_HEIGHT = 64;
+static const int BLOCK_TILE_WIDTH = 512;
+
+static inline uint64_t load64(const uint8_t* p) {
+  uint64_t word;
+  std::memcpy(&word, p, sizeof(word));
+  return word;
+}
+
+// B3/S23 on 8 cells at once: every byte of the counts is the neighbor count of one cell.
+struct ConwayStep {
+  // 0x80 in every byte of v that equals c (for byte values below 0x80).
+  static inline uint64_t equal(uint64_t v, uint64_t c) {
+    const uint64_t low = 0x7F7F7F7F7F7F7F7FULL;
+    uint64_t x = v ^ (c * 0x0101010101010101ULL);
+    return ~(((x & low) + low) | x | low);
+  }
+  uint64_t word(uint64_t alive, uint64_t counts) const {
+    return (equal(counts, 3) | (equal(counts, 2) & (alive << 7))) >> 7;
+  }
+  bool cell(bool alive, int determinationValue) const {
+    return determinationValue == 3 || (determinationValue == 2 && alive);
+  }
+};
+
+// Other rules: table indexed by state and neighbor count, one lookup per byte.
+struct TableStep {
+  bool table[18];
+  explicit TableStep(const Rule& rule) {
+    for (int n = 0; n <= 8; n++) {
+      table[n] = rule.next(false, n);
+      table[9 + n] = rule.next(true, n);
+    }
+  }
+  uint64_t word(uint64_t alive, uint64_t counts) const {
+    uint64_t result = 0;
+    for (int i = 0; i < 64; i += 8) {
+      result |= (uint64_t)table[((alive >> i) & 1) * 9 + ((counts >> i) & 0xFF)] << i;
+    }
+    return result;
+  }
+  bool cell(bool alive, int determinationValue) const {
+    return table[alive * 9 + determinationValue];
+  }
+};
+
+// Copy count cells of a row starting at column start (may be negative or past the edge), wrapping around.
+static void copy_wrapped(uint8_t* dest, const bool* row, long start, long count, long width) {
+  long x = ((start % width) + width) % width;
+  while (count > 0) {
+    long n = std::min(count, width - x);
+    std::memcpy(dest, row + x, n);
+    dest += n;
+    count -= n;
+    x = 0;
+  }
+}
+
+template <class Step>
+void World::block_tile(const Step& step, int ty, int tx, int th, int tw, int steps, bool tracking, uint8_t* cur, uint8_t* nxt) {
+  int rh = th + 2 * steps;
+  int rw = tw + 2 * steps;
+
+  // Load the tile with a halo of steps cells, the torus wrap is resolved here.
+  for (int ry = 0; ry < rh; ry++) {
+    long gy = (((long)ty - steps + ry) % this->height + this->height) % this->height;
+    copy_wrapped(cur + (size_t)ry * rw, this->grid + gy * this->width, (long)tx - steps, rw, this->width);
+  }
+
+  // After step s the cells [s, rh - s) x [s, rw - s) are valid.
+  for (int s = 1; s <= steps; s++) {
+    for (int y = s; y < rh - s; y++) {
+      const uint8_t* up = cur + (size_t)(y - 1) * rw;
+      const uint8_t* row = cur + (size_t)y * rw;
+      const uint8_t* down = cur + (size_t)(y + 1) * rw;
+      uint8_t* out = nxt + (size_t)y * rw;
+      int x = s;
+      // 8 cells per iteration, the byte sums of the neighbor words can't carry (at most 8).
+      for (; x + 8 <= rw - s; x += 8) {
+        uint64_t counts = load64(up + x - 1) + load64(up + x) + load64(up + x + 1)
+                        + load64(row + x - 1) + load64(row + x + 1)
+                        + load64(down + x - 1) + load64(down + x) + load64(down + x + 1);
+        uint64_t result = step.word(load64(row + x), counts);
+        std::memcpy(out + x, &result, sizeof(result));
+      }
+      for (; x < rw - s; x++) {
+        int determinationValue = up[x - 1] + up[x] + up[x + 1] + row[x - 1] + row[x + 1]
+                                + down[x - 1] + down[x] + down[x + 1];
+        out[x] = step.cell(row[x], determinationValue);
+      }
+    }
+    std::swap(cur, nxt);
+  }
+
+  // Write back the interior, the halo was only needed for the intermediate generations.
+  for (int r = 0; r < th; r++) {
+    std::memcpy(this->nextGrid + (size_t)(ty + r) * this->width + tx, cur + (size_t)(steps + r) * rw + steps, tw);
+    // Tiles are multiples of STATS_TILE, so the fingerprint tiles of this tile are marked by this worker only.
+    if (tracking) mark_changed_tiles(ty + r, tx, tx + tw);
+  }
+}
+
+template <class Step>
+void World::evolve_blocked_rule(const Step& step, int steps, bool tracking) {
+  int th = std::min(this->height, BLOCK_TILE_HEIGHT);
+  int tw = std::min(this->width, BLOCK_TILE_WIDTH);
+  int tiles_across = (this->width + tw - 1) / tw;
+  int tiles = ((this->height + th - 1) / th) * tiles_across;
+
+  int workers = this->pool != NULL ? this->pool->size() : 1;
+  size_t scratch = (size_t)(th + 2 * steps) * (tw + 2 * steps);
+  this->block_scratch.resize(workers);
+
+  // Contiguous ranges of tiles, so a worker keeps the same part of the grid across passes.
+  std::function<void(int)> job = [&](int worker) {
+    // Resized by the worker itself, so its scratch pages are on its NUMA node.
+    std::vector<uint8_t>& buffer = this->block_scratch[worker];
+    if (buffer.size() < 2 * scratch) buffer.resize(2 * scratch);
+    uint8_t* a = buffer.data();
+    for (int t = (long)tiles * worker / workers; t < (long)tiles * (worker + 1) / workers; t++) {
+      int ty = (t / tiles_across) * th;
+      int tx = (t % tiles_across) * tw;
+      block_tile(step, ty, tx, std::min(th, this->height - ty), std::min(tw, this->width - tx), steps, tracking, a, a + scratch);
+    }
+  };
+  if (this->pool != NULL) this->pool->run(job); else job(0);
+}
+
+bool* World::evolve_blocked(int steps) {
+  steps = std::max(1, steps);
+  if (this->collect_statistics) {
+    // The statistics are computed by the scalar loop, per generation.
+    for (int s = 0; s < steps; s++) evolve_scalar();
+    return this->grid;
+  }
+
+  bool tracking = track_step();
+  if (this->rule.is_conway()) {
+    evolve_blocked_rule(ConwayStep(), steps, tracking);
+  } else {
+    evolve_blocked_rule(TableStep(this->rule), steps, tracking);
+  }
+
+  // Swap old and new grid and increment generation counter.
+  std::swap(this->grid, this->nextGrid);
+  this->generation += steps;
+  this->band_passes++;
+  if (tracking) this->tracked_generation = this->generation;
+
+  return this->grid;
+}
@@ -0,0 +1,198 @@
+#include "Census.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+// Number of soups a worker evaluates before publishing its tally.
+static const uint64_t BATCH_SIZE = 64;
+
+Census::Census(int soup_size, int world_size, uint64_t seed, int threads, long max_generations, const Rule& rule)
+    : rng(seed), next_soup(0), pending(nullptr), running_workers(0) {
+  // Objects are classified on the infinite plane, which B0 rules would fill completely.
+  if (rule.birth & 1) {
+    throw std::invalid_argument("The census does not support B0 rules: " + rule.to_string());
+  }
+  this->rule = rule;
+  this->soup_size = soup_size;
+  this->world_size = std::max(world_size, soup_size);
+  this->threads = std::max(threads, 1);
+  this->max_generations = max_generations;
+  this->max_period = 64;
+}
+
+void Census::fill_soup(World& world, uint64_t index) {
+  world.clear();
+  int offset_y = (world.height - this->soup_size) / 2;
+  int offset_x = (world.width - this->soup_size) / 2;
+  uint64_t bits = 0;
+  int cell = 0;
+  for (int y = 0; y < this->soup_size; y++) {
+    for (int x = 0; x < this->soup_size; x++, cell++) {
+      // Draw 64 cells per RNG call.
+      if (cell % 64 == 0) bits = this->rng.at(index, cell / 64);
+      world.grid[(y + offset_y) * world.width + x + offset_x] = (bits >> (cell % 64)) & 1;
+    }
+  }
+}
+
+bool Census::run_to_stabilisation(World& world) {
+  std::unordered_map<uint64_t, long> seen;
+  seen.reserve(1024);
+  seen[world.fingerprint()] = world.generation;
+  while (world.generation < this->max_generations) {
+    world.evolve();
+    // A repeated grid state means the whole world is periodic, e.g. only still lifes and oscillators are left.
+    if (!seen.emplace(world.fingerprint(), world.generation).second) return true;
+  }
+  return false;
+}
+
+std::vector<CellList> Census::segment(World& world) {
+  std::vector<CellList> objects;
+  std::vector<char> visited(world.N, 0);
+  std::vector<std::pair<int, int> > stack;
+
+  for (int y = 0; y < world.height; y++) {
+    for (int x = 0; x < world.width; x++) {
+      if (!world.grid[y * world.width + x] || visited[y * world.width + x]) continue;
+
+      // Flood fill with unwrapped coordinates so that objects on the seam of the torus stay in one piece.
+      CellList object;
+      visited[y * world.width + x] = 1;
+      stack.push_back(std::make_pair(x, y));
+      while (!stack.empty()) {
+        std::pair<int, int> c = stack.back();
+        stack.pop_back();
+        object.push_back(c);
+        for (int dy = -2; dy <= 2; dy++) {
+          for (int dx = -2; dx <= 2; dx++) {
+            int ux = c.first + dx;
+            int uy = c.second + dy;
+            int sx = ((ux % world.width) + world.width) % world.width;
+            int sy = ((uy % world.height) + world.height) % world.height;
+            if (world.grid[sy * world.width + sx] && !visited[sy * world.width + sx]) {
+              visited[sy * world.width + sx] = 1;
+              stack.push_back(std::make_pair(ux, uy));
+            }
+          }
+        }
+      }
+      objects.push_back(object);
+    }
+  }
+  return objects;
+}
+
+void Census::publish(Tally* tally) {
+  tally->next = this->pending.load(std::memory_order_relaxed);
+  while (!this->pending.compare_exchange_weak(tally->next, tally,
+                                              std::memory_order_release, std::memory_order_relaxed)) {
+  }
+}
+
+void Census::worker(uint64_t soups) {
+  World world(this->world_size, this->world_size);
+  world.set_engine(Engine::Scalar);
+  // Stabilisation checks hash only the tiles that changed.
+  world.set_fingerprints(true);
+  world.set_rule(this->rule);
+
+  Tally* tally = new Tally();
+  uint64_t index;
+  while ((index = this->next_soup.fetch_add(1, std::memory_order_relaxed)) < soups) {
+    fill_soup(world, index);
+    if (run_to_stabilisation(world)) {
+      for (const CellList& object : segment(world)) {
+        tally->counts[classify_object(object, this->max_period, this->rule).code]++;
+      }
+    } else {
+      tally->counts["zz_UNSTABLE"]++;
+    }
+    tally->soups++;
+
+    if (tally->soups == BATCH_SIZE) {
+      publish(tally);
+      tally = new Tally();
+    }
+  }
+  publish(tally);
+  this->running_workers--;
+}
+
+void Census::collect() {
+  // The collector is the only consumer and takes the whole stack at once, so there is no ABA problem.
+  Tally* tally = this->pending.exchange(nullptr, std::memory_order_acquire);
+  while (tally != nullptr) {
+    for (const auto& entry : tally->counts) {
+      this->totals[entry.first] += entry.second;
+    }
+    this->soups_done += tally->soups;
+    Tally* next = tally->next;
+    delete tally;
+    tally = next;
+  }
+}
+
+void Census::write_results(const std::string& file_name, double seconds) {
+  std::vector<std::pair<std::string, uint64_t> > sorted(this->totals.begin(), this->totals.end());
+  std::stable_sort(sorted.begin(), sorted.end(),
+                   [](const std::pair<std::string, uint64_t>& a, const std::pair<std::string, uint64_t>& b) {
+                     return a.second > b.second;
+                   });
+
+  // Write to a temporary file first, so readers never see a half written result.
+  std::string tmp_name = file_name + ".tmp";
+  std::ofstream file(tmp_name);
+  if (!file.is_open()) {
+    throw std::runtime_error("Unable to create file: " + tmp_name);
+  }
+  file << "# soups = " << this->soups_done << "\n";
+  file << "# seed = " << this->rng.key << "\n";
+  file << "# rule = " << this->rule.to_string() << "\n";
+  file << "# soup = " << this->soup_size << "x" << this->soup_size
+       << " on a " << this->world_size << "x" << this->world_size << " torus\n";
+  file << "# soups/second = " << (seconds > 0 ? this->soups_done / seconds : 0) << "\n";
+  for (const auto& entry : sorted) {
+    file << entry.first << " " << entry.second << "\n";
+  }
+  file.close();
+  std::rename(tmp_name.c_str(), file_name.c_str());
+}
+
+void Census::run(uint64_t soups, const std::string& file_name) {
+  this->next_soup = 0;
+  this->running_workers = this->threads;
+
+  auto start = std::chrono::high_resolution_clock::now();
+  std::vector<std::thread> workers;
+  for (int i = 0; i < this->threads; i++) {
+    workers.emplace_back(&Census::worker, this, soups);
+  }
+
+  // Stream the totals while the workers are running.
+  while (this->running_workers > 0) {
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    collect();
+    double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+    write_results(file_name, seconds);
+    std::cout << "Census: " << this->soups_done << "/" << soups << " soups, "
+              << this->soups_done / seconds << " soups/second" << std::endl;
+  }
+  for (std::thread& worker : workers) {
+    worker.join();
+  }
+
+  collect();
+  double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+  write_results(file_name, seconds);
+  std::cout << "Census finished: " << this->soups_done << " soups in " << seconds << " s ("
+            << this->soups_done / seconds << " soups/second), " << this->totals.size()
+            << " distinct objects. Results in " << file_name << std::endl;
+}
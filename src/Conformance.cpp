@@ -0,0 +1,178 @@
+#include "Conformance.h"
+#include "FixedEngine.h"
+
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+
+Conformance::Conformance(const std::vector<Engine>& engines, const std::vector<std::string>& sizes,
+                         const std::vector<Rule>& rules, const std::vector<std::string>& fills,
+                         const std::vector<uint64_t>& seeds, const std::vector<int>& threads,
+                         long generations, const std::vector<int>& block_steps, const std::string& device, bool adaptive) {
+  this->engines = engines;
+  this->adaptive = adaptive;
+  this->threads = threads.empty() ? std::vector<int>{1} : threads;
+  this->generations = std::max(1L, generations);
+  for (int steps : block_steps) this->block_steps.push_back(std::max(1, steps));
+  if (this->block_steps.empty()) this->block_steps.push_back(1);
+  this->device = device;
+  for (const std::string& size : sizes) {
+    size_t separator = size.find('x');
+    if (separator == std::string::npos) throw std::invalid_argument("Size is not height x width: " + size);
+    int height = std::stoi(size.substr(0, separator));
+    int width = std::stoi(size.substr(separator + 1));
+    if (height < 1 || width < 1) throw std::invalid_argument("Size is not height x width: " + size);
+    for (const Rule& rule : rules) {
+      for (const std::string& fill : fills) {
+        if (fill != "random" && fill != "patterns") throw std::invalid_argument("Unknown fill: " + fill);
+        for (uint64_t seed : seeds) {
+          this->cases.push_back({height, width, rule, fill, seed});
+        }
+      }
+    }
+  }
+}
+
+void Conformance::fill(World& world, const Case& test) {
+  if (test.fill == "patterns") {
+    world.fill_patterns({}, std::max<long>(1, (long)world.N / 64), test.seed);
+  } else {
+    world.fill_random(0.3, test.seed);
+  }
+}
+
+std::vector<uint64_t> Conformance::reference_hashes(const Case& test) {
+  World world(test.height, test.width);
+  world.set_engine(Engine::Scalar);
+  // The generic loop, the FixedEngine sizes are checked against it.
+  world.set_fixed_sizes(false);
+  world.set_rule(test.rule);
+  fill(world, test);
+  std::vector<uint64_t> hashes;
+  hashes.reserve(this->generations + 1);
+  hashes.push_back(grid_hash(world.grid, world.N));
+  for (long g = 0; g < this->generations; g++) {
+    world.evolve();
+    hashes.push_back(grid_hash(world.grid, world.N));
+  }
+  return hashes;
+}
+
+void Conformance::report_divergence(const Case& test, const World& world, long generation, std::ostream& out) {
+  World reference(test.height, test.width);
+  reference.set_engine(Engine::Scalar);
+  reference.set_fixed_sizes(false);
+  reference.set_rule(test.rule);
+  fill(reference, test);
+  while (reference.generation < generation) reference.evolve();
+  for (ulong i = 0; i < reference.N; i++) {
+    if (reference.grid[i] == world.grid[i]) continue;
+    out << "\tfirst divergent cell: generation " << generation << ", y " << i / test.width << ", x " << i % test.width
+        << ", expected " << reference.grid[i] << ", got " << world.grid[i] << std::endl;
+    return;
+  }
+  // Same cells, different hash can't happen; a wrong generation counter can.
+  out << "\tgeneration counter " << world.generation << ", expected " << generation << std::endl;
+}
+
+Conformance::Result Conformance::check(const Case& test, Engine engine, bool adaptive, bool fixed, int threads, int steps,
+                        const std::vector<uint64_t>& reference, std::ostream& out) {
+  // Printed with the result, the world setup writes to the console too.
+  std::string name = (adaptive ? std::string("adaptive") : fixed && engine == Engine::Scalar ? std::string("fixed") : engine_name(engine)) + "\t" + test.rule.to_string() + "\t" + std::to_string(test.height) + "x"
+                   + std::to_string(test.width) + "\t" + test.fill + ":" + std::to_string(test.seed) + "\t"
+                   + std::to_string(threads) + "\t" + std::to_string(steps) + "\t";
+  World world(test.height, test.width);
+  try {
+    world.set_rule(test.rule);
+    world.set_threads(threads);
+    world.set_fixed_sizes(fixed);
+    world.set_block_steps(steps);
+    if (this->device != "") world.set_device(DeviceSelection::parse(this->device));
+    // Last, OpenCL is built for the settings above.
+    world.set_engine(engine);
+    // The adaptive run has OpenCL among its candidates when the opencl engine is compared too.
+    if (adaptive && std::find(this->engines.begin(), this->engines.end(), Engine::OpenCL) != this->engines.end()) {
+      world.init_OpenCL();
+    }
+  } catch (const std::exception& e) {
+    out << name << "skipped\t" << e.what() << std::endl;
+    return Result::Skipped;
+  }
+  fill(world, test);
+  if (adaptive) {
+    // Short intervals and trials of every candidate at every sample, so the run switches engines
+    // (and back to OpenCL from the host engines) many times.
+    AdaptiveOptions options;
+    options.interval = 16;
+    options.trial = 4;
+    options.margin = 0;
+    options.dwell = 0;
+    options.stale = 0;
+    world.set_adaptive(true, options);
+  }
+
+  // The blocked and OpenCL engines are compared where their passes end.
+  long stride = adaptive || engine == Engine::Blocked || engine == Engine::OpenCL ? steps : 1;
+  double seconds = 0;
+  long g = 0;
+  bool passed = true;
+  while (g < this->generations) {
+    long pass = std::min(stride, this->generations - g);
+    auto begin = std::chrono::steady_clock::now();
+    world.evolve_generations(pass);
+    seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    g += pass;
+    world.sync_grid();
+    if (world.generation != g || grid_hash(world.grid, world.N) != reference[g]) {
+      passed = false;
+      break;
+    }
+  }
+
+  out << name << (passed ? "ok" : "FAILED") << "\t" << g << "\t" << (seconds > 0 ? g * (double)world.N / seconds / 1e6 : 0) << std::endl;
+  if (!passed) report_divergence(test, world, g, out);
+  return passed ? Result::Passed : Result::Diverged;
+}
+
+int Conformance::run(std::ostream& out) {
+  int failures = 0;
+  this->skipped = 0;
+  // Skipped runs (engine not available here) are no evidence either way.
+  auto count = [&](Result result) {
+    if (result == Result::Diverged) failures++;
+    if (result == Result::Skipped) this->skipped++;
+  };
+  out << "engine\trule\tsize\tfill\tthreads\tsteps\tresult\tgenerations\tMcells/s" << std::endl;
+  const std::vector<int> single = {1};
+  for (const Case& test : this->cases) {
+    std::vector<uint64_t> reference = reference_hashes(test);
+    for (Engine engine : this->engines) {
+      // The OpenCL engines don't use the worker pool.
+      bool cpu = engine != Engine::OpenCL && engine != Engine::Split;
+      // Only the blocked and OpenCL engines have passes: 1 is the single generation path (evolve on OpenCL).
+      bool passes = engine == Engine::Blocked || engine == Engine::OpenCL;
+      for (int threads : this->threads) {
+        for (int steps : passes ? this->block_steps : single) {
+          count(check(test, engine, false, false, threads, steps, reference, out));
+        }
+        if (!cpu) break;
+      }
+      // Single-threaded scalar runs these sizes on FixedEngine, its own row.
+      if (engine == Engine::Scalar && find_fixed_step(test.height, test.width, test.rule) != NULL) {
+        count(check(test, engine, false, true, 1, 1, reference, out));
+      }
+    }
+    if (this->adaptive) {
+      for (int threads : this->threads) {
+        for (int steps : this->block_steps) {
+          count(check(test, Engine::Scalar, true, true, threads, steps, reference, out));
+        }
+      }
+    }
+  }
+  std::string verdict = failures == 0 ? (this->skipped == 0 ? "all engines conform" : "all engines that ran conform")
+                                      : std::to_string(failures) + " runs diverged";
+  if (this->skipped > 0) verdict += ", " + std::to_string(this->skipped) + " runs skipped";
+  out << verdict << std::endl;
+  return failures;
+}
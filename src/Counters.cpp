@@ -0,0 +1,175 @@
+#include "Counters.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// The perf event of a counter kind, user space of the calling thread only.
+static perf_event_attr counter_attributes(int kind) {
+  perf_event_attr attributes;
+  std::memset(&attributes, 0, sizeof(attributes));
+  attributes.size = sizeof(attributes);
+  attributes.type = PERF_TYPE_HARDWARE;
+  static const uint64_t configs[COUNTER_KINDS] = {
+    PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES
+  };
+  attributes.config = configs[kind];
+  attributes.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+  attributes.exclude_kernel = 1;
+  attributes.exclude_hv = 1;
+  return attributes;
+}
+
+static int open_counter(int kind) {
+  perf_event_attr attributes = counter_attributes(kind);
+  return (int)syscall(SYS_perf_event_open, &attributes, 0, -1, -1, 0);
+}
+
+void CounterValues::add(const CounterValues& other) {
+  for (int i = 0; i < COUNTER_KINDS; i++) this->counts[i] += other.counts[i];
+}
+
+StepCounters::ThreadCounters::ThreadCounters(const bool* enabled) {
+  this->owner = std::this_thread::get_id();
+  for (int i = 0; i < COUNTER_KINDS; i++) {
+    this->fds[i] = enabled[i] ? open_counter(i) : -1;
+  }
+}
+
+StepCounters::ThreadCounters::~ThreadCounters() {
+  for (int fd : this->fds) {
+    if (fd >= 0) close(fd);
+  }
+}
+
+void StepCounters::ThreadCounters::begin() {
+  for (int i = 0; i < COUNTER_KINDS; i++) {
+    if (this->fds[i] < 0 || read(this->fds[i], this->start[i], sizeof(this->start[i])) != sizeof(this->start[i])) {
+      std::memset(this->start[i], 0, sizeof(this->start[i]));
+    }
+  }
+}
+
+CounterValues StepCounters::ThreadCounters::end() {
+  CounterValues values;
+  for (int i = 0; i < COUNTER_KINDS; i++) {
+    uint64_t now[3];
+    if (this->fds[i] < 0 || read(this->fds[i], now, sizeof(now)) != sizeof(now)) continue;
+    double count = (double)(now[0] - this->start[i][0]);
+    uint64_t enabled = now[1] - this->start[i][1];
+    uint64_t running = now[2] - this->start[i][2];
+    // Multiplexed with other events: extrapolate to the whole step.
+    if (running > 0 && running < enabled) count = count * enabled / running;
+    values.counts[i] = count;
+  }
+  return values;
+}
+
+StepCounters::StepCounters(long cells) {
+  this->cells = cells;
+  reset();
+  for (int i = 0; i < COUNTER_KINDS; i++) {
+    int fd = open_counter(i);
+    this->enabled[i] = fd >= 0;
+    if (fd >= 0) close(fd);
+  }
+}
+
+StepCounters::~StepCounters() { }
+
+void StepCounters::begin_step(int threads) {
+  if ((int)this->counters.size() < threads) {
+    this->counters.resize(threads);
+    this->thread_values.resize(threads);
+  }
+  this->step_values.assign(threads, CounterValues());
+  this->step_begin = std::chrono::steady_clock::now();
+}
+
+void StepCounters::start(int thread) {
+  std::unique_ptr<ThreadCounters>& counters = this->counters[thread];
+  // The caller of index 0 can change between steps (e.g. the autoplay thread).
+  if (counters == nullptr || counters->owner != std::this_thread::get_id()) {
+    counters.reset(new ThreadCounters(this->enabled));
+  }
+  counters->begin();
+}
+
+void StepCounters::stop(int thread) {
+  // Only this thread touches its entries until end_step.
+  this->step_values[thread].add(this->counters[thread]->end());
+}
+
+void StepCounters::end_step(long generation, long generations) {
+  GenerationCounters step;
+  step.generation = generation;
+  step.steps = generations;
+  step.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - this->step_begin).count();
+  for (size_t i = 0; i < this->step_values.size(); i++) {
+    step.values.add(this->step_values[i]);
+    this->thread_values[i].add(this->step_values[i]);
+  }
+  // Running totals only, long runs must not grow with the number of steps.
+  this->totals.generation = step.generation;
+  this->totals.steps += step.steps;
+  this->totals.seconds += step.seconds;
+  this->totals.values.add(step.values);
+  if (this->slowest.steps == 0 || step.values[Counter::Cycles] / step.steps > this->slowest.values[Counter::Cycles] / this->slowest.steps) {
+    this->slowest = step;
+  }
+}
+
+void StepCounters::reset() {
+  this->totals = GenerationCounters{0, 0, 0, CounterValues()};
+  this->slowest = this->totals;
+  std::fill(this->thread_values.begin(), this->thread_values.end(), CounterValues());
+}
+
+CounterMetrics StepCounters::metrics(const GenerationCounters& step, double peak_bandwidth) const {
+  CounterMetrics metrics;
+  double cycles = step.values[Counter::Cycles];
+  if (cycles > 0) {
+    metrics.cells_per_cycle = (double)this->cells * step.steps / cycles;
+    metrics.instructions_per_cycle = step.values[Counter::Instructions] / cycles;
+  }
+  metrics.bytes = step.values[Counter::CacheMisses] * line_size();
+  if (step.seconds > 0) metrics.bandwidth = metrics.bytes / step.seconds;
+  if (peak_bandwidth > 0) metrics.peak_fraction = metrics.bandwidth / peak_bandwidth;
+  return metrics;
+}
+
+size_t StepCounters::line_size() {
+  static const size_t size = [] {
+    long bytes = sysconf(_SC_LEVEL1_DCACHE_LINESIZE);
+    return bytes > 0 ? (size_t)bytes : (size_t)64;
+  }();
+  return size;
+}
+
+double StepCounters::peak_bandwidth() {
+  static const double peak = [] {
+    // 256 MiB per buffer, far beyond the last level cache of current hosts.
+    const size_t bytes = (size_t)256 << 20;
+    int threads = std::max(1, (int)std::thread::hardware_concurrency());
+    std::vector<char> source(bytes, 1), target(bytes, 0);
+    double best = 0;
+    for (int repeat = 0; repeat < 3; repeat++) {
+      auto begin = std::chrono::steady_clock::now();
+      std::vector<std::thread> copies;
+      for (int t = 0; t < threads; t++) {
+        copies.emplace_back([&, t] {
+          size_t first = bytes * t / threads, last = bytes * (t + 1) / threads;
+          std::memcpy(target.data() + first, source.data() + first, last - first);
+        });
+      }
+      for (std::thread& copy : copies) copy.join();
+      double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+      if (seconds > 0) best = std::max(best, 2.0 * bytes / seconds);
+    }
+    return best;
+  }();
+  return peak;
+}
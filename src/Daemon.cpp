@@ -0,0 +1,324 @@
+#include "Daemon.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Little-endian fields of the protocol.
+static void put_le(std::vector<uint8_t>& out, uint64_t value, int bytes) {
+  for (int i = 0; i < bytes; i++) out.push_back((uint8_t)(value >> (8 * i)));
+}
+
+static void put_string(std::vector<uint8_t>& out, const std::string& text) {
+  put_le(out, text.size(), 2);
+  out.insert(out.end(), text.begin(), text.end());
+}
+
+// Bounds-checked reading of a request payload.
+class RequestReader {
+private:
+  const std::vector<uint8_t>& data;
+  size_t position = 0;
+
+  const uint8_t* take(size_t bytes) {
+    if (data.size() - position < bytes) throw std::invalid_argument("Truncated request");
+    position += bytes;
+    return data.data() + position - bytes;
+  }
+
+public:
+  explicit RequestReader(const std::vector<uint8_t>& data) : data(data) { }
+
+  uint64_t le(int bytes) {
+    const uint8_t* p = take(bytes);
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; i++) value |= (uint64_t)p[i] << (8 * i);
+    return value;
+  }
+  int32_t i32() { return (int32_t)le(4); }
+  int64_t i64() { return (int64_t)le(8); }
+
+  std::string string() {
+    size_t length = le(2);
+    const uint8_t* p = take(length);
+    return std::string((const char*)p, length);
+  }
+
+  const uint8_t* bytes(size_t count) { return take(count); }
+};
+
+static bool read_all(int socket, uint8_t* data, size_t size) {
+  while (size > 0) {
+    ssize_t n = recv(socket, data, size, 0);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    data += n;
+    size -= n;
+  }
+  return true;
+}
+
+static bool write_all(int socket, const uint8_t* data, size_t size) {
+  while (size > 0) {
+    // No SIGPIPE if the client is gone.
+    ssize_t n = send(socket, data, size, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    data += n;
+    size -= n;
+  }
+  return true;
+}
+
+// File names of LOAD and SNAPSHOT stay inside configurations/: no directories, no way up.
+static const std::string& check_file_name(const std::string& name) {
+  if (name.empty() || name.find('/') != std::string::npos || name.find("..") != std::string::npos
+      || name.find('\0') != std::string::npos) {
+    throw std::invalid_argument("Invalid file name: " + name);
+  }
+  return name;
+}
+
+static void check_region(int y, int x, int rows, int columns, int height, int width) {
+  if (y < 0 || x < 0 || rows < 0 || columns < 0 || y + (long)rows > height || x + (long)columns > width) {
+    throw std::out_of_range("Region outside the world");
+  }
+}
+
+Daemon::Daemon(const std::string& socket_path, int threads) {
+  this->socket_path = socket_path;
+  this->threads = threads;
+  sockaddr_un address;
+  std::memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (socket_path.size() >= sizeof(address.sun_path)) {
+    throw std::runtime_error("Socket path too long: " + socket_path);
+  }
+  std::memcpy(address.sun_path, socket_path.c_str(), socket_path.size());
+
+  this->listener = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (this->listener < 0) throw std::runtime_error("Unable to create socket: " + std::string(std::strerror(errno)));
+  // A socket file left by an earlier daemon would make bind fail.
+  unlink(socket_path.c_str());
+  if (bind(this->listener, (sockaddr*)&address, sizeof(address)) < 0 || listen(this->listener, 64) < 0) {
+    std::string reason = std::strerror(errno);
+    close(this->listener);
+    throw std::runtime_error("Unable to listen on " + socket_path + ": " + reason);
+  }
+}
+
+Daemon::~Daemon() {
+  close(this->listener);
+  unlink(this->socket_path.c_str());
+}
+
+void Daemon::stop() {
+  this->stopping = true;
+}
+
+size_t Daemon::world_count() {
+  std::lock_guard<std::mutex> lock(this->worlds_mutex);
+  return this->worlds.size();
+}
+
+void Daemon::run() {
+  while (!this->stopping) {
+    // Wake up regularly to notice stop.
+    pollfd waiting = {this->listener, POLLIN, 0};
+    int ready = poll(&waiting, 1, 200);
+    if (ready <= 0) continue;
+    int client = accept(this->listener, NULL, NULL);
+    if (client < 0) continue;
+
+    // Join the threads of closed connections.
+    for (auto it = this->connections.begin(); it != this->connections.end();) {
+      if (!it->done) {
+        ++it;
+        continue;
+      }
+      it->thread.join();
+      it = this->connections.erase(it);
+    }
+    std::lock_guard<std::mutex> lock(this->sockets_mutex);
+    this->connections.emplace_back();
+    Connection& connection = this->connections.back();
+    connection.socket = client;
+    connection.thread = std::thread(&Daemon::serve, this, std::ref(connection));
+  }
+
+  {
+    // Ends the blocking reads of the connection threads.
+    std::lock_guard<std::mutex> lock(this->sockets_mutex);
+    for (Connection& connection : this->connections) {
+      if (!connection.done) shutdown(connection.socket, SHUT_RDWR);
+    }
+  }
+  for (Connection& connection : this->connections) connection.thread.join();
+  this->connections.clear();
+}
+
+void Daemon::serve(Connection& connection) {
+  std::vector<uint8_t> request;
+  std::vector<uint8_t> response;
+  while (true) {
+    uint8_t header[9];
+    if (!read_all(connection.socket, header, 4)) break;
+    uint32_t size = header[0] | header[1] << 8 | header[2] << 16 | (uint32_t)header[3] << 24;
+    if (size < 5 || size > MAX_REQUEST || !read_all(connection.socket, header + 4, 5)) break;
+    DaemonCommand command = (DaemonCommand)header[4];
+    uint32_t world = header[5] | header[6] << 8 | header[7] << 16 | (uint32_t)header[8] << 24;
+    request.resize(size - 5);
+    if (!read_all(connection.socket, request.data(), request.size())) break;
+
+    response.assign(5, 0);
+    try {
+      std::vector<uint8_t> payload = handle(command, world, request);
+      response.insert(response.end(), payload.begin(), payload.end());
+    } catch (const std::exception& e) {
+      response.resize(5);
+      response[4] = 1;
+      std::string message = e.what();
+      response.insert(response.end(), message.begin(), message.end());
+    }
+    uint32_t length = response.size() - 4;
+    for (int i = 0; i < 4; i++) response[i] = (uint8_t)(length >> (8 * i));
+    if (!write_all(connection.socket, response.data(), response.size())) break;
+  }
+
+  std::lock_guard<std::mutex> lock(this->sockets_mutex);
+  close(connection.socket);
+  connection.done = true;
+}
+
+uint32_t Daemon::add(std::shared_ptr<Resident> resident, const std::string& engine) {
+  // Set up before the world is visible: OpenCL discovery, kernel build and buffers are paid once.
+  // A missing device or a failed build throws, and the client gets the error instead of a world.
+  resident->world.set_threads(this->threads);
+  resident->world.set_engine(parse_engine(engine.empty() ? "lookup" : engine));
+  std::lock_guard<std::mutex> lock(this->worlds_mutex);
+  uint32_t id = this->next_world++;
+  this->worlds[id] = resident;
+  return id;
+}
+
+std::shared_ptr<Daemon::Resident> Daemon::find(uint32_t world) {
+  std::lock_guard<std::mutex> lock(this->worlds_mutex);
+  auto it = this->worlds.find(world);
+  if (it == this->worlds.end()) throw std::invalid_argument("Unknown world: " + std::to_string(world));
+  return it->second;
+}
+
+std::vector<uint8_t> Daemon::handle(DaemonCommand command, uint32_t world, const std::vector<uint8_t>& request) {
+  RequestReader reader(request);
+  std::vector<uint8_t> response;
+
+  if (command == DaemonCommand::Create) {
+    int height = reader.i32();
+    int width = reader.i32();
+    std::string engine = reader.string();
+    std::string rule = reader.string();
+    if (height <= 0 || width <= 0) throw std::invalid_argument("Height and width have to be positive");
+    auto resident = std::make_shared<Resident>(height, width);
+    if (!rule.empty()) resident->world.set_rule(Rule::parse(rule));
+    put_le(response, add(resident, engine), 4);
+    return response;
+  }
+  if (command == DaemonCommand::Load) {
+    std::string engine = reader.string();
+    std::string file_name = check_file_name(reader.string());
+    put_le(response, add(std::make_shared<Resident>(file_name), engine), 4);
+    return response;
+  }
+  if (command == DaemonCommand::Destroy) {
+    std::lock_guard<std::mutex> lock(this->worlds_mutex);
+    // Deleted when the last command still running on it is done.
+    if (this->worlds.erase(world) == 0) throw std::invalid_argument("Unknown world: " + std::to_string(world));
+    return response;
+  }
+
+  std::shared_ptr<Resident> resident = find(world);
+  std::lock_guard<std::mutex> lock(resident->mutex);
+  World& w = resident->world;
+  switch (command) {
+  case DaemonCommand::Step: {
+    long generations = reader.i64();
+    if (generations < 0) throw std::invalid_argument("Negative number of generations");
+    w.evolve_generations(generations);
+    put_le(response, w.getGeneration(), 8);
+    break;
+  }
+  case DaemonCommand::Query: {
+    int y = reader.i32(), x = reader.i32(), rows = reader.i32(), columns = reader.i32();
+    GridView view = w.view();
+    check_region(y, x, rows, columns, view.height, view.width);
+    put_le(response, view.generation, 8);
+    size_t row_bytes = (columns + 7) / 8;
+    size_t start = response.size();
+    response.resize(start + row_bytes * rows, 0);
+    for (int r = 0; r < rows; r++) {
+      const bool* cells = view.row(y + r) + x;
+      uint8_t* dest = response.data() + start + r * row_bytes;
+      int c = 0;
+      // 8 cells (bytes of 0 or 1) per multiply: bit i of the result is byte i.
+      for (; c + 8 <= columns; c += 8) {
+        uint64_t bytes;
+        std::memcpy(&bytes, cells + c, sizeof(bytes));
+        dest[c / 8] = (uint8_t)((bytes * 0x0102040810204080ULL) >> 56);
+      }
+      for (; c < columns; c++) dest[c / 8] |= cells[c] << (c % 8);
+    }
+    break;
+  }
+  case DaemonCommand::Set: {
+    int y = reader.i32(), x = reader.i32(), rows = reader.i32(), columns = reader.i32();
+    GridView view = w.view();
+    check_region(y, x, rows, columns, view.height, view.width);
+    size_t row_bytes = (columns + 7) / 8;
+    const uint8_t* bits = reader.bytes(row_bytes * rows);
+    std::vector<uint8_t> cells((size_t)rows * columns);
+    for (int r = 0; r < rows; r++) {
+      for (int c = 0; c < columns; c++) {
+        cells[(size_t)r * columns + c] = (bits[r * row_bytes + c / 8] >> (c % 8)) & 1;
+      }
+    }
+    w.set_region(y, x, rows, columns, cells.data(), columns);
+    break;
+  }
+  case DaemonCommand::Stats: {
+    // From the packed words: population by popcount, bounding box from the set bits.
+    PackedView view = w.packed_view();
+    uint64_t population = 0;
+    int min_x = -1, min_y = -1, max_x = -1, max_y = -1;
+    for (int y = 0; y < view.height; y++) {
+      const uint64_t* row = view.row(y);
+      for (size_t j = 0; j < view.words_per_row; j++) {
+        if (row[j] == 0) continue;
+        population += __builtin_popcountll(row[j]);
+        int first = 64 * j + __builtin_ctzll(row[j]);
+        int last = 64 * j + 63 - __builtin_clzll(row[j]);
+        if (min_y < 0) min_y = y;
+        max_y = y;
+        min_x = min_x < 0 ? first : std::min(min_x, first);
+        max_x = std::max(max_x, last);
+      }
+    }
+    put_le(response, view.generation, 8);
+    put_le(response, population, 8);
+    for (int value : {min_x, min_y, max_x, max_y}) put_le(response, (uint32_t)value, 4);
+    put_string(response, engine_name(w.engine));
+    break;
+  }
+  case DaemonCommand::Snapshot:
+    w.save_gamestate(check_file_name(reader.string()));
+    break;
+  default:
+    throw std::invalid_argument("Unknown command: " + std::to_string((int)command));
+  }
+  return response;
+}
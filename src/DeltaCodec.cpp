@@ -0,0 +1,64 @@
+#include "DeltaCodec.h"
+
+#include <cstring>
+#include <stdexcept>
+
+void put_varint(std::vector<uint8_t>& out, uint64_t value) {
+  while (value >= 0x80) {
+    out.push_back((uint8_t)(value | 0x80));
+    value >>= 7;
+  }
+  out.push_back((uint8_t)value);
+}
+
+bool get_varint(const uint8_t*& data, const uint8_t* end, uint64_t& value) {
+  value = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    if (data == end) return false;
+    uint8_t byte = *data++;
+    value |= (uint64_t)(byte & 0x7F) << shift;
+    if (!(byte & 0x80)) return true;
+  }
+  return false;
+}
+
+// Cell i of previous (0 if there is no previous grid) differs from cell i of current.
+static inline bool differs(const bool* previous, const bool* current, size_t i) {
+  return previous != NULL ? previous[i] != current[i] : current[i];
+}
+
+void encode_delta(const bool* previous, const bool* current, size_t cells, std::vector<uint8_t>& out) {
+  size_t i = 0;
+  while (i < cells) {
+    // Skip unchanged cells 8 at a time, most of a grid doesn't change between generations.
+    size_t begin = i;
+    while (i + 8 <= cells) {
+      uint64_t a = 0, b;
+      if (previous != NULL) std::memcpy(&a, previous + i, sizeof(a));
+      std::memcpy(&b, current + i, sizeof(b));
+      if (a != b) break;
+      i += 8;
+    }
+    while (i < cells && !differs(previous, current, i)) i++;
+    if (i == cells) break;
+
+    size_t changed = i;
+    while (i < cells && differs(previous, current, i)) i++;
+    put_varint(out, changed - begin);
+    put_varint(out, i - changed);
+  }
+}
+
+void apply_delta(const uint8_t* data, size_t size, bool* cells, size_t count) {
+  const uint8_t* end = data + size;
+  size_t i = 0;
+  while (data != end) {
+    uint64_t unchanged, changed;
+    if (!get_varint(data, end, unchanged) || !get_varint(data, end, changed)
+        || unchanged > count - i || changed > count - i - unchanged) {
+      throw std::runtime_error("Corrupt delta");
+    }
+    i += unchanged;
+    for (size_t stop = i + changed; i < stop; i++) cells[i] = !cells[i];
+  }
+}
@@ -0,0 +1,316 @@
+#include "DeltaLog.h"
+#include "DeltaCodec.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+static const char HEADER_MAGIC[8] = {'G', 'O', 'L', 'D', 'E', 'L', 'T', 'A'};
+static const char INDEX_MAGIC[8] = {'G', 'O', 'L', 'I', 'N', 'D', 'E', 'X'};
+static const uint64_t VERSION = 1;
+// Frame kinds.
+static const uint8_t DELTA = 0;
+static const uint8_t KEYFRAME = 1;
+static const uint8_t INDEX = 2;
+// Index offset (8 bytes, little endian) and magic.
+static const size_t TRAILER_SIZE = 16;
+
+static bool read_varint(std::istream& in, uint64_t& value, uint64_t& offset) {
+  value = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    int byte = in.get();
+    if (byte == EOF) return false;
+    offset++;
+    value |= (uint64_t)(byte & 0x7F) << shift;
+    if (!(byte & 0x80)) return true;
+  }
+  return false;
+}
+
+DeltaLogWriter::DeltaLogWriter(const std::string& file_name, int height, int width, int keyframe_interval) {
+  this->height = height;
+  this->width = width;
+  this->cells = (size_t)height * width;
+  this->keyframe_interval = std::max(1, keyframe_interval);
+  this->file.open(file_name, std::ios::binary | std::ios::trunc);
+  if (!this->file.is_open()) {
+    throw std::runtime_error("Unable to create file: " + file_name);
+  }
+  std::vector<uint8_t> header(HEADER_MAGIC, HEADER_MAGIC + sizeof(HEADER_MAGIC));
+  put_varint(header, VERSION);
+  put_varint(header, height);
+  put_varint(header, width);
+  put_varint(header, this->keyframe_interval);
+  write(header);
+  this->last.reset(new bool[this->cells]);
+  this->encoder = std::thread(&DeltaLogWriter::encoder_loop, this);
+}
+
+DeltaLogWriter::~DeltaLogWriter() {
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->stop = true;
+  }
+  this->changed.notify_all();
+  this->encoder.join();
+
+  // The index goes last, so the frames could be appended without knowing how many there will be.
+  uint64_t index_offset = this->bytes;
+  std::vector<uint8_t> index(1, INDEX);
+  put_varint(index, this->runs.size());
+  for (const LogRun& run : this->runs) {
+    put_varint(index, (uint64_t)run.generation);
+    put_varint(index, run.offset);
+    put_varint(index, (uint64_t)run.frames);
+  }
+  for (int i = 0; i < 8; i++) index.push_back((uint8_t)(index_offset >> (8 * i)));
+  index.insert(index.end(), INDEX_MAGIC, INDEX_MAGIC + sizeof(INDEX_MAGIC));
+  write(index);
+  // Errors can't be reported from here, a log without a valid index is scanned by the reader.
+  this->file.close();
+}
+
+void DeltaLogWriter::write(const std::vector<uint8_t>& data) {
+  this->file.write((const char*)data.data(), data.size());
+  this->bytes += data.size();
+}
+
+void DeltaLogWriter::record(long generation, const bool* grid) {
+  std::unique_ptr<bool[]> buffer;
+  {
+    std::unique_lock<std::mutex> lock(this->mutex);
+    if (!this->error.empty()) throw std::runtime_error(this->error);
+    // Back pressure, so a slow disk can't use unbounded memory.
+    this->changed.wait(lock, [&] { return this->pending.size() < MAX_PENDING; });
+    if (!this->free_buffers.empty()) {
+      buffer = std::move(this->free_buffers.back());
+      this->free_buffers.pop_back();
+    }
+  }
+  if (!buffer) buffer.reset(new bool[this->cells]);
+  std::memcpy(buffer.get(), grid, sizeof(bool) * this->cells);
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->pending.push_back(Snapshot{generation, std::move(buffer)});
+  }
+  this->changed.notify_all();
+}
+
+void DeltaLogWriter::encoder_loop() {
+  std::vector<uint8_t> delta;
+  while (true) {
+    Snapshot snapshot;
+    {
+      std::unique_lock<std::mutex> lock(this->mutex);
+      this->changed.wait(lock, [&] { return this->stop || !this->pending.empty(); });
+      if (this->pending.empty()) return;
+      snapshot = std::move(this->pending.front());
+      this->pending.pop_front();
+      this->busy = true;
+    }
+
+    // A gap (or a generation recorded again after a seek) also starts with a keyframe.
+    bool keyframe = this->runs.empty() || snapshot.generation != this->last_coded + 1
+                    || this->since_keyframe + 1 >= this->keyframe_interval;
+    delta.clear();
+    encode_delta(keyframe ? NULL : this->last.get(), snapshot.cells.get(), this->cells, delta);
+    if (keyframe) this->runs.push_back(LogRun{snapshot.generation, this->bytes, 0});
+    this->runs.back().frames++;
+    this->buffer.assign(1, keyframe ? KEYFRAME : DELTA);
+    put_varint(this->buffer, (uint64_t)snapshot.generation);
+    put_varint(this->buffer, delta.size());
+    write(this->buffer);
+    write(delta);
+    this->since_keyframe = keyframe ? 0 : this->since_keyframe + 1;
+    this->last_coded = snapshot.generation;
+    // The snapshot becomes the new last grid, the old one is reused for the next record.
+    std::swap(this->last, snapshot.cells);
+
+    {
+      std::lock_guard<std::mutex> lock(this->mutex);
+      if (!this->file && this->error.empty()) this->error = "Unable to write the delta log";
+      this->frames++;
+      this->free_buffers.push_back(std::move(snapshot.cells));
+      this->busy = false;
+    }
+    this->changed.notify_all();
+  }
+}
+
+void DeltaLogWriter::wait_idle(std::unique_lock<std::mutex>& lock) {
+  this->changed.wait(lock, [&] { return this->pending.empty() && !this->busy; });
+  if (!this->error.empty()) throw std::runtime_error(this->error);
+}
+
+void DeltaLogWriter::flush() {
+  std::unique_lock<std::mutex> lock(this->mutex);
+  wait_idle(lock);
+  // The encoder waits for the next snapshot, the file is not in use.
+  this->file.flush();
+  if (!this->file) this->error = "Unable to write the delta log";
+  if (!this->error.empty()) throw std::runtime_error(this->error);
+}
+
+long DeltaLogWriter::frame_count() {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  return this->frames;
+}
+
+uint64_t DeltaLogWriter::byte_count() {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  return this->bytes;
+}
+
+DeltaLogReader::DeltaLogReader(const std::string& file_name) {
+  this->file.open(file_name, std::ios::binary);
+  if (!this->file.is_open()) {
+    throw std::runtime_error("Unable to open file: " + file_name);
+  }
+  char magic[8];
+  uint64_t offset = sizeof(magic), version, height, width, interval;
+  if (!this->file.read(magic, sizeof(magic)) || std::memcmp(magic, HEADER_MAGIC, sizeof(magic)) != 0
+      || !read_varint(this->file, version, offset) || version != VERSION
+      || !read_varint(this->file, height, offset) || !read_varint(this->file, width, offset)
+      || !read_varint(this->file, interval, offset) || height == 0 || width == 0) {
+    throw std::runtime_error("Not a delta log: " + file_name);
+  }
+  this->height = (int)height;
+  this->width = (int)width;
+  this->keyframe_interval = (int)interval;
+  this->current.reset(new bool[(size_t)height * width]);
+
+  this->file.seekg(0, std::ios::end);
+  uint64_t size = (uint64_t)this->file.tellg();
+  uint8_t trailer[TRAILER_SIZE];
+  uint64_t index_offset = 0;
+  bool indexed = false;
+  if (size >= offset + TRAILER_SIZE) {
+    this->file.seekg(size - TRAILER_SIZE);
+    this->file.read((char*)trailer, TRAILER_SIZE);
+    for (int i = 0; i < 8; i++) index_offset |= (uint64_t)trailer[i] << (8 * i);
+    indexed = this->file && std::memcmp(trailer + 8, INDEX_MAGIC, sizeof(INDEX_MAGIC)) == 0
+              && index_offset >= offset && index_offset < size - TRAILER_SIZE;
+  }
+  if (indexed) {
+    this->file.seekg(index_offset);
+    uint64_t position = index_offset + 1, count;
+    indexed = this->file.get() == INDEX && read_varint(this->file, count, position);
+    for (uint64_t i = 0; indexed && i < count; i++) {
+      uint64_t generation, run_offset, frames;
+      indexed = read_varint(this->file, generation, position) && read_varint(this->file, run_offset, position)
+                && read_varint(this->file, frames, position) && run_offset < index_offset;
+      if (indexed) this->runs.push_back(LogRun{(long)generation, run_offset, (long)frames});
+    }
+    this->end = index_offset;
+  }
+  if (!indexed) {
+    // The writer didn't finish: read the frame headers.
+    this->file.clear();
+    this->runs.clear();
+    scan(offset, size);
+  }
+  resolve_runs();
+}
+
+void DeltaLogReader::resolve_runs() {
+  // After a seek the world evolves from an earlier generation again: a run hides the generations
+  // of the earlier runs from its first generation on.
+  this->visible_end.resize(this->runs.size());
+  long limit = -1;
+  for (size_t i = this->runs.size(); i-- > 0;) {
+    const LogRun& run = this->runs[i];
+    long end = run.generation + run.frames;
+    this->visible_end[i] = limit < 0 ? end : std::max(run.generation, std::min(end, limit));
+    limit = limit < 0 ? run.generation : std::min(limit, run.generation);
+  }
+}
+
+void DeltaLogReader::scan(uint64_t begin, uint64_t size) {
+  uint64_t offset = begin;
+  this->end = begin;
+  this->file.seekg(offset);
+  while (true) {
+    int kind = this->file.get();
+    uint64_t position = offset + 1, generation, bytes;
+    if (kind == EOF || !read_varint(this->file, generation, position) || !read_varint(this->file, bytes, position)) break;
+    if (kind != KEYFRAME && (kind != DELTA || this->runs.empty()
+        || (long)generation != this->runs.back().generation + this->runs.back().frames)) break;
+    // A frame cut off by the end of the file is not part of the log.
+    if (position + bytes > size) break;
+    this->file.seekg(position + bytes);
+    if (kind == KEYFRAME) this->runs.push_back(LogRun{(long)generation, offset, 0});
+    this->runs.back().frames++;
+    offset = position + bytes;
+    this->end = offset;
+  }
+  this->file.clear();
+}
+
+uint64_t DeltaLogReader::read_frame(uint64_t offset, bool& keyframe, long& generation) {
+  this->file.seekg(offset);
+  int kind = this->file.get();
+  uint64_t position = offset + 1, value, size;
+  if ((kind != KEYFRAME && kind != DELTA) || !read_varint(this->file, value, position)
+      || !read_varint(this->file, size, position) || position + size > this->end) {
+    throw std::runtime_error("Corrupt delta log frame at offset " + std::to_string(offset));
+  }
+  this->data.resize(size);
+  if (size > 0 && !this->file.read((char*)this->data.data(), size)) {
+    throw std::runtime_error("Corrupt delta log frame at offset " + std::to_string(offset));
+  }
+  keyframe = kind == KEYFRAME;
+  generation = (long)value;
+  return position + size;
+}
+
+long DeltaLogReader::first_generation() const {
+  long first = -1;
+  for (size_t i = 0; i < this->runs.size(); i++) {
+    if (this->visible_end[i] > this->runs[i].generation && (first < 0 || this->runs[i].generation < first)) {
+      first = this->runs[i].generation;
+    }
+  }
+  return first;
+}
+
+long DeltaLogReader::last_generation() const {
+  long last = -1;
+  for (size_t i = 0; i < this->runs.size(); i++) {
+    if (this->visible_end[i] > this->runs[i].generation) last = std::max(last, this->visible_end[i] - 1);
+  }
+  return last;
+}
+
+bool DeltaLogReader::read(long generation, bool* grid) {
+  size_t run = 0;
+  while (run < this->runs.size() && !(this->runs[run].generation <= generation && generation < this->visible_end[run])) run++;
+  if (run == this->runs.size()) return false;
+
+  size_t count = (size_t)this->height * this->width;
+  bool continued = this->current_generation >= 0 && this->current_run == run && this->current_generation <= generation;
+  if (!continued) {
+    std::fill_n(this->current.get(), count, false);
+    this->current_generation = this->runs[run].generation - 1;
+    this->current_run = run;
+    this->next_offset = this->runs[run].offset;
+  }
+  try {
+    while (this->current_generation < generation) {
+      bool keyframe;
+      long frame_generation;
+      this->next_offset = read_frame(this->next_offset, keyframe, frame_generation);
+      if (frame_generation != this->current_generation + 1) {
+        throw std::runtime_error("Corrupt delta log: generation " + std::to_string(frame_generation)
+                                 + " instead of " + std::to_string(this->current_generation + 1));
+      }
+      apply_delta(this->data.data(), this->data.size(), this->current.get(), count);
+      this->current_generation = frame_generation;
+    }
+  } catch (const std::runtime_error& e) {
+    // The cells are partly updated, the next read starts from a keyframe.
+    this->current_generation = -1;
+    throw;
+  }
+  std::memcpy(grid, this->current.get(), sizeof(bool) * count);
+  return true;
+}
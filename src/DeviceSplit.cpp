@@ -0,0 +1,257 @@
+#include "DeviceSplit.h"
+#include "World.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+
+DeviceSplit::DeviceSplit(World& world, const std::vector<DeviceSelection>& selections) : world(world) {
+    cl_int err;
+    for (const DeviceSelection& selection : selections) {
+        DeviceInfo info = OpenCLWrapper::select_device(selection);
+        if (selection.sub_devices == 0) {
+            Part part;
+            part.name = info.name;
+            part.device = info.device;
+            this->parts.push_back(part);
+            continue;
+        }
+        // Equal partitions of the compute units, e.g. one sub-device per socket or core group.
+        cl_uint units = 1;
+        clGetDeviceInfo(info.device, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(units), &units, NULL);
+        cl_uint per_device = std::max(1u, units / selection.sub_devices);
+        cl_device_partition_property properties[] = {CL_DEVICE_PARTITION_EQUALLY, (cl_device_partition_property)per_device, 0};
+        std::vector<cl_device_id> created(std::max(units, (cl_uint)selection.sub_devices));
+        cl_uint count = 0;
+        err = clCreateSubDevices(info.device, properties, (cl_uint)created.size(), created.data(), &count);
+        OpenCLWrapper::checkError(err, "clCreateSubDevices");
+        for (cl_uint i = 0; i < count; i++) {
+            this->sub_devices.push_back(created[i]);
+            // Remainder partitions (compute units not divisible) are created but not used.
+            if ((int)i >= selection.sub_devices) continue;
+            Part part;
+            part.name = info.name + " #" + std::to_string(i);
+            part.device = created[i];
+            this->parts.push_back(part);
+        }
+    }
+    if (this->parts.empty() || (int)this->parts.size() > world.height) {
+        throw std::invalid_argument("DeviceSplit: " + std::to_string(this->parts.size()) + " devices for "
+                                    + std::to_string(world.height) + " rows");
+    }
+
+    std::string sourceStr = OpenCLWrapper::readKernelSource("../src/evolve_and_compare.cl");
+    const char* source = sourceStr.c_str();
+    std::string options = OpenCLWrapper::build_options(world);
+    for (Part& part : this->parts) {
+        std::cout << "OpenCL: Preparing " << part.name << "..." << std::endl;
+        part.context = clCreateContext(NULL, 1, &part.device, NULL, NULL, &err);
+        OpenCLWrapper::checkError(err, "clCreateContext");
+        // Profiling gives the kernel times for the balancing.
+        part.queue = clCreateCommandQueue(part.context, part.device, CL_QUEUE_PROFILING_ENABLE, &err);
+        OpenCLWrapper::checkError(err, "clCreateCommandQueue");
+        part.program = clCreateProgramWithSource(part.context, 1, &source, NULL, &err);
+        OpenCLWrapper::checkError(err, "clCreateProgramWithSource");
+        err = clBuildProgram(part.program, 1, &part.device, options.c_str(), NULL, NULL);
+        if (err != CL_SUCCESS) {
+            size_t log_size;
+            clGetProgramBuildInfo(part.program, part.device, CL_PROGRAM_BUILD_LOG, 0, NULL, &log_size);
+            std::vector<char> log(log_size);
+            clGetProgramBuildInfo(part.program, part.device, CL_PROGRAM_BUILD_LOG, log_size, log.data(), NULL);
+            throw std::runtime_error("Error during operation 'clBuildProgram' on " + part.name + ": " + std::to_string(err)
+                                     + "\nBuild log:\n" + std::string(log.data()));
+        }
+        part.kernel = clCreateKernel(part.program, "evolve_band", &err);
+        OpenCLWrapper::checkError(err, "clCreateKernel (evolve_band)");
+        err = clSetKernelArg(part.kernel, 2, sizeof(int), &world.width);
+        OpenCLWrapper::checkError(err, "clSetKernelArg (width)");
+    }
+
+    // Start with an even split, the balancing corrects it after the first interval.
+    std::vector<int> rows(this->parts.size());
+    for (size_t i = 0; i < rows.size(); i++) {
+        rows[i] = world.height / (int)rows.size() + ((int)i < world.height % (int)rows.size() ? 1 : 0);
+    }
+    assign_rows(rows);
+}
+
+DeviceSplit::~DeviceSplit() {
+    for (Part& part : this->parts) {
+        if (part.capacity > 0) {
+            clReleaseMemObject(part.buffer_band[0]);
+            clReleaseMemObject(part.buffer_band[1]);
+        }
+        clReleaseKernel(part.kernel);
+        clReleaseProgram(part.program);
+        clReleaseCommandQueue(part.queue);
+        clReleaseContext(part.context);
+    }
+    for (cl_device_id device : this->sub_devices) {
+        clReleaseDevice(device);
+    }
+}
+
+void DeviceSplit::allocate(Part& part, int rows) {
+    if (rows <= part.capacity) return;
+    cl_int err;
+    if (part.capacity > 0) {
+        clReleaseMemObject(part.buffer_band[0]);
+        clReleaseMemObject(part.buffer_band[1]);
+    }
+    size_t bytes = sizeof(bool) * (size_t)(rows + 2) * this->world.width;
+    for (int i = 0; i < 2; i++) {
+        part.buffer_band[i] = clCreateBuffer(part.context, CL_MEM_READ_WRITE, bytes, NULL, &err);
+        OpenCLWrapper::checkError(err, "clCreateBuffer (buffer_band)");
+    }
+    part.capacity = rows;
+}
+
+void DeviceSplit::assign_rows(const std::vector<int>& rows) {
+    int y = 0;
+    for (size_t i = 0; i < this->parts.size(); i++) {
+        allocate(this->parts[i], rows[i]);
+        this->parts[i].y_begin = y;
+        this->parts[i].rows = rows[i];
+        y += rows[i];
+    }
+    this->resident = false;
+}
+
+void DeviceSplit::invalidate() {
+    // The caller wrote the whole grid or downloaded it before writing.
+    this->resident = false;
+    this->host_stale = false;
+}
+
+void DeviceSplit::download() {
+    if (!this->host_stale) return;
+    cl_int err;
+    size_t row_bytes = sizeof(bool) * this->world.width;
+    for (Part& part : this->parts) {
+        err = clEnqueueReadBuffer(part.queue, part.buffer_band[part.current], CL_FALSE, row_bytes, part.rows * row_bytes,
+                                  this->world.grid + (size_t)part.y_begin * this->world.width, 0, NULL, NULL);
+        OpenCLWrapper::checkError(err, "clEnqueueReadBuffer (band)");
+        clFlush(part.queue);
+    }
+    for (Part& part : this->parts) clFinish(part.queue);
+    this->host_stale = false;
+}
+
+const std::vector<DeviceSplit::Part>& DeviceSplit::getParts() {
+    return this->parts;
+}
+
+void DeviceSplit::evolve() {
+    // Another engine or the host may have changed the grid since the last step.
+    if (this->world.grid != this->resident_grid || this->world.generation != this->resident_generation) {
+        this->resident = false;
+    }
+    cl_int err;
+    int width = this->world.width;
+    int height = this->world.height;
+    size_t row_bytes = sizeof(bool) * width;
+    std::vector<cl_event> kernel_events(this->parts.size());
+
+    for (size_t i = 0; i < this->parts.size(); i++) {
+        Part& part = this->parts[i];
+        cl_mem source = part.buffer_band[part.current];
+        cl_mem target = part.buffer_band[1 - part.current];
+        const bool* above = this->world.grid + (size_t)((part.y_begin - 1 + height) % height) * width;
+        const bool* below = this->world.grid + (size_t)((part.y_begin + part.rows) % height) * width;
+
+        // Halo exchange: the rows next to the band were computed by the neighbors in the last step.
+        err = clEnqueueWriteBuffer(part.queue, source, CL_FALSE, 0, row_bytes, above, 0, NULL, NULL);
+        OpenCLWrapper::checkError(err, "clEnqueueWriteBuffer (halo above)");
+        err = clEnqueueWriteBuffer(part.queue, source, CL_FALSE, (part.rows + 1) * row_bytes, row_bytes, below, 0, NULL, NULL);
+        OpenCLWrapper::checkError(err, "clEnqueueWriteBuffer (halo below)");
+        if (!this->resident) {
+            err = clEnqueueWriteBuffer(part.queue, source, CL_FALSE, row_bytes, part.rows * row_bytes,
+                                       this->world.grid + (size_t)part.y_begin * width, 0, NULL, NULL);
+            OpenCLWrapper::checkError(err, "clEnqueueWriteBuffer (band)");
+        }
+
+        err = clSetKernelArg(part.kernel, 0, sizeof(cl_mem), &source);
+        OpenCLWrapper::checkError(err, "clSetKernelArg (source)");
+        err = clSetKernelArg(part.kernel, 1, sizeof(cl_mem), &target);
+        OpenCLWrapper::checkError(err, "clSetKernelArg (target)");
+        err = clSetKernelArg(part.kernel, 3, sizeof(int), &part.rows);
+        OpenCLWrapper::checkError(err, "clSetKernelArg (rows)");
+        size_t global_work_size[2] = {(size_t)width, (size_t)part.rows};
+        err = clEnqueueNDRangeKernel(part.queue, part.kernel, 2, NULL, global_work_size, NULL, 0, NULL, &kernel_events[i]);
+        OpenCLWrapper::checkError(err, "clEnqueueNDRangeKernel (evolve_band)");
+
+        // Only the edge rows of the band: they are the halos of the neighbors. The rest stays on the device.
+        err = clEnqueueReadBuffer(part.queue, target, CL_FALSE, row_bytes, row_bytes,
+                                  this->world.nextGrid + (size_t)part.y_begin * width, 0, NULL, NULL);
+        OpenCLWrapper::checkError(err, "clEnqueueReadBuffer (first row)");
+        if (part.rows > 1) {
+            err = clEnqueueReadBuffer(part.queue, target, CL_FALSE, part.rows * row_bytes, row_bytes,
+                                      this->world.nextGrid + (size_t)(part.y_begin + part.rows - 1) * width, 0, NULL, NULL);
+            OpenCLWrapper::checkError(err, "clEnqueueReadBuffer (last row)");
+        }
+        // Start this device before enqueueing the next one.
+        clFlush(part.queue);
+    }
+
+    for (size_t i = 0; i < this->parts.size(); i++) {
+        Part& part = this->parts[i];
+        clFinish(part.queue);
+        cl_ulong time_start = 0, time_end = 0;
+        clGetEventProfilingInfo(kernel_events[i], CL_PROFILING_COMMAND_START, sizeof(time_start), &time_start, NULL);
+        clGetEventProfilingInfo(kernel_events[i], CL_PROFILING_COMMAND_END, sizeof(time_end), &time_end, NULL);
+        part.seconds += (double)(time_end - time_start) / 1e9;
+        clReleaseEvent(kernel_events[i]);
+        part.current = 1 - part.current;
+    }
+
+    std::swap(this->world.grid, this->world.nextGrid);
+    this->world.generation++;
+    this->resident = true;
+    this->host_stale = true;
+    this->resident_grid = this->world.grid;
+    this->resident_generation = this->world.generation;
+
+    if (++this->steps >= BALANCE_INTERVAL && this->parts.size() > 1) balance();
+}
+
+void DeviceSplit::balance() {
+    int height = this->world.height;
+    // Rows per kernel second of every part.
+    std::vector<double> speed(this->parts.size());
+    double total = 0;
+    for (size_t i = 0; i < this->parts.size(); i++) {
+        speed[i] = this->parts[i].rows / std::max(this->parts[i].seconds, 1e-9);
+        total += speed[i];
+    }
+
+    std::vector<int> rows(this->parts.size());
+    int assigned = 0;
+    size_t fastest = 0;
+    for (size_t i = 0; i < this->parts.size(); i++) {
+        rows[i] = std::max(1, (int)std::lround(height * speed[i] / total));
+        assigned += rows[i];
+        if (speed[i] > speed[fastest]) fastest = i;
+    }
+    // Rounding remainder goes to (or comes from) the fastest part.
+    rows[fastest] += height - assigned;
+    if (rows[fastest] < 1) {
+        // Very small grids: fall back to the even split.
+        for (size_t i = 0; i < rows.size(); i++) {
+            rows[i] = height / (int)rows.size() + ((int)i < height % (int)rows.size() ? 1 : 0);
+        }
+    }
+
+    int threshold = std::max(1, height / 50);
+    bool changed = false;
+    for (size_t i = 0; i < this->parts.size(); i++) {
+        if (std::abs(rows[i] - this->parts[i].rows) > threshold) changed = true;
+        this->parts[i].seconds = 0;
+    }
+    this->steps = 0;
+    if (!changed) return;
+    // The new bands are uploaded from the host grid.
+    download();
+    assign_rows(rows);
+}
@@ -0,0 +1,154 @@
+#include "EngineSelector.h"
+#include "World.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+
+// Regime bounds: densities from settled ash to dense soup, activities from still life to chaos.
+static const double DENSITY_BOUNDS[] = {0.005, 0.02, 0.08, 0.2};
+static const double ACTIVITY_BOUNDS[] = {0.02, 0.1, 0.35};
+
+int EngineSelector::regime_of(double density, double activity) {
+  int d = (int)(std::upper_bound(std::begin(DENSITY_BOUNDS), std::end(DENSITY_BOUNDS), density) - std::begin(DENSITY_BOUNDS));
+  int a = (int)(std::upper_bound(std::begin(ACTIVITY_BOUNDS), std::end(ACTIVITY_BOUNDS), activity) - std::begin(ACTIVITY_BOUNDS));
+  return d * (int)(std::end(ACTIVITY_BOUNDS) - std::begin(ACTIVITY_BOUNDS) + 1) + a;
+}
+
+EngineSelector::EngineSelector(World& world, const AdaptiveOptions& options) {
+  this->options = options;
+  this->options.interval = std::max(1L, options.interval);
+  this->options.trial = std::max(2L, std::min(options.trial, this->options.interval));
+  this->candidates = options.engines;
+  if (this->candidates.empty()) {
+    this->candidates = {Engine::Scalar, Engine::Lookup, Engine::Blocked};
+    if (world.cl != NULL) this->candidates.push_back(Engine::OpenCL);
+  }
+  this->home = world.engine;
+  this->next_sample = world.generation + this->options.interval;
+  this->last_switch = -this->options.dwell;
+}
+
+void EngineSelector::record(World& world, long generations, double seconds) {
+  if (this->warm) {
+    this->seconds += seconds;
+    this->generations += generations;
+  }
+  this->warm = true;
+
+  if (!this->trials.empty()) {
+    if (world.generation < this->trial_end) return;
+    // The trial is over: its step time counts for the regime of the sample that started it.
+    Cost cost;
+    cost.seconds = this->generations > 0 ? this->seconds / this->generations : 1e30;
+    cost.sample = this->samples;
+    this->costs[std::make_pair(this->regime, (int)this->trials.front())] = cost;
+    this->trial_count++;
+    this->trials.erase(this->trials.begin());
+    if (!this->trials.empty()) {
+      start_trial(world);
+    } else {
+      decide(world);
+    }
+    return;
+  }
+
+  // Keep the tiles before the step that reaches the sample (steps are 1 or block_steps generations).
+  bool last = world.generation < this->next_sample && world.generation + generations >= this->next_sample;
+  if (last && this->captured != world.generation) {
+    this->tiles = world.tile_fingerprints();
+    this->captured = world.generation;
+  }
+  if (world.generation >= this->next_sample) sample(world);
+}
+
+void EngineSelector::sample(World& world) {
+  // The cells are 0 or 1 bytes, so the set bits of a word count its live cells.
+  world.sync_grid();
+  long population = 0;
+  size_t i = 0;
+  for (; i + 8 <= world.N; i += 8) {
+    uint64_t word;
+    std::memcpy(&word, world.grid + i, sizeof(word));
+    population += __builtin_popcountll(word);
+  }
+  for (; i < world.N; i++) population += world.grid[i];
+  this->density = (double)population / world.N;
+
+  const std::vector<uint64_t>& now = world.tile_fingerprints();
+  long changed = 0;
+  if (this->captured >= 0 && this->tiles.size() == now.size()) {
+    for (size_t t = 0; t < now.size(); t++) changed += now[t] != this->tiles[t];
+    this->activity = (double)changed / now.size();
+  }
+  this->captured = -1;
+
+  this->regime = regime_of(this->density, this->activity);
+  this->samples++;
+  this->next_sample = world.generation + this->options.interval;
+  if (this->generations > 0) {
+    Cost cost;
+    cost.seconds = this->seconds / this->generations;
+    cost.sample = this->samples;
+    this->costs[std::make_pair(this->regime, (int)world.engine)] = cost;
+  }
+  this->seconds = 0;
+  this->generations = 0;
+
+  // Measure the candidates without a recent step time in this regime.
+  this->home = world.engine;
+  for (Engine engine : this->candidates) {
+    if (engine == world.engine) continue;
+    auto it = this->costs.find(std::make_pair(this->regime, (int)engine));
+    if (it == this->costs.end() || this->samples - it->second.sample > this->options.stale) {
+      this->trials.push_back(engine);
+    }
+  }
+  if (!this->trials.empty()) {
+    start_trial(world);
+  } else {
+    decide(world);
+  }
+}
+
+void EngineSelector::start_trial(World& world) {
+  use(world, this->trials.front());
+  this->trial_end = world.generation + this->options.trial;
+}
+
+void EngineSelector::decide(World& world) {
+  auto home_cost = this->costs.find(std::make_pair(this->regime, (int)this->home));
+  Engine best = this->home;
+  double best_seconds = home_cost != this->costs.end() ? home_cost->second.seconds : 1e30;
+  for (Engine engine : this->candidates) {
+    auto it = this->costs.find(std::make_pair(this->regime, (int)engine));
+    if (it != this->costs.end() && it->second.seconds < best_seconds) {
+      best = engine;
+      best_seconds = it->second.seconds;
+    }
+  }
+  double home_seconds = home_cost != this->costs.end() ? home_cost->second.seconds : 1e30;
+  bool settled = this->samples - this->last_switch >= this->options.dwell;
+  if (best != this->home && best_seconds * (1 + this->options.margin) < home_seconds && settled) {
+    EngineSwitch entry;
+    entry.generation = world.generation;
+    entry.from = this->home;
+    entry.to = best;
+    entry.density = this->density;
+    entry.activity = this->activity;
+    entry.speedup = home_seconds / best_seconds;
+    this->log.push_back(entry);
+    this->last_switch = this->samples;
+    this->home = best;
+  }
+  use(world, this->home);
+}
+
+void EngineSelector::use(World& world, Engine engine) {
+  if (world.engine != engine) {
+    world.set_engine(engine);
+    this->warm = false;
+  }
+  this->seconds = 0;
+  this->generations = 0;
+}
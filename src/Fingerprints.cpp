@@ -0,0 +1,116 @@
+/*
+* Incremental tile fingerprints of the World class.
+* Every STATS_TILE x STATS_TILE tile keeps a hash of its cells. The CPU engines mark the tiles
+* whose cells changed during a step, and only those are rehashed. The world fingerprint is the
+* sum of the mixed tile hashes, so replacing one tile hash updates it in O(1).
+*/
+
+#include "World.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+static inline uint64_t mix64(uint64_t x) {
+  x ^= x >> 33;
+  x *= 0xFF51AFD7ED558CCDULL;
+  x ^= x >> 33;
+  x *= 0xC4CEB9FE1A85EC53ULL;
+  x ^= x >> 33;
+  return x;
+}
+
+// Contribution of a tile to the world fingerprint, position dependent so moved cells change it.
+static inline uint64_t tile_term(uint64_t hash, int tile) {
+  return mix64(hash ^ ((uint64_t)(tile + 1) * 0x9E3779B97F4A7C15ULL));
+}
+
+void World::set_fingerprints(bool enabled) {
+  this->track_tiles = enabled;
+}
+
+bool World::track_step() {
+  return this->track_tiles && this->tiles_valid && this->tracked_generation == this->generation;
+}
+
+void World::mark_changed_tiles(int y, int x_begin, int x_end) {
+  const bool* old_row = this->grid + (size_t)y * this->width;
+  const bool* new_row = this->nextGrid + (size_t)y * this->width;
+  uint8_t* dirty = this->tile_dirty.data() + (size_t)(y / STATS_TILE) * tiles_x();
+  int x = x_begin;
+  // Full tiles: 8 cells per word.
+  for (; x + STATS_TILE <= x_end; x += STATS_TILE) {
+    uint64_t a[STATS_TILE / 8], b[STATS_TILE / 8], differ = 0;
+    std::memcpy(a, old_row + x, sizeof(a));
+    std::memcpy(b, new_row + x, sizeof(b));
+    for (int i = 0; i < STATS_TILE / 8; i++) differ |= a[i] ^ b[i];
+    dirty[x / STATS_TILE] |= differ != 0;
+  }
+  if (x < x_end) dirty[x / STATS_TILE] |= std::memcmp(old_row + x, new_row + x, x_end - x) != 0;
+}
+
+uint64_t World::hash_tile(int tile) {
+  int y0 = (tile / tiles_x()) * STATS_TILE;
+  int x0 = (tile % tiles_x()) * STATS_TILE;
+  int rows = std::min(STATS_TILE, this->height - y0);
+  int columns = std::min(STATS_TILE, this->width - x0);
+  uint64_t h = 0;
+  for (int r = 0; r < rows; r++) {
+    const bool* row = this->grid + (size_t)(y0 + r) * this->width + x0;
+    // The row as bits, 8 cells per multiply (bit i of the result is byte i).
+    uint64_t bits = 0;
+    int x = 0;
+    for (; x + 8 <= columns; x += 8) {
+      uint64_t bytes;
+      std::memcpy(&bytes, row + x, sizeof(bytes));
+      bits |= ((bytes * 0x0102040810204080ULL) >> 56) << x;
+    }
+    for (; x < columns; x++) bits |= (uint64_t)row[x] << x;
+    h = mix64(h ^ (bits << 8 | (uint64_t)r));
+  }
+  return h;
+}
+
+const std::vector<uint64_t>& World::tile_fingerprints() {
+  size_t tiles = (size_t)tiles_x() * tiles_y();
+  sync_grid();
+  if (!this->tiles_valid || this->tracked_generation != this->generation || this->tile_hashes.size() != tiles) {
+    // Not tracked since the last fingerprint (other engine, host edit, seek): hash every tile.
+    this->tile_hashes.resize(tiles);
+    this->tile_dirty.assign(tiles, 0);
+    this->tile_hash_sum = 0;
+    for (size_t t = 0; t < tiles; t++) {
+      this->tile_hashes[t] = hash_tile((int)t);
+      this->tile_hash_sum += tile_term(this->tile_hashes[t], (int)t);
+    }
+    this->tiles_valid = true;
+    this->tracked_generation = this->generation;
+    return this->tile_hashes;
+  }
+  for (size_t t = 0; t < tiles; t++) {
+    if (!this->tile_dirty[t]) continue;
+    this->tile_dirty[t] = 0;
+    uint64_t hash = hash_tile((int)t);
+    this->tile_hash_sum += tile_term(hash, (int)t) - tile_term(this->tile_hashes[t], (int)t);
+    this->tile_hashes[t] = hash;
+  }
+  return this->tile_hashes;
+}
+
+uint64_t World::fingerprint() {
+  tile_fingerprints();
+  return mix64(this->tile_hash_sum ^ ((uint64_t)this->height << 32 | (uint32_t)this->width));
+}
+
+std::vector<int> World::differing_tiles(World& other) {
+  if (other.height != this->height || other.width != this->width) {
+    throw std::invalid_argument("differing_tiles: worlds of different size");
+  }
+  const std::vector<uint64_t>& mine = tile_fingerprints();
+  const std::vector<uint64_t>& theirs = other.tile_fingerprints();
+  std::vector<int> tiles;
+  for (size_t t = 0; t < mine.size(); t++) {
+    if (mine[t] != theirs[t]) tiles.push_back((int)t);
+  }
+  return tiles;
+}
@@ -0,0 +1,102 @@
+#include "FixedEngine.h"
+
+#include <cstdint>
+#include <cstring>
+
+static inline uint64_t load64(const uint8_t* p) {
+  uint64_t word;
+  std::memcpy(&word, p, sizeof(word));
+  return word;
+}
+
+// 0x80 in every byte of v that equals c (for byte values below 0x80).
+static inline uint64_t equal(uint64_t v, uint64_t c) {
+  const uint64_t low = 0x7F7F7F7F7F7F7F7FULL;
+  uint64_t x = v ^ (c * 0x0101010101010101ULL);
+  return ~(((x & low) + low) | x | low);
+}
+
+// Rule known at compile time: the loops over the neighbor counts below fold to the set bits.
+template <uint16_t Birth, uint16_t Survive>
+struct StaticRule {
+  static constexpr uint16_t birth = Birth;
+  static constexpr uint16_t survive = Survive;
+  explicit StaticRule(const Rule&) { }
+};
+
+struct DynamicRule {
+  uint16_t birth;
+  uint16_t survive;
+  explicit DynamicRule(const Rule& rule) : birth(rule.birth), survive(rule.survive) { }
+};
+
+// Next state of 8 cells at once: every byte of counts is the neighbor count of one cell.
+template <class Rules>
+static inline uint64_t next_word(const Rules& rules, uint64_t alive, uint64_t counts) {
+  uint64_t born = 0, kept = 0;
+  for (int n = 0; n <= 8; n++) {
+    if ((rules.birth >> n) & 1) born |= equal(counts, n);
+    if ((rules.survive >> n) & 1) kept |= equal(counts, n);
+  }
+  uint64_t living = alive << 7;
+  return ((born & ~living) | (kept & living)) >> 7;
+}
+
+template <class Rules>
+static inline bool next_cell(const Rules& rules, bool alive, int determinationValue) {
+  return ((alive ? rules.survive : rules.birth) >> determinationValue) & 1;
+}
+
+template <int H, int W, class Rules>
+static void fixed_step(const bool* grid, bool* next, const Rule& rule) {
+  Rules rules(rule);
+  const uint8_t* cells = (const uint8_t*)grid;
+  for (int y = 0; y < H; y++) {
+    const uint8_t* up = cells + (y == 0 ? H - 1 : y - 1) * W;
+    const uint8_t* row = cells + y * W;
+    const uint8_t* down = cells + (y == H - 1 ? 0 : y + 1) * W;
+    bool* out = next + y * W;
+    // The wrapped columns, one cell at a time.
+    auto cell = [&](int x) {
+      int xl = x == 0 ? W - 1 : x - 1;
+      int xr = x == W - 1 ? 0 : x + 1;
+      int determinationValue = up[xl] + up[x] + up[xr] + row[xl] + row[xr] + down[xl] + down[x] + down[xr];
+      out[x] = next_cell(rules, row[x], determinationValue);
+    };
+    cell(0);
+    int x = 1;
+    // 8 cells per iteration, the byte sums of the neighbor words can't carry (at most 8).
+    for (; x + 8 <= W - 1; x += 8) {
+      uint64_t counts = load64(up + x - 1) + load64(up + x) + load64(up + x + 1)
+                      + load64(row + x - 1) + load64(row + x + 1)
+                      + load64(down + x - 1) + load64(down + x) + load64(down + x + 1);
+      uint64_t result = next_word(rules, load64(row + x), counts);
+      std::memcpy(out + x, &result, sizeof(result));
+    }
+    for (; x < W; x++) cell(x);
+  }
+}
+
+// The sizes as pairs of height and width (an odd number of values doesn't compile).
+template <int... Sizes>
+struct FixedSizes;
+
+template <>
+struct FixedSizes<> {
+  static FixedStep find(int, int, const Rule&) { return NULL; }
+};
+
+template <int H, int W, int... Rest>
+struct FixedSizes<H, W, Rest...> {
+  static_assert(H > 0 && W > 0, "FIXED_WORLD_SIZES must be positive");
+
+  static FixedStep find(int height, int width, const Rule& rule) {
+    if (height != H || width != W) return FixedSizes<Rest...>::find(height, width, rule);
+    if (rule.is_conway()) return &fixed_step<H, W, StaticRule<1 << 3, (1 << 2) | (1 << 3)> >;
+    return &fixed_step<H, W, DynamicRule>;
+  }
+};
+
+FixedStep find_fixed_step(int height, int width, const Rule& rule) {
+  return FixedSizes<FIXED_WORLD_SIZES>::find(height, width, rule);
+}
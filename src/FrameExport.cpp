@@ -0,0 +1,404 @@
+#include "FrameExport.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+// Longest and farthest match of deflate.
+static const size_t MAX_MATCH = 258;
+static const size_t MAX_DISTANCE = 32768;
+static const int HASH_BITS = 15;
+
+static const uint16_t LENGTH_BASE[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59,
+                                         67, 83, 99, 115, 131, 163, 195, 227, 258};
+static const uint8_t LENGTH_EXTRA[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3,
+                                         4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const uint16_t DISTANCE_BASE[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385,
+                                           513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+static const uint8_t DISTANCE_EXTRA[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7,
+                                           8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+// Deflate bit stream, least significant bit first (Huffman codes are stored reversed).
+class BitWriter {
+private:
+  std::vector<uint8_t>& out;
+  uint64_t bits = 0;
+  int count = 0;
+
+public:
+  explicit BitWriter(std::vector<uint8_t>& out) : out(out) { }
+
+  void put(uint32_t value, int length) {
+    bits |= (uint64_t)value << count;
+    count += length;
+    while (count >= 8) {
+      out.push_back((uint8_t)bits);
+      bits >>= 8;
+      count -= 8;
+    }
+  }
+
+  void finish() {
+    if (count > 0) out.push_back((uint8_t)bits);
+    bits = 0;
+    count = 0;
+  }
+};
+
+static uint32_t reverse_bits(uint32_t code, int length) {
+  uint32_t reversed = 0;
+  for (int i = 0; i < length; i++) reversed |= ((code >> i) & 1) << (length - 1 - i);
+  return reversed;
+}
+
+// Fixed Huffman codes of the literal/length symbols (RFC 1951, 3.2.6), bit-reversed for the stream.
+struct FixedCodes {
+  uint16_t code[288];
+  uint8_t length[288];
+  uint16_t distance[30];
+
+  FixedCodes() {
+    for (int symbol = 0; symbol < 288; symbol++) {
+      if (symbol < 144) set(symbol, 0x30 + symbol, 8);
+      else if (symbol < 256) set(symbol, 0x190 + symbol - 144, 9);
+      else if (symbol < 280) set(symbol, symbol - 256, 7);
+      else set(symbol, 0xC0 + symbol - 280, 8);
+    }
+    for (int d = 0; d < 30; d++) distance[d] = (uint16_t)reverse_bits(d, 5);
+  }
+
+  void set(int symbol, uint32_t value, int bits) {
+    code[symbol] = (uint16_t)reverse_bits(value, bits);
+    length[symbol] = (uint8_t)bits;
+  }
+};
+
+static const FixedCodes FIXED_CODES;
+
+static inline void put_symbol(BitWriter& writer, int symbol) {
+  writer.put(FIXED_CODES.code[symbol], FIXED_CODES.length[symbol]);
+}
+
+static void put_match(BitWriter& writer, size_t length, size_t distance) {
+  int l = 28;
+  while (LENGTH_BASE[l] > length) l--;
+  put_symbol(writer, 257 + l);
+  writer.put((uint32_t)(length - LENGTH_BASE[l]), LENGTH_EXTRA[l]);
+  int d = 29;
+  while (DISTANCE_BASE[d] > distance) d--;
+  writer.put(FIXED_CODES.distance[d], 5);
+  writer.put((uint32_t)(distance - DISTANCE_BASE[d]), DISTANCE_EXTRA[d]);
+}
+
+// One fixed Huffman block. Images of cells are mostly runs and repeated rows, so the matches tried are
+// the previous byte, the byte one row up, and the last position of the same three bytes.
+static void deflate(const std::vector<uint8_t>& data, size_t stride, std::vector<uint8_t>& out) {
+  BitWriter writer(out);
+  writer.put(1, 1); // Last block.
+  writer.put(1, 2); // Fixed Huffman codes.
+  std::vector<int64_t> head((size_t)1 << HASH_BITS, -1);
+  size_t n = data.size();
+  size_t i = 0;
+  while (i < n) {
+    size_t best_length = 0, best_distance = 0;
+    size_t limit = std::min(MAX_MATCH, n - i);
+    auto try_match = [&](size_t distance) {
+      if (distance == 0 || distance > i || distance > MAX_DISTANCE) return;
+      size_t length = 0;
+      while (length < limit && data[i + length] == data[i + length - distance]) length++;
+      if (length > best_length) {
+        best_length = length;
+        best_distance = distance;
+      }
+    };
+    try_match(1);
+    try_match(stride);
+    if (i + 3 <= n) {
+      uint32_t hash = ((uint32_t)data[i] << 16 | (uint32_t)data[i + 1] << 8 | data[i + 2]) * 2654435761u >> (32 - HASH_BITS);
+      if (head[hash] >= 0) try_match(i - (size_t)head[hash]);
+      head[hash] = (int64_t)i;
+    }
+    if (best_length >= 3) {
+      put_match(writer, best_length, best_distance);
+      i += best_length;
+    } else {
+      put_symbol(writer, data[i]);
+      i++;
+    }
+  }
+  put_symbol(writer, 256); // End of block.
+  writer.finish();
+}
+
+static uint32_t crc32(const uint8_t* data, size_t size, uint32_t crc = 0) {
+  static const std::vector<uint32_t> table = [] {
+    std::vector<uint32_t> entries(256);
+    for (uint32_t n = 0; n < 256; n++) {
+      uint32_t c = n;
+      for (int k = 0; k < 8; k++) c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+      entries[n] = c;
+    }
+    return entries;
+  }();
+  crc = ~crc;
+  for (size_t i = 0; i < size; i++) crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+  return ~crc;
+}
+
+static uint32_t adler32(const std::vector<uint8_t>& data) {
+  uint32_t a = 1, b = 0;
+  size_t i = 0;
+  while (i < data.size()) {
+    // The sums can't overflow in 5552 bytes.
+    size_t end = std::min(data.size(), i + 5552);
+    for (; i < end; i++) {
+      a += data[i];
+      b += a;
+    }
+    a %= 65521;
+    b %= 65521;
+  }
+  return b << 16 | a;
+}
+
+static void put_u32(std::vector<uint8_t>& out, uint32_t value) {
+  for (int shift = 24; shift >= 0; shift -= 8) out.push_back((uint8_t)(value >> shift));
+}
+
+static void put_chunk(std::vector<uint8_t>& out, const char* type, const std::vector<uint8_t>& data) {
+  put_u32(out, (uint32_t)data.size());
+  size_t start = out.size();
+  out.insert(out.end(), type, type + 4);
+  out.insert(out.end(), data.begin(), data.end());
+  put_u32(out, crc32(out.data() + start, out.size() - start));
+}
+
+// Palette index of a cell age: 1 for newborn cells up to 255 for cells alive 65536 generations (log scale).
+static uint8_t age_index(uint32_t age) {
+  static const std::vector<uint8_t> table = [] {
+    std::vector<uint8_t> entries(65536);
+    for (uint32_t a = 1; a < entries.size(); a++) {
+      entries[a] = (uint8_t)(1 + std::min(254, (int)(std::log2((double)a) * 254 / 16)));
+    }
+    return entries;
+  }();
+  return table[std::min<uint32_t>(age, 65535)];
+}
+
+// Dead cells black, living cells from white (newborn) over yellow, orange and red to blue (still lifes).
+static const std::vector<uint8_t>& age_palette() {
+  static const std::vector<uint8_t> palette = [] {
+    static const double stops[][4] = {{0.0, 255, 255, 255}, {0.2, 255, 230, 80}, {0.45, 255, 120, 0},
+                                      {0.7, 200, 0, 60}, {1.0, 40, 40, 200}};
+    std::vector<uint8_t> entries(3 * 256, 0);
+    for (int index = 1; index < 256; index++) {
+      double t = (index - 1) / 254.0;
+      int s = 0;
+      while (s < 3 && stops[s + 1][0] < t) s++;
+      double f = (t - stops[s][0]) / (stops[s + 1][0] - stops[s][0]);
+      for (int c = 0; c < 3; c++) {
+        entries[3 * index + c] = (uint8_t)std::lround(stops[s][1 + c] + f * (stops[s + 1][1 + c] - stops[s][1 + c]));
+      }
+    }
+    return entries;
+  }();
+  return palette;
+}
+
+FrameExporter::FrameExporter(const std::string& prefix, int height, int width, const ExportOptions& options) {
+  this->prefix = prefix;
+  this->height = height;
+  this->width = width;
+  this->cells = (size_t)height * width;
+  this->options = options;
+  this->options.scale = std::max(1, options.scale);
+  this->options.every = std::max(1L, options.every);
+  if (this->options.ages) this->ages.assign(this->cells, 0);
+  int threads = options.threads > 0 ? options.threads : (int)std::max(1u, std::thread::hardware_concurrency());
+  for (int i = 0; i < threads; i++) {
+    this->encoders.emplace_back(&FrameExporter::encoder_loop, this);
+  }
+}
+
+FrameExporter::~FrameExporter() {
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->stop = true;
+  }
+  this->changed.notify_all();
+  for (std::thread& encoder : this->encoders) encoder.join();
+}
+
+void FrameExporter::submit(long generation, const bool* grid) {
+  if (this->options.ages) {
+    // Steps of several generations (passes of the blocked engine) age the cells by all of them.
+    uint32_t step = (uint32_t)std::max(1L, std::min(65535L, generation - this->aged_generation));
+    if (this->aged_generation < 0) step = 1;
+    for (size_t i = 0; i < this->cells; i++) {
+      this->ages[i] = grid[i] ? (uint16_t)std::min<uint32_t>(this->ages[i] + step, 65535) : 0;
+    }
+    this->aged_generation = generation;
+  }
+  if (generation % this->options.every != 0) return;
+
+  Snapshot snapshot;
+  {
+    std::unique_lock<std::mutex> lock(this->mutex);
+    if (!this->error.empty()) throw std::runtime_error(this->error);
+    // Back pressure: a few images per encoder in flight, the simulation waits beyond that.
+    this->changed.wait(lock, [&] { return this->pending.size() < 2 * this->encoders.size(); });
+    if (!this->free_snapshots.empty()) {
+      snapshot = std::move(this->free_snapshots.back());
+      this->free_snapshots.pop_back();
+    }
+  }
+  if (!snapshot.cells) snapshot.cells.reset(new bool[this->cells]);
+  std::memcpy(snapshot.cells.get(), grid, sizeof(bool) * this->cells);
+  if (this->options.ages) {
+    if (!snapshot.ages) snapshot.ages.reset(new uint16_t[this->cells]);
+    std::memcpy(snapshot.ages.get(), this->ages.data(), sizeof(uint16_t) * this->cells);
+  }
+  snapshot.generation = generation;
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->pending.push_back(std::move(snapshot));
+  }
+  this->changed.notify_all();
+}
+
+void FrameExporter::encoder_loop() {
+  std::vector<uint8_t> pixels;
+  while (true) {
+    Snapshot snapshot;
+    {
+      std::unique_lock<std::mutex> lock(this->mutex);
+      this->changed.wait(lock, [&] { return this->stop || !this->pending.empty(); });
+      if (this->pending.empty()) return;
+      snapshot = std::move(this->pending.front());
+      this->pending.pop_front();
+      this->busy++;
+    }
+
+    int image_height, image_width;
+    convert(snapshot, pixels, image_height, image_width);
+    std::vector<uint8_t> image;
+    if (this->options.format == ImageFormat::PNG) {
+      image = encode_png(pixels, image_height, image_width,
+                         this->options.ages ? age_palette() : std::vector<uint8_t>());
+    } else {
+      image = encode_pgm(pixels, image_height, image_width);
+    }
+    std::string name = file_name(snapshot.generation);
+    std::ofstream file(name, std::ios::binary);
+    file.write((const char*)image.data(), image.size());
+    file.close();
+
+    {
+      std::lock_guard<std::mutex> lock(this->mutex);
+      if (!file && this->error.empty()) this->error = "Unable to write file: " + name;
+      this->written++;
+      this->free_snapshots.push_back(std::move(snapshot));
+      this->busy--;
+    }
+    this->changed.notify_all();
+  }
+}
+
+void FrameExporter::convert(const Snapshot& snapshot, std::vector<uint8_t>& pixels, int& image_height, int& image_width) const {
+  int scale = this->options.scale;
+  image_height = (this->height + scale - 1) / scale;
+  image_width = (this->width + scale - 1) / scale;
+  pixels.resize((size_t)image_height * image_width);
+  bool palette = this->options.ages && this->options.format == ImageFormat::PNG;
+  // Pixel of a block of cells: the share of living cells, or the colour of their mean age.
+  auto shade = [&](uint32_t alive, uint32_t block, uint64_t age_sum) -> uint8_t {
+    if (alive == 0) return 0;
+    if (!this->options.ages) return (uint8_t)(255 * alive / block);
+    uint8_t index = age_index((uint32_t)(age_sum / alive));
+    // Grey levels without a palette: newborn cells white, old cells dark grey.
+    return palette ? index : (uint8_t)(255 - (index - 1) * 191 / 254);
+  };
+
+  if (scale == 1) {
+    for (size_t i = 0; i < this->cells; i++) {
+      pixels[i] = shade(snapshot.cells[i], 1, this->options.ages ? snapshot.ages[i] : 0);
+    }
+    return;
+  }
+  for (int py = 0; py < image_height; py++) {
+    int y_end = std::min(this->height, (py + 1) * scale);
+    for (int px = 0; px < image_width; px++) {
+      int x_end = std::min(this->width, (px + 1) * scale);
+      uint32_t alive = 0, block = 0;
+      uint64_t age_sum = 0;
+      for (int y = py * scale; y < y_end; y++) {
+        size_t row = (size_t)y * this->width;
+        for (int x = px * scale; x < x_end; x++) {
+          block++;
+          if (!snapshot.cells[row + x]) continue;
+          alive++;
+          if (this->options.ages) age_sum += snapshot.ages[row + x];
+        }
+      }
+      pixels[(size_t)py * image_width + px] = shade(alive, block, age_sum);
+    }
+  }
+}
+
+std::string FrameExporter::file_name(long generation) const {
+  char number[32];
+  std::snprintf(number, sizeof(number), "%08ld", generation);
+  return this->prefix + "_" + number + (this->options.format == ImageFormat::PNG ? ".png" : ".pgm");
+}
+
+void FrameExporter::flush() {
+  std::unique_lock<std::mutex> lock(this->mutex);
+  this->changed.wait(lock, [&] { return this->pending.empty() && this->busy == 0; });
+  if (!this->error.empty()) throw std::runtime_error(this->error);
+}
+
+long FrameExporter::image_count() {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  return this->written;
+}
+
+std::vector<uint8_t> FrameExporter::encode_png(const std::vector<uint8_t>& pixels, int height, int width,
+                                               const std::vector<uint8_t>& palette) {
+  static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+  std::vector<uint8_t> out(signature, signature + sizeof(signature));
+
+  std::vector<uint8_t> header;
+  put_u32(header, (uint32_t)width);
+  put_u32(header, (uint32_t)height);
+  header.push_back(8); // Bits per pixel.
+  header.push_back(palette.empty() ? 0 : 3); // Greyscale or palette.
+  header.push_back(0); // Deflate.
+  header.push_back(0); // Adaptive filtering (only filter type 0 is used).
+  header.push_back(0); // Not interlaced.
+  put_chunk(out, "IHDR", header);
+  if (!palette.empty()) put_chunk(out, "PLTE", palette);
+
+  // Every row starts with its filter type (0, none), the row above is found by the matches.
+  std::vector<uint8_t> raw;
+  raw.reserve((size_t)height * (width + 1));
+  for (int y = 0; y < height; y++) {
+    raw.push_back(0);
+    raw.insert(raw.end(), pixels.begin() + (size_t)y * width, pixels.begin() + (size_t)(y + 1) * width);
+  }
+  std::vector<uint8_t> compressed = {0x78, 0x01}; // zlib header: deflate, 32 KiB window.
+  deflate(raw, (size_t)width + 1, compressed);
+  put_u32(compressed, adler32(raw));
+  put_chunk(out, "IDAT", compressed);
+  put_chunk(out, "IEND", std::vector<uint8_t>());
+  return out;
+}
+
+std::vector<uint8_t> FrameExporter::encode_pgm(const std::vector<uint8_t>& pixels, int height, int width) {
+  std::string header = "P5\n" + std::to_string(width) + " " + std::to_string(height) + "\n255\n";
+  std::vector<uint8_t> out(header.begin(), header.end());
+  out.insert(out.end(), pixels.begin(), pixels.end());
+  return out;
+}
@@ -0,0 +1,161 @@
+#include "History.h"
+#include "DeltaCodec.h"
+
+#include <algorithm>
+#include <cstring>
+
+History::History(size_t cells, int keyframe_interval, size_t max_bytes) {
+  this->cells = cells;
+  this->keyframe_interval = std::max(1, keyframe_interval);
+  this->max_bytes = max_bytes;
+  this->last.reset(new bool[cells]);
+  this->encoder = std::thread(&History::encoder_loop, this);
+}
+
+History::~History() {
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->stop = true;
+  }
+  this->changed.notify_all();
+  this->encoder.join();
+}
+
+void History::record(long generation, const bool* grid) {
+  std::unique_ptr<bool[]> buffer;
+  {
+    std::unique_lock<std::mutex> lock(this->mutex);
+    // Back pressure, so a slow encoder can't use unbounded memory.
+    this->changed.wait(lock, [&] { return this->pending.size() < MAX_PENDING; });
+    if (!this->free_buffers.empty()) {
+      buffer = std::move(this->free_buffers.back());
+      this->free_buffers.pop_back();
+    }
+  }
+  if (!buffer) buffer.reset(new bool[this->cells]);
+  std::memcpy(buffer.get(), grid, sizeof(bool) * this->cells);
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->pending.push_back(Snapshot{generation, std::move(buffer)});
+  }
+  this->changed.notify_all();
+}
+
+void History::encoder_loop() {
+  while (true) {
+    Snapshot snapshot;
+    bool keyframe;
+    {
+      std::unique_lock<std::mutex> lock(this->mutex);
+      this->changed.wait(lock, [&] { return this->stop || !this->pending.empty(); });
+      if (this->pending.empty()) return;
+      snapshot = std::move(this->pending.front());
+      this->pending.pop_front();
+      this->busy = true;
+      // A gap (e.g. generations computed without recording) also starts with a keyframe.
+      keyframe = this->frames.empty() || this->restart || snapshot.generation != this->last_coded + 1
+                 || this->since_keyframe + 1 >= this->keyframe_interval;
+      this->restart = false;
+    }
+
+    Frame frame;
+    frame.generation = snapshot.generation;
+    frame.keyframe = keyframe;
+    encode_delta(keyframe ? NULL : this->last.get(), snapshot.cells.get(), this->cells, frame.data);
+    frame.data.shrink_to_fit();
+    this->since_keyframe = keyframe ? 0 : this->since_keyframe + 1;
+    this->last_coded = snapshot.generation;
+    // The snapshot becomes the new last grid, the old one is reused for the next record.
+    std::swap(this->last, snapshot.cells);
+
+    {
+      std::lock_guard<std::mutex> lock(this->mutex);
+      // A non-consecutive generation replaces the frames from it on (recorded again after a seek).
+      while (!this->frames.empty() && this->frames.back().generation >= frame.generation) {
+        this->bytes -= this->frames.back().data.size();
+        this->frames.pop_back();
+      }
+      this->bytes += frame.data.size();
+      this->frames.push_back(std::move(frame));
+      trim();
+      this->free_buffers.push_back(std::move(snapshot.cells));
+      this->busy = false;
+    }
+    this->changed.notify_all();
+  }
+}
+
+void History::trim() {
+  while (this->bytes > this->max_bytes) {
+    // Find the second keyframe, everything before it can be dropped as a whole.
+    size_t next = 1;
+    while (next < this->frames.size() && !this->frames[next].keyframe) next++;
+    if (next >= this->frames.size()) return;
+    for (size_t i = 0; i < next; i++) {
+      this->bytes -= this->frames.front().data.size();
+      this->frames.pop_front();
+    }
+  }
+}
+
+void History::wait_idle(std::unique_lock<std::mutex>& lock) {
+  this->changed.wait(lock, [&] { return this->pending.empty() && !this->busy; });
+}
+
+bool History::restore(long generation, bool* grid) {
+  std::unique_lock<std::mutex> lock(this->mutex);
+  wait_idle(lock);
+  auto it = std::lower_bound(this->frames.begin(), this->frames.end(), generation,
+                             [](const Frame& frame, long g) { return frame.generation < g; });
+  if (it == this->frames.end() || it->generation != generation) return false;
+  // Generations after a gap are keyframes, so the frames from the keyframe on are consecutive.
+  size_t target = it - this->frames.begin();
+  size_t key = target;
+  while (!this->frames[key].keyframe) key--;
+
+  std::fill_n(grid, this->cells, false);
+  for (size_t i = key; i <= target; i++) {
+    apply_delta(this->frames[i].data.data(), this->frames[i].data.size(), grid, this->cells);
+  }
+  return true;
+}
+
+void History::truncate(long generation) {
+  std::unique_lock<std::mutex> lock(this->mutex);
+  wait_idle(lock);
+  while (!this->frames.empty() && this->frames.back().generation > generation) {
+    this->bytes -= this->frames.back().data.size();
+    this->frames.pop_back();
+  }
+  // The encoder's last grid is a later generation now.
+  this->restart = true;
+}
+
+long History::first_generation() {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  return this->frames.empty() ? -1 : this->frames.front().generation;
+}
+
+long History::last_generation() {
+  std::unique_lock<std::mutex> lock(this->mutex);
+  wait_idle(lock);
+  return this->frames.empty() ? -1 : this->frames.back().generation;
+}
+
+size_t History::frame_count() {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  return this->frames.size();
+}
+
+size_t History::keyframe_count() {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  size_t count = 0;
+  for (const Frame& frame : this->frames) count += frame.keyframe;
+  return count;
+}
+
+size_t History::memory_usage() {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  size_t grids = 1 + this->pending.size() + this->free_buffers.size() + (this->busy ? 1 : 0);
+  return this->bytes + this->frames.size() * sizeof(Frame) + grids * this->cells * sizeof(bool);
+}
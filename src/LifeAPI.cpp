@@ -0,0 +1,97 @@
+#include "LifeAPI.h"
+#include "World.h"
+
+#include <exception>
+#include <stdexcept>
+#include <string>
+
+static_assert(sizeof(bool) == 1, "Views hand out the bool grid as bytes");
+
+struct gol_world {
+  World world;
+
+  gol_world(int height, int width) : world(height, width) { }
+};
+
+static thread_local std::string last_error;
+
+// Run an operation, turning exceptions into -1 and the message of gol_last_error.
+template <class Operation>
+static int guarded(Operation operation) {
+  try {
+    operation();
+    last_error.clear();
+    return 0;
+  } catch (const std::exception& e) {
+    last_error = e.what();
+    return -1;
+  }
+}
+
+int gol_api_version(void) {
+  return GOL_API_VERSION;
+}
+
+gol_world* gol_create(int height, int width, const char* engine) {
+  gol_world* handle = NULL;
+  int status = guarded([&] {
+    if (height <= 0 || width <= 0) throw std::invalid_argument("Height and width have to be positive");
+    Engine selected = parse_engine(engine != NULL ? engine : "lookup");
+    handle = new gol_world(height, width);
+    handle->world.set_engine(selected);
+  });
+  if (status != 0) {
+    delete handle;
+    return NULL;
+  }
+  return handle;
+}
+
+void gol_destroy(gol_world* world) {
+  delete world;
+}
+
+int gol_set_rule(gol_world* world, const char* rule) {
+  return guarded([&] { world->world.set_rule(Rule::parse(rule)); });
+}
+
+int gol_set_threads(gol_world* world, int threads) {
+  return guarded([&] { world->world.set_threads(threads); });
+}
+
+int gol_step(gol_world* world, long generations) {
+  return guarded([&] { world->world.evolve_generations(generations); });
+}
+
+long gol_generation(gol_world* world) {
+  return world->world.getGeneration();
+}
+
+int gol_get_view(gol_world* world, gol_grid_view* view) {
+  return guarded([&] {
+    GridView cells = world->world.view();
+    *view = gol_grid_view{(const uint8_t*)cells.cells, cells.height, cells.width, (size_t)cells.width, cells.generation};
+  });
+}
+
+int gol_get_packed_view(gol_world* world, gol_packed_view* view) {
+  return guarded([&] {
+    PackedView cells = world->world.packed_view();
+    *view = gol_packed_view{cells.words, cells.height, cells.width, cells.words_per_row, cells.generation};
+  });
+}
+
+int gol_set_region(gol_world* world, int y, int x, int rows, int columns, const uint8_t* cells, size_t stride) {
+  return guarded([&] { world->world.set_region(y, x, rows, columns, cells, stride); });
+}
+
+int gol_set_cells(gol_world* world, const uint8_t* cells) {
+  return guarded([&] {
+    GridView current = world->world.view();
+    world->world.set_region(0, 0, current.height, current.width, cells, current.width);
+  });
+}
+
+const char* gol_last_error(void) {
+  return last_error.c_str();
+}
@@ -0,0 +1,152 @@
+/*
+* Lookup table engine of the World class.
+* The grid is packed into bit rows, and the next state of every 2x2 block of cells is looked up
+* in a 64 KiB table indexed by the 16 cells of its 4x4 neighborhood.
+*/
+
+#include "World.h"
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+
+// Bit offset of cell 0 in a packed row. Bit 7 holds the wrapped left neighbor (cell width-1),
+// bit width+8 the wrapped right neighbor (cell 0), so every cell is byte aligned.
+static const int PACKED_OFFSET = 8;
+
+static inline uint64_t load64(const uint8_t* p) {
+  uint64_t word;
+  std::memcpy(&word, p, sizeof(word));
+  return word;
+}
+
+void World::build_lookup_table() {
+  if (!this->lookup_table.empty() && this->lookup_rule == this->rule) return;
+  this->lookup_table.assign(1 << 16, 0);
+  this->lookup_rule = this->rule;
+  // Bit r * 4 + i of the index is the cell in row r and column i of the 4x4 neighborhood.
+  for (int index = 0; index < (1 << 16); index++) {
+    uint8_t result = 0;
+    for (int cy = 1; cy <= 2; cy++) {
+      for (int cx = 1; cx <= 2; cx++) {
+        int determinationValue = 0;
+        for (int dy = -1; dy <= 1; dy++) {
+          for (int dx = -1; dx <= 1; dx++) {
+            if (dx == 0 && dy == 0) continue;
+            determinationValue += (index >> ((cy + dy) * 4 + cx + dx)) & 1;
+          }
+        }
+        bool alive = (index >> (cy * 4 + cx)) & 1;
+        // Result bits: 0 = top left, 1 = top right, 2 = bottom left, 3 = bottom right.
+        if (this->rule.next(alive, determinationValue)) result |= 1 << ((cy - 1) * 2 + (cx - 1));
+      }
+    }
+    this->lookup_table[index] = result;
+  }
+}
+
+void World::pack_rows(int y_begin, int y_end) {
+  for (int y = y_begin; y < y_end; y++) {
+    const bool* row = this->grid + y * this->width;
+    uint8_t* dest = this->packed.data() + y * this->packed_stride;
+    std::fill_n(dest, this->packed_stride, 0);
+    int x = 0;
+    // 8 cells (bytes of 0 or 1) per multiply: bit i of the result is byte i.
+    for (; x + 8 <= this->width; x += 8) {
+      uint64_t bytes;
+      std::memcpy(&bytes, row + x, sizeof(bytes));
+      dest[(x + PACKED_OFFSET) / 8] = (uint8_t)((bytes * 0x0102040810204080ULL) >> 56);
+    }
+    for (; x < this->width; x++) {
+      dest[(x + PACKED_OFFSET) / 8] |= row[x] << ((x + PACKED_OFFSET) % 8);
+    }
+    // Wrapped border bits.
+    dest[(PACKED_OFFSET - 1) / 8] |= row[this->width - 1] << ((PACKED_OFFSET - 1) % 8);
+    dest[(this->width + PACKED_OFFSET) / 8] |= row[0] << ((this->width + PACKED_OFFSET) % 8);
+  }
+}
+
+void World::lookup_rows(int y_begin, int y_end) {
+  const uint8_t* table = this->lookup_table.data();
+  // Two cells as two bool bytes, indexed by two result bits.
+  static const uint16_t pair_bytes[4] = {0x0000, 0x0001, 0x0100, 0x0101};
+
+  for (int y = y_begin; y < y_end; y += 2) {
+    const uint8_t* r0 = this->packed.data() + ((y - 1 + this->height) % this->height) * this->packed_stride;
+    const uint8_t* r1 = this->packed.data() + y * this->packed_stride;
+    const uint8_t* r2 = this->packed.data() + ((y + 1) % this->height) * this->packed_stride;
+    const uint8_t* r3 = this->packed.data() + ((y + 2) % this->height) * this->packed_stride;
+    bool* top = this->nextGrid + y * this->width;
+    bool* bottom = y + 1 < this->height ? this->nextGrid + (y + 1) * this->width : NULL;
+
+    // 16 cells (8 blocks) per 64 bit load of each row.
+    for (int c0 = 0; c0 < this->width; c0 += 16) {
+      uint64_t w0 = load64(r0 + c0 / 8);
+      uint64_t w1 = load64(r1 + c0 / 8);
+      uint64_t w2 = load64(r2 + c0 / 8);
+      uint64_t w3 = load64(r3 + c0 / 8);
+      bool full = c0 + 16 <= this->width && bottom != NULL;
+      for (int k = 0; k < 8; k++) {
+        int c = c0 + 2 * k;
+        if (c >= this->width) break;
+        // Columns c-1 to c+2 are the bits PACKED_OFFSET-1+2k to PACKED_OFFSET+2+2k of the words.
+        int shift = PACKED_OFFSET - 1 + 2 * k;
+        unsigned index = ((w0 >> shift) & 0xF) | (((w1 >> shift) & 0xF) << 4)
+                       | (((w2 >> shift) & 0xF) << 8) | (((w3 >> shift) & 0xF) << 12);
+        uint8_t result = table[index];
+        if (full) {
+          std::memcpy(top + c, &pair_bytes[result & 3], 2);
+          std::memcpy(bottom + c, &pair_bytes[result >> 2], 2);
+        } else {
+          // Odd width or height: drop the cells outside the grid.
+          top[c] = result & 1;
+          if (c + 1 < this->width) top[c + 1] = (result >> 1) & 1;
+          if (bottom != NULL) {
+            bottom[c] = (result >> 2) & 1;
+            if (c + 1 < this->width) bottom[c + 1] = (result >> 3) & 1;
+          }
+        }
+      }
+    }
+  }
+}
+
+bool* World::evolve_lookup() {
+  // The statistics are computed by the scalar loop.
+  if (this->collect_statistics) return evolve_scalar();
+
+  build_lookup_table();
+  this->packed_stride = (this->width + 2 * PACKED_OFFSET) / 8 + sizeof(uint64_t);
+  this->packed.resize(this->packed_stride * this->height);
+
+  // The bands of the scalar engine: whole tiles, so even rows.
+  int bands = this->pool != NULL ? this->pool->size() : 1;
+  bool tracking = track_step();
+  std::function<void(int)> pack = [&](int band) {
+    int y_begin, y_end;
+    band_range(band, bands, y_begin, y_end);
+    pack_rows(y_begin, y_end);
+  };
+  // All rows have to be packed before any band looks at its neighbor rows.
+  std::function<void(int)> lookup = [&](int band) {
+    int y_begin, y_end;
+    band_range(band, bands, y_begin, y_end);
+    lookup_rows(y_begin, y_end);
+    if (tracking) for (int y = y_begin; y < y_end; y++) mark_changed_tiles(y, 0, this->width);
+  };
+  if (this->pool != NULL) {
+    this->pool->run(pack);
+    this->pool->run(lookup);
+  } else {
+    pack(0);
+    lookup(0);
+  }
+
+  // Swap old and new grid and increment generation counter.
+  std::swap(this->grid, this->nextGrid);
+  this->generation++;
+  this->band_passes++;
+  if (tracking) this->tracked_generation = this->generation;
+
+  return this->grid;
+}
@@ -0,0 +1,139 @@
+#include "Objects.h"
+
+#include <algorithm>
+#include <climits>
+
+CellList step_cells(const CellList& cells, const Rule& rule) {
+  CellList next;
+  if (cells.empty()) return next;
+
+  // Bounding box of the object.
+  int min_x = INT_MAX, min_y = INT_MAX, max_x = INT_MIN, max_y = INT_MIN;
+  for (const auto& c : cells) {
+    min_x = std::min(min_x, c.first);
+    max_x = std::max(max_x, c.first);
+    min_y = std::min(min_y, c.second);
+    max_y = std::max(max_y, c.second);
+  }
+
+  // Dense bitmap with a border of two dead cells, so the next generation fits (one cell growth)
+  // and the neighbor count of border cells does not need bound checks.
+  int w = max_x - min_x + 5;
+  int h = max_y - min_y + 5;
+  std::vector<char> alive(w * h, 0);
+  for (const auto& c : cells) {
+    alive[(c.second - min_y + 2) * w + (c.first - min_x + 2)] = 1;
+  }
+
+  for (int y = 1; y < h - 1; y++) {
+    for (int x = 1; x < w - 1; x++) {
+      int determinationValue = alive[(y-1) * w + x-1] + alive[(y-1) * w + x] + alive[(y-1) * w + x+1]
+                             + alive[y * w + x-1] + alive[y * w + x+1]
+                             + alive[(y+1) * w + x-1] + alive[(y+1) * w + x] + alive[(y+1) * w + x+1];
+      if (rule.next(alive[y * w + x], determinationValue)) {
+        next.push_back(std::make_pair(x + min_x - 2, y + min_y - 2));
+      }
+    }
+  }
+  std::sort(next.begin(), next.end());
+  return next;
+}
+
+CellList normalise_cells(const CellList& cells, int& min_x, int& min_y) {
+  min_x = INT_MAX;
+  min_y = INT_MAX;
+  for (const auto& c : cells) {
+    min_x = std::min(min_x, c.first);
+    min_y = std::min(min_y, c.second);
+  }
+  CellList normalised;
+  normalised.reserve(cells.size());
+  for (const auto& c : cells) {
+    normalised.push_back(std::make_pair(c.first - min_x, c.second - min_y));
+  }
+  std::sort(normalised.begin(), normalised.end());
+  return normalised;
+}
+
+// Encode normalised cells row by row, 4 cells per hex digit, rows separated by 'z'.
+static std::string encode_bitmap(const CellList& normalised) {
+  int w = 0, h = 0;
+  for (const auto& c : normalised) {
+    w = std::max(w, c.first + 1);
+    h = std::max(h, c.second + 1);
+  }
+  int digits = (w + 3) / 4;
+  std::vector<int> nibbles(digits * h, 0);
+  for (const auto& c : normalised) {
+    nibbles[c.second * digits + c.first / 4] |= 1 << (c.first % 4);
+  }
+  std::string code;
+  for (int y = 0; y < h; y++) {
+    if (y > 0) code += 'z';
+    for (int d = 0; d < digits; d++) {
+      code += "0123456789abcdef"[nibbles[y * digits + d]];
+    }
+  }
+  return code;
+}
+
+std::string phase_code(const CellList& cells) {
+  std::string best;
+  for (int symmetry = 0; symmetry < 8; symmetry++) {
+    CellList transformed;
+    transformed.reserve(cells.size());
+    for (const auto& c : cells) {
+      int x = (symmetry & 1) ? -c.first : c.first;
+      int y = (symmetry & 2) ? -c.second : c.second;
+      if (symmetry & 4) std::swap(x, y);
+      transformed.push_back(std::make_pair(x, y));
+    }
+    int min_x, min_y;
+    std::string code = encode_bitmap(normalise_cells(transformed, min_x, min_y));
+    // Shorter codes first so that the choice does not depend on the string comparison of different shapes only.
+    if (best.empty() || code.size() < best.size() || (code.size() == best.size() && code < best)) {
+      best = code;
+    }
+  }
+  return best;
+}
+
+ObjectInfo classify_object(const CellList& cells, int max_period, const Rule& rule) {
+  ObjectInfo info;
+  info.period = 0;
+  info.dx = 0;
+  info.dy = 0;
+  info.population = (int)cells.size();
+
+  int x0, y0;
+  CellList start = normalise_cells(cells, x0, y0);
+  std::string best = phase_code(start);
+
+  CellList current = cells;
+  for (int t = 1; t <= max_period; t++) {
+    current = step_cells(current, rule);
+    if (current.empty()) break;
+
+    int x, y;
+    CellList normalised = normalise_cells(current, x, y);
+    if (normalised == start) {
+      info.period = t;
+      info.dx = x - x0;
+      info.dy = y - y0;
+      break;
+    }
+    std::string code = phase_code(normalised);
+    if (code.size() < best.size() || (code.size() == best.size() && code < best)) best = code;
+  }
+
+  if (info.period == 0) {
+    info.code = "zz_" + std::to_string(info.population);
+  } else if (info.dx != 0 || info.dy != 0) {
+    info.code = "xq" + std::to_string(info.period) + "_" + best;
+  } else if (info.period == 1) {
+    info.code = "xs" + std::to_string(info.population) + "_" + best;
+  } else {
+    info.code = "xp" + std::to_string(info.period) + "_" + best;
+  }
+  return info;
+}
@@ -0,0 +1,136 @@
+/*
+* Pipelined OpenCL mode of the World class: compute of generation g+1 overlaps with the
+* non-blocking readback of generation g and the host-side consumer of generation g-1.
+*/
+
+#include "World.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+void World::evolve_pipelined(long generations, int host_buffers,
+                             const std::function<void(long, const bool*)>& consumer) {
+  if (generations <= 0) return;
+  if (this->cl == NULL) throw std::runtime_error("OpenCL is not initialized");
+  bool observed = this->history != NULL || this->log != NULL || this->exporter != NULL || this->tracker != NULL;
+  if (observed || this->collect_statistics) {
+    // The observers and statistics need every generation on the host, step by step instead.
+    for (long g = 0; g < generations; g++) {
+      evolve();
+      consumer(this->generation, this->grid);
+    }
+    return;
+  }
+  host_buffers = std::max(host_buffers, 2);
+  cl->init_pipeline(*this);
+  size_t bytes = sizeof(bool) * this->N;
+
+  std::vector<bool*> slots(host_buffers);
+  for (bool*& slot : slots) slot = new bool[this->N];
+
+  // A generation whose readback was enqueued, waiting for the consumer.
+  struct Item {
+    long generation;
+    int slot;
+    cl_event read_event;
+  };
+  std::mutex mutex;
+  std::condition_variable changed;
+  std::deque<Item> items;
+  std::vector<bool> busy(host_buffers, false); // Host buffer is being read back or consumed.
+  bool finished = false;
+
+  std::thread consumer_thread([&] {
+    while (true) {
+      Item item;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [&] { return !items.empty() || finished; });
+        if (items.empty()) return;
+        item = items.front();
+        items.pop_front();
+      }
+      clWaitForEvents(1, &item.read_event);
+      clReleaseEvent(item.read_event);
+      consumer(item.generation, slots[item.slot]);
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        busy[item.slot] = false;
+      }
+      changed.notify_all();
+    }
+  });
+
+  // Upload the current grid once, afterwards the grid stays on the device.
+  sync_grid();
+  cl->err = clEnqueueWriteBuffer(cl->queue, cl->buffer_ring[0], CL_FALSE, 0, bytes, this->grid, 0, NULL, NULL);
+  cl->checkError(cl->err, "clEnqueueWriteBuffer (buffer_ring)");
+
+  // Latest readback of each ring buffer; the kernel that overwrites the buffer has to wait for it.
+  cl_event ring_read[3] = {NULL, NULL, NULL};
+  for (long g = 1; g <= generations; g++) {
+    cl_mem source = cl->buffer_ring[(g - 1) % 3];
+    cl_mem target = cl->buffer_ring[g % 3];
+    cl->err = clSetKernelArg(cl->kernel_pipeline, 0, sizeof(cl_mem), &source);
+    cl->checkError(cl->err, "clSetKernelArg (source)");
+    cl->err = clSetKernelArg(cl->kernel_pipeline, 1, sizeof(cl_mem), &target);
+    cl->checkError(cl->err, "clSetKernelArg (target)");
+
+    // The previous kernel is ordered by the in-order queue, the readback of generation g-3 by its event.
+    cl_event kernel_event;
+    cl_uint wait_count = ring_read[g % 3] != NULL ? 1 : 0;
+    cl->err = clEnqueueNDRangeKernel(cl->queue, cl->kernel_pipeline, 2, NULL, cl->evolve_global_work_size, NULL,
+                                     wait_count, wait_count ? &ring_read[g % 3] : NULL, &kernel_event);
+    cl->checkError(cl->err, "clEnqueueNDRangeKernel (pipeline)");
+    clFlush(cl->queue);
+    if (ring_read[g % 3] != NULL) {
+      clReleaseEvent(ring_read[g % 3]);
+      ring_read[g % 3] = NULL;
+    }
+
+    // Only the host waits here (the kernel is already enqueued), and only if the consumer is behind.
+    int slot = g % host_buffers;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      changed.wait(lock, [&] { return !busy[slot]; });
+      busy[slot] = true;
+    }
+
+    cl_event read_event;
+    cl->err = clEnqueueReadBuffer(cl->queue_transfer, target, CL_FALSE, 0, bytes, slots[slot], 1, &kernel_event, &read_event);
+    cl->checkError(cl->err, "clEnqueueReadBuffer (pipeline)");
+    clFlush(cl->queue_transfer);
+    clReleaseEvent(kernel_event);
+
+    // One reference for the ring, one for the consumer.
+    clRetainEvent(read_event);
+    ring_read[g % 3] = read_event;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      items.push_back(Item{this->generation + g, slot, read_event});
+    }
+    changed.notify_all();
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    finished = true;
+  }
+  changed.notify_all();
+  consumer_thread.join();
+  clFinish(cl->queue);
+  clFinish(cl->queue_transfer);
+  for (cl_event event : ring_read) {
+    if (event != NULL) clReleaseEvent(event);
+  }
+
+  // The last host buffer holds the final generation.
+  std::memcpy(this->grid, slots[generations % host_buffers], bytes);
+  this->generation += generations;
+  for (bool* slot : slots) delete[] slot;
+}
@@ -1,98 +1,163 @@
 #include "OpenCLWrapper.h"
 #include "World.h"
 
+#include <algorithm>
 #include <vector>
 #include <iostream>
 #include <filesystem>
 #include <fstream>
+#include <stdexcept>
 
 OpenCLWrapper::OpenCLWrapper(World& world) {
-    // All this debugging text is needed because we can't install additional debugging info without sudo rights.
-    std::cout << "OpenCL: Getting platform IDs..." << std::endl;
-    err = clGetPlatformIDs(1, &platform, &platformCount);
-    checkError(err, "clGetPlatformIDs");
+    try {
+        create(world);
+    } catch (const std::runtime_error& e) {
+        release();
+        throw;
+    }
+}
 
-    std::cout << "OpenCL: Getting device IDs..." << std::endl;
-    err = clGetDeviceIDs(platform, CL_DEVICE_TYPE_GPU, 1, &device, &deviceCount);
-    checkError(err, "clGetDeviceIDs");
+void OpenCLWrapper::create(World& world) {
+    // All this debugging text is needed because we can't install additional debugging info without sudo rights.
+    std::cout << "OpenCL: Selecting device " << world.device_selection.to_string() << "..." << std::endl;
+    DeviceInfo selected = select_device(world.device_selection);
+    platform = selected.platform;
+    device = selected.device;
+    clGetPlatformIDs(0, NULL, &platformCount);
+    clGetDeviceIDs(platform, CL_DEVICE_TYPE_ALL, 0, NULL, &deviceCount);
 
     std::cout << "OpenCL: Creating context..." << std::endl;
     context = clCreateContext(NULL, 1, &device, NULL, NULL, &err);
-    checkError(err, "clCreateContext");
+    checkSetup(err, "clCreateContext");
 
     std::cout << "OpenCL: Creating command queue..." << std::endl;
     queue = clCreateCommandQueue(context, device, 0, &err);
     // COMMENT ABOVE AND UNCOMMENT BELOW FOR PROFILING.
     //queue = clCreateCommandQueue(context, device, CL_QUEUE_PROFILING_ENABLE, &err);
-    checkError(err, "clCreateCommandQueue");
+    checkSetup(err, "clCreateCommandQueue");
 
     std::cout << "OpenCL: Reading kernel source..." << std::endl;
     std::string sourceStr = readKernelSource("../src/evolve_and_compare.cl");
     const char* source = sourceStr.c_str();
     program = clCreateProgramWithSource(context, 1, &source, NULL, &err);
-    checkError(err, "clCreateProgramWithSource");
+    checkSetup(err, "clCreateProgramWithSource");
 
-    std::cout << "OpenCL: Building program..." << std::endl;
-    err = clBuildProgram(program, 1, &device, NULL, NULL, NULL);
+    std::cout << "OpenCL: Building program for rule " << world.rule.to_string() << "..." << std::endl;
+    std::string options = build_options(world);
+    err = clBuildProgram(program, 1, &device, options.c_str(), NULL, NULL);
     if (err != CL_SUCCESS) {
         size_t log_size;
         clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, 0, NULL, &log_size);
         std::vector<char> log(log_size);
         clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, log_size, log.data(), NULL);
-        std::cerr << "Error during operation 'clBuildProgram': " << err << std::endl;
-        std::cerr << "Build log:" << std::endl << log.data() << std::endl;
-        exit(1);
+        throw std::runtime_error("Error during operation 'clBuildProgram': " + std::to_string(err) + "\nBuild log:\n"
+                                 + std::string(log.data()));
     }
 
     std::cout << "OpenCL: Creating kernels..." << std::endl;
     kernel_evolve = clCreateKernel(program, "evolve", &err);
-    checkError(err, "clCreateKernel (evolve)");
+    checkSetup(err, "clCreateKernel (evolve)");
     kernel_compare = clCreateKernel(program, "compare_arrays", &err);
-    checkError(err, "clCreateKernel (compare)");
-
-    std::cout << "OpenCL: Creating buffers..." << std::endl;
-    // Buffer for the current grid (evolve).
-    buffer_grid = clCreateBuffer(context, CL_MEM_READ_ONLY, sizeof(bool) * world.N, NULL, &err);
-    checkError(err, "clCreateBuffer (buffer_grid)");
-    // Buffer for the new grid (evolve).
-    buffer_newGrid = clCreateBuffer(context, CL_MEM_WRITE_ONLY, sizeof(bool) * world.N, NULL, &err);
-    checkError(err, "clCreateBuffer (buffer_newGrid)");
+    checkSetup(err, "clCreateKernel (compare)");
+    kernel_evolve_stats = clCreateKernel(program, "evolve_stats", &err);
+    checkSetup(err, "clCreateKernel (evolve_stats)");
+    kernel_multi = clCreateKernel(program, "evolve_multi", &err);
+    checkSetup(err, "clCreateKernel (evolve_multi)");
+    multi_steps = std::min(std::max(world.block_steps, 1), MAX_MULTI_STEPS);
+
+    // Zero-copy if the device shares memory with the host (integrated GPUs, CPU runtimes).
+    cl_bool unified_memory = CL_FALSE;
+    cl_device_type device_type = 0;
+    clGetDeviceInfo(device, CL_DEVICE_HOST_UNIFIED_MEMORY, sizeof(unified_memory), &unified_memory, NULL);
+    clGetDeviceInfo(device, CL_DEVICE_TYPE, sizeof(device_type), &device_type, NULL);
+    if (world.zero_copy == ZeroCopy::Auto) {
+        zero_copy = unified_memory == CL_TRUE || (device_type & CL_DEVICE_TYPE_CPU);
+    } else {
+        zero_copy = world.zero_copy == ZeroCopy::Enabled;
+    }
+    mapped_buffer = NULL;
+
+    std::cout << "OpenCL: Creating buffers" << (zero_copy ? " (zero-copy)" : "") << "..." << std::endl;
+    if (zero_copy) {
+        // Host-visible ping-pong buffers, World maps the current one instead of copying it.
+        buffer_grid = clCreateBuffer(context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, sizeof(bool) * world.N, NULL, &err);
+        checkSetup(err, "clCreateBuffer (buffer_grid)");
+        buffer_newGrid = clCreateBuffer(context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, sizeof(bool) * world.N, NULL, &err);
+        checkSetup(err, "clCreateBuffer (buffer_newGrid)");
+    } else {
+        // Buffer for the current grid (evolve), read-write as evolve_multi passes ping-pong between both buffers.
+        buffer_grid = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(bool) * world.N, NULL, &err);
+        checkSetup(err, "clCreateBuffer (buffer_grid)");
+        // Buffer for the new grid (evolve).
+        buffer_newGrid = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(bool) * world.N, NULL, &err);
+        checkSetup(err, "clCreateBuffer (buffer_newGrid)");
+    }
     // Buffer for the first grid (compare)
     buffer_grid1 = clCreateBuffer(context, CL_MEM_READ_ONLY, sizeof(bool) * world.N, NULL, &err);
-    checkError(err, "clCreateBuffer (buffer_grid1)");
+    checkSetup(err, "clCreateBuffer (buffer_grid1)");
     // Buffer for the second grid (compare)
     buffer_grid2 = clCreateBuffer(context, CL_MEM_READ_ONLY, sizeof(bool) * world.N, NULL, &err);
-    checkError(err, "clCreateBuffer (buffer_grid2)");
+    checkSetup(err, "clCreateBuffer (buffer_grid2)");
     // Buffer for the comparison result (compare)
     buffer_result = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(int), NULL, &err);
-    checkError(err, "clCreateBuffer (buffer_result)");
+    checkSetup(err, "clCreateBuffer (buffer_result)");
+    // Buffer for the global statistic counters (evolve_stats)
+    buffer_counters = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(cl_int) * 7, NULL, &err);
+    checkSetup(err, "clCreateBuffer (buffer_counters)");
+    // Buffer for the tile densities (evolve_stats)
+    tile_count = (size_t)world.tiles_x() * world.tiles_y();
+    buffer_tiles = clCreateBuffer(context, CL_MEM_WRITE_ONLY, sizeof(cl_ushort) * tile_count, NULL, &err);
+    checkSetup(err, "clCreateBuffer (buffer_tiles)");
 
     std::cout << "OpenCL: Setting kernel arguments..." << std::endl;
     // Set the arguments for the evolve kernel.
     err = clSetKernelArg(kernel_evolve, 0, sizeof(cl_mem), &buffer_grid);
-    checkError(err, "clSetKernelArg (buffer_grid)");
+    checkSetup(err, "clSetKernelArg (buffer_grid)");
     err = clSetKernelArg(kernel_evolve, 1, sizeof(cl_mem), &buffer_newGrid);
-    checkError(err, "clSetKernelArg (buffer_newGrid)");
+    checkSetup(err, "clSetKernelArg (buffer_newGrid)");
     err = clSetKernelArg(kernel_evolve, 2, sizeof(int), &world.width);
-    checkError(err, "clSetKernelArg (width)");
+    checkSetup(err, "clSetKernelArg (width)");
     err = clSetKernelArg(kernel_evolve, 3, sizeof(int), &world.height);
-    checkError(err, "clSetKernelArg (height)");
+    checkSetup(err, "clSetKernelArg (height)");
     // Set the arguments for the compare kernel.
     err = clSetKernelArg(kernel_compare, 0, sizeof(cl_mem), &buffer_grid1);
-    checkError(err, "clSetKernelArg (buffer_grid1)");
+    checkSetup(err, "clSetKernelArg (buffer_grid1)");
     err = clSetKernelArg(kernel_compare, 1, sizeof(cl_mem), &buffer_grid2);
-    checkError(err, "clSetKernelArg (buffer_grid2)");
+    checkSetup(err, "clSetKernelArg (buffer_grid2)");
     err = clSetKernelArg(kernel_compare, 2, sizeof(cl_mem), &buffer_result);
-    checkError(err, "clSetKernelArg (result)");
+    checkSetup(err, "clSetKernelArg (result)");
 
     err = clSetKernelArg(kernel_compare, 3, sizeof(ulong), &world.N);
-    checkError(err, "clSetKernelArg (N)");
+    checkSetup(err, "clSetKernelArg (N)");
+    // Set the arguments for the evolve_stats kernel.
+    err = clSetKernelArg(kernel_evolve_stats, 0, sizeof(cl_mem), &buffer_grid);
+    checkSetup(err, "clSetKernelArg (buffer_grid)");
+    err = clSetKernelArg(kernel_evolve_stats, 1, sizeof(cl_mem), &buffer_newGrid);
+    checkSetup(err, "clSetKernelArg (buffer_newGrid)");
+    err = clSetKernelArg(kernel_evolve_stats, 2, sizeof(int), &world.width);
+    checkSetup(err, "clSetKernelArg (width)");
+    err = clSetKernelArg(kernel_evolve_stats, 3, sizeof(int), &world.height);
+    checkSetup(err, "clSetKernelArg (height)");
+    err = clSetKernelArg(kernel_evolve_stats, 4, sizeof(cl_mem), &buffer_counters);
+    checkSetup(err, "clSetKernelArg (buffer_counters)");
+    err = clSetKernelArg(kernel_evolve_stats, 5, sizeof(cl_mem), &buffer_tiles);
+    checkSetup(err, "clSetKernelArg (buffer_tiles)");
+    // Set the arguments for the evolve_multi kernel (buffers and steps are set per launch).
+    err = clSetKernelArg(kernel_multi, 2, sizeof(int), &world.width);
+    checkSetup(err, "clSetKernelArg (width)");
+    err = clSetKernelArg(kernel_multi, 3, sizeof(int), &world.height);
+    checkSetup(err, "clSetKernelArg (height)");
 
     evolve_global_work_size[0] = (size_t)world.width;
     evolve_global_work_size[1] = (size_t)world.height;
     //evolve_local_work_size[0] = 16;
     //evolve_local_work_size[1] = 16;
 
+    stats_local_work_size[0] = STATS_TILE;
+    stats_local_work_size[1] = STATS_TILE;
+    stats_global_work_size[0] = (size_t)world.tiles_x() * STATS_TILE;
+    stats_global_work_size[1] = (size_t)world.tiles_y() * STATS_TILE;
+
     compare_global_work_size[0] = world.N;
     //compare_local_work_size[0] = 16;
 
@@ -100,17 +165,175 @@ OpenCLWrapper::OpenCLWrapper(World& world) {
     printAttributes(platform, device);
 }
 
+DeviceSelection DeviceSelection::parse(const std::string& text) {
+    DeviceSelection selection;
+    selection.fallback = false;
+    std::string type = text;
+    size_t slash = type.find('/');
+    try {
+        if (slash != std::string::npos) {
+            selection.sub_devices = std::stoi(type.substr(slash + 1));
+            type = type.substr(0, slash);
+        }
+        size_t colon = type.find(':');
+        if (colon != std::string::npos) {
+            selection.index = std::stoi(type.substr(colon + 1));
+            type = type.substr(0, colon);
+        }
+    } catch (const std::logic_error& e) {
+        throw std::invalid_argument("Invalid device: " + text);
+    }
+    if (type == "gpu") {
+        selection.type = CL_DEVICE_TYPE_GPU;
+    } else if (type == "cpu") {
+        selection.type = CL_DEVICE_TYPE_CPU;
+    } else if (type == "accelerator") {
+        selection.type = CL_DEVICE_TYPE_ACCELERATOR;
+    } else if (type == "any") {
+        selection.type = CL_DEVICE_TYPE_ALL;
+    } else {
+        throw std::invalid_argument("Invalid device: " + text);
+    }
+    if (selection.index < 0 || selection.sub_devices < 0) {
+        throw std::invalid_argument("Invalid device: " + text);
+    }
+    return selection;
+}
+
+std::string DeviceSelection::to_string() const {
+    std::string text;
+    switch (type) {
+    case CL_DEVICE_TYPE_GPU:
+        text = "gpu";
+        break;
+    case CL_DEVICE_TYPE_CPU:
+        text = "cpu";
+        break;
+    case CL_DEVICE_TYPE_ACCELERATOR:
+        text = "accelerator";
+        break;
+    default:
+        text = "any";
+    }
+    text += ":" + std::to_string(index);
+    if (sub_devices > 0) text += "/" + std::to_string(sub_devices);
+    return text;
+}
+
+std::vector<DeviceInfo> OpenCLWrapper::list_devices() {
+    std::vector<DeviceInfo> devices;
+    cl_uint platform_count = 0;
+    // Fails without an installed runtime (no ICD), that simply means there are no devices.
+    if (clGetPlatformIDs(0, NULL, &platform_count) != CL_SUCCESS || platform_count == 0) return devices;
+    std::vector<cl_platform_id> platforms(platform_count);
+    clGetPlatformIDs(platform_count, platforms.data(), NULL);
+
+    for (cl_platform_id platform : platforms) {
+        cl_uint device_count = 0;
+        if (clGetDeviceIDs(platform, CL_DEVICE_TYPE_ALL, 0, NULL, &device_count) != CL_SUCCESS) continue;
+        std::vector<cl_device_id> ids(device_count);
+        clGetDeviceIDs(platform, CL_DEVICE_TYPE_ALL, device_count, ids.data(), NULL);
+        for (cl_device_id id : ids) {
+            DeviceInfo info;
+            char name[1024] = "";
+            info.platform = platform;
+            info.device = id;
+            clGetDeviceInfo(id, CL_DEVICE_TYPE, sizeof(info.type), &info.type, NULL);
+            clGetDeviceInfo(id, CL_DEVICE_NAME, sizeof(name), name, NULL);
+            info.name = name;
+            devices.push_back(info);
+        }
+    }
+    return devices;
+}
+
+DeviceInfo OpenCLWrapper::select_device(const DeviceSelection& selection) {
+    std::vector<DeviceInfo> devices = list_devices();
+    int index = 0;
+    for (const DeviceInfo& info : devices) {
+        if ((info.type & selection.type) && index++ == selection.index) return info;
+    }
+    // Nodes without a GPU run the kernels on a CPU runtime instead.
+    if (selection.fallback && !devices.empty()) {
+        std::cout << "OpenCL: No device " << selection.to_string() << ", using " << devices[0].name << std::endl;
+        return devices[0];
+    }
+    throw std::runtime_error("OpenCL: No device " + selection.to_string() + " (" + std::to_string(devices.size()) + " devices found)");
+}
+
+bool* OpenCLWrapper::mapGrid(cl_mem buffer, size_t bytes) {
+    void* pointer = clEnqueueMapBuffer(queue, buffer, CL_TRUE, CL_MAP_READ | CL_MAP_WRITE, 0, bytes, 0, NULL, NULL, &err);
+    checkError(err, "clEnqueueMapBuffer");
+    mapped_buffer = buffer;
+    return (bool*)pointer;
+}
+
+void OpenCLWrapper::unmapGrid(cl_mem buffer, bool* pointer) {
+    err = clEnqueueUnmapMemObject(queue, buffer, pointer, 0, NULL, NULL);
+    checkError(err, "clEnqueueUnmapMemObject");
+    mapped_buffer = NULL;
+}
+
+void OpenCLWrapper::bind_grid_buffers() {
+    cl_kernel kernels[2] = {kernel_evolve, kernel_evolve_stats};
+    for (cl_kernel kernel : kernels) {
+        err = clSetKernelArg(kernel, 0, sizeof(cl_mem), &buffer_grid);
+        checkError(err, "clSetKernelArg (buffer_grid)");
+        err = clSetKernelArg(kernel, 1, sizeof(cl_mem), &buffer_newGrid);
+        checkError(err, "clSetKernelArg (buffer_newGrid)");
+    }
+}
+
+void OpenCLWrapper::init_pipeline(World& world) {
+    if (pipeline_initialized) return;
+
+    std::cout << "OpenCL: Creating pipeline..." << std::endl;
+    queue_transfer = clCreateCommandQueue(context, device, 0, &err);
+    checkError(err, "clCreateCommandQueue (queue_transfer)");
+    for (int i = 0; i < 3; i++) {
+        buffer_ring[i] = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(bool) * world.N, NULL, &err);
+        checkError(err, "clCreateBuffer (buffer_ring)");
+    }
+    kernel_pipeline = clCreateKernel(program, "evolve", &err);
+    checkError(err, "clCreateKernel (pipeline)");
+    err = clSetKernelArg(kernel_pipeline, 2, sizeof(int), &world.width);
+    checkError(err, "clSetKernelArg (width)");
+    err = clSetKernelArg(kernel_pipeline, 3, sizeof(int), &world.height);
+    checkError(err, "clSetKernelArg (height)");
+    pipeline_initialized = true;
+}
+
 OpenCLWrapper::~OpenCLWrapper() {
-    clReleaseMemObject(buffer_newGrid);
-    clReleaseMemObject(buffer_grid);
-    clReleaseMemObject(buffer_grid1);
-    clReleaseMemObject(buffer_grid2);
-    clReleaseMemObject(buffer_result);
-    clReleaseKernel(kernel_evolve);
-    clReleaseKernel(kernel_compare);
-    clReleaseProgram(program);
-    clReleaseCommandQueue(queue);
-    clReleaseContext(context);
+    release();
+}
+
+void OpenCLWrapper::release() {
+    if (pipeline_initialized) {
+        for (int i = 0; i < 3; i++) clReleaseMemObject(buffer_ring[i]);
+        clReleaseKernel(kernel_pipeline);
+        clReleaseCommandQueue(queue_transfer);
+        pipeline_initialized = false;
+    }
+    // A failed setup leaves the objects after the failing one NULL.
+    cl_mem buffers[7] = {buffer_newGrid, buffer_grid, buffer_grid1, buffer_grid2, buffer_result, buffer_counters, buffer_tiles};
+    for (cl_mem buffer : buffers) {
+        if (buffer != NULL) clReleaseMemObject(buffer);
+    }
+    cl_kernel kernels[4] = {kernel_evolve, kernel_evolve_stats, kernel_multi, kernel_compare};
+    for (cl_kernel kernel : kernels) {
+        if (kernel != NULL) clReleaseKernel(kernel);
+    }
+    if (program != NULL) clReleaseProgram(program);
+    if (queue != NULL) clReleaseCommandQueue(queue);
+    if (context != NULL) clReleaseContext(context);
+}
+
+std::string OpenCLWrapper::build_options(World& world) {
+    // Bake the rule into the kernel as preprocessor constants.
+    return "-D BIRTH_MASK=" + std::to_string(world.rule.birth)
+         + " -D SURVIVE_MASK=" + std::to_string(world.rule.survive)
+         + " -D STATS_TILE=" + std::to_string(STATS_TILE)
+         + " -D MULTI_STEPS=" + std::to_string(std::min(std::max(world.block_steps, 1), MAX_MULTI_STEPS));
 }
 
 std::string OpenCLWrapper::readKernelSource(const char* filename) {
@@ -128,6 +351,12 @@ void OpenCLWrapper::checkError(cl_int err, const char* operation) {
     }
 }
 
+void OpenCLWrapper::checkSetup(cl_int err, const char* operation) {
+    if (err != CL_SUCCESS) {
+        throw std::runtime_error("Error during operation '" + std::string(operation) + "': " + std::to_string(err));
+    }
+}
+
 void OpenCLWrapper::printAttributes(cl_platform_id platform, cl_device_id device) {
     char info[1024];
 
@@ -175,6 +404,7 @@ void OpenCLWrapper::printAttributes(cl_platform_id platform, cl_device_id device
     std::cout << "  kernel_evolve: " << kernel_evolve << std::endl;
     std::cout << "  kernel_compare: " << kernel_compare << std::endl;
     std::cout << "  buffer_newGrid: " << buffer_newGrid << std::endl;
+    std::cout << "  zero_copy: " << zero_copy << std::endl;
     std::cout << "  evolve_global_work_size: [" << evolve_global_work_size[0] << ", " << evolve_global_work_size[1] << "]" << std::endl;
     std::cout << "  compare_global_work_size: [" << compare_global_work_size[0] << "]" << std::endl;
     std::cout << "  context: " << context << std::endl;
@@ -0,0 +1,192 @@
+#include "Patterns.h"
+
+#include <cctype>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+Pattern::Pattern(const std::string& name, int height, int width) {
+  this->name = name;
+  this->height = height;
+  this->width = width;
+  this->words = (width + 63) / 64;
+  this->bits.assign((size_t)height * this->words, 0);
+}
+
+uint64_t Pattern::population() const {
+  uint64_t count = 0;
+  for (uint64_t word : this->bits) count += __builtin_popcountll(word);
+  return count;
+}
+
+Pattern Pattern::transformed(int transform) const {
+  bool reflect = transform & 4;
+  int rotations = transform & 3;
+  bool swap = rotations % 2 == 1;
+  Pattern result(this->name, swap ? this->width : this->height, swap ? this->height : this->width);
+  for (int y = 0; y < this->height; y++) {
+    for (int x = 0; x < this->width; x++) {
+      if (!get(y, x)) continue;
+      int ty = y, tx = reflect ? this->width - 1 - x : x;
+      int h = this->height, w = this->width;
+      // Clockwise rotation: (y, x) -> (x, h - 1 - y).
+      for (int r = 0; r < rotations; r++) {
+        int ry = tx, rx = h - 1 - ty;
+        ty = ry;
+        tx = rx;
+        std::swap(h, w);
+      }
+      result.set(ty, tx);
+    }
+  }
+  return result;
+}
+
+Pattern Pattern::from_rle(const std::string& name, const std::string& text) {
+  std::istringstream iss(text);
+  std::string line, body;
+  int width = -1, height = -1;
+  while (std::getline(iss, line)) {
+    if (line.empty() || line[0] == '#') continue;
+    if (width < 0) {
+      // Header: x = 3, y = 3, rule = B3/S23
+      for (char& c : line) {
+        if (c == ',' || c == '=') c = ' ';
+      }
+      std::istringstream header(line);
+      std::string key;
+      while (header >> key) {
+        if (key == "x") header >> width;
+        else if (key == "y") header >> height;
+      }
+      if (width < 0 || height < 0) throw std::invalid_argument("Missing RLE header in pattern " + name);
+      continue;
+    }
+    body += line;
+  }
+
+  Pattern pattern(name, height, width);
+  int x = 0, y = 0, count = 0;
+  for (char c : body) {
+    if (std::isdigit((unsigned char)c)) {
+      count = count * 10 + (c - '0');
+      continue;
+    }
+    int run = count > 0 ? count : 1;
+    count = 0;
+    if (c == '!') break;
+    if (c == '$') {
+      y += run;
+      x = 0;
+    } else if (c == 'b' || c == '.') {
+      x += run;
+    } else if (std::isalpha((unsigned char)c)) {
+      for (int i = 0; i < run; i++, x++) {
+        if (x < width && y < height) pattern.set(y, x);
+      }
+    }
+  }
+  return pattern;
+}
+
+Pattern Pattern::from_plaintext(const std::string& name, const std::string& text) {
+  std::vector<std::string> rows;
+  std::istringstream iss(text);
+  std::string line;
+  size_t width = 0;
+  while (std::getline(iss, line)) {
+    if (!line.empty() && line[0] == '!') continue;
+    if (!line.empty() && line.back() == '\r') line.pop_back();
+    rows.push_back(line);
+    width = std::max(width, line.size());
+  }
+  Pattern pattern(name, (int)rows.size(), (int)width);
+  for (size_t y = 0; y < rows.size(); y++) {
+    for (size_t x = 0; x < rows[y].size(); x++) {
+      if (rows[y][x] == 'O' || rows[y][x] == '*') pattern.set((int)y, (int)x);
+    }
+  }
+  return pattern;
+}
+
+PatternLibrary::PatternLibrary() {
+  // The patterns of the former add_* methods and a few well-known others.
+  static const char* builtin[][2] = {
+    {"glider", "x = 3, y = 3\nbo$2bo$3o!"},
+    {"toad", "x = 4, y = 4\n2bo$o2bo$o2bo$bo!"},
+    {"beacon", "x = 4, y = 4\n2o$o$3bo$2b2o!"},
+    {"methuselah", "x = 3, y = 3\nb2o$2o$bo!"},
+    {"block", "x = 2, y = 2\n2o$2o!"},
+    {"blinker", "x = 3, y = 1\n3o!"},
+    {"lwss", "x = 5, y = 4\nbo2bo$o$o3bo$4o!"},
+    {"acorn", "x = 7, y = 3\nbo$3bo$2o2b3o!"},
+    {"diehard", "x = 8, y = 3\n6bo$2o$bo3b3o!"},
+    {"gosper_gun", "x = 36, y = 9\n24bo$22bobo$12b2o6b2o12b2o$11bo3bo4b2o12b2o$2o8bo5bo3b2o$"
+                   "2o8bo3bob2o4bobo$10bo5bo7bo$11bo3bo$12b2o!"},
+  };
+  for (const auto& entry : builtin) {
+    add(Pattern::from_rle(entry[0], entry[1]));
+  }
+}
+
+void PatternLibrary::add(const Pattern& pattern) {
+  this->patterns[pattern.name] = pattern;
+}
+
+void PatternLibrary::load_file(const std::string& file_name) {
+  std::ifstream file(file_name);
+  if (!file.is_open()) {
+    throw std::runtime_error("Unable to open file: " + file_name);
+  }
+  std::stringstream buffer;
+  buffer << file.rdbuf();
+  std::filesystem::path path(file_name);
+  std::string name = path.stem().string();
+  if (path.extension() == ".rle") {
+    add(Pattern::from_rle(name, buffer.str()));
+  } else {
+    add(Pattern::from_plaintext(name, buffer.str()));
+  }
+}
+
+int PatternLibrary::load_directory(const std::string& directory) {
+  if (!std::filesystem::is_directory(directory)) return 0;
+  int count = 0;
+  for (const auto& entry : std::filesystem::directory_iterator(directory)) {
+    std::string extension = entry.path().extension().string();
+    if (extension != ".rle" && extension != ".cells") continue;
+    try {
+      load_file(entry.path().string());
+      count++;
+    } catch (const std::exception& e) {
+      std::cerr << e.what() << std::endl;
+    }
+  }
+  return count;
+}
+
+const Pattern& PatternLibrary::get(const std::string& name) const {
+  auto it = this->patterns.find(name);
+  if (it == this->patterns.end()) {
+    throw std::invalid_argument("Unknown pattern: " + name);
+  }
+  return it->second;
+}
+
+std::vector<std::string> PatternLibrary::names() const {
+  std::vector<std::string> result;
+  for (const auto& entry : this->patterns) result.push_back(entry.first);
+  return result;
+}
+
+const PatternLibrary& PatternLibrary::shared() {
+  // Initialized once, thread-safe since C++11.
+  static const PatternLibrary library = [] {
+    PatternLibrary loaded;
+    loaded.load_directory("patterns");
+    return loaded;
+  }();
+  return library;
+}
@@ -0,0 +1,252 @@
+#include "PlaneWorld.h"
+#include "World.h"
+
+#include <algorithm>
+#include <climits>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <unordered_set>
+#include <vector>
+
+// Chunk coordinate of a cell coordinate (rounding towards negative infinity).
+static int32_t chunk_of(long c) {
+  return (int32_t)(c >= 0 ? c / PlaneWorld::CHUNK_SIZE : -((-c - 1) / PlaneWorld::CHUNK_SIZE) - 1);
+}
+
+// Bit-sliced adders: add the bits of several words position by position.
+static inline void add2(uint64_t a, uint64_t b, uint64_t& sum, uint64_t& carry) {
+  sum = a ^ b;
+  carry = a & b;
+}
+
+static inline void add3(uint64_t a, uint64_t b, uint64_t c, uint64_t& sum, uint64_t& carry) {
+  uint64_t t = a ^ b;
+  sum = t ^ c;
+  carry = (a & b) | (t & c);
+}
+
+PlaneWorld::PlaneWorld(const Rule& rule) {
+  if (rule.birth & 1) {
+    throw std::invalid_argument("The unbounded plane does not support B0 rules: " + rule.to_string());
+  }
+  this->rule = rule;
+  this->generation = 0;
+  this->min_x = this->min_y = this->max_x = this->max_y = 0;
+}
+
+PlaneWorld::PlaneWorld(World& world) : PlaneWorld(world.rule) {
+  for (int y = 0; y < world.height; y++) {
+    for (int x = 0; x < world.width; x++) {
+      if (world.grid[y * world.width + x]) set_cell_state(1, y, x);
+    }
+  }
+}
+
+int PlaneWorld::get_cell_state(long y, long x) const {
+  auto it = this->chunks.find(key(chunk_of(x), chunk_of(y)));
+  if (it == this->chunks.end()) return 0;
+  long lx = x - (long)chunk_of(x) * CHUNK_SIZE;
+  long ly = y - (long)chunk_of(y) * CHUNK_SIZE;
+  return (it->second.rows[ly] >> lx) & 1;
+}
+
+void PlaneWorld::set_cell_state(int state, long y, long x) {
+  int64_t k = key(chunk_of(x), chunk_of(y));
+  long lx = x - (long)chunk_of(x) * CHUNK_SIZE;
+  long ly = y - (long)chunk_of(y) * CHUNK_SIZE;
+  auto it = this->chunks.find(k);
+  if (state) {
+    if (this->chunks.empty()) {
+      this->min_x = this->max_x = x;
+      this->min_y = this->max_y = y;
+    }
+    if (it == this->chunks.end()) {
+      it = this->chunks.emplace(k, Chunk()).first;
+      std::fill_n(it->second.rows, CHUNK_SIZE, 0);
+    }
+    it->second.rows[ly] |= 1ULL << lx;
+    // Births can only grow the bounding box.
+    this->min_x = std::min(this->min_x, x);
+    this->max_x = std::max(this->max_x, x);
+    this->min_y = std::min(this->min_y, y);
+    this->max_y = std::max(this->max_y, y);
+  } else if (it != this->chunks.end()) {
+    it->second.rows[ly] &= ~(1ULL << lx);
+    bool empty = std::all_of(it->second.rows, it->second.rows + CHUNK_SIZE, [](uint64_t r) { return r == 0; });
+    if (empty) this->chunks.erase(it);
+    update_bounding_box();
+  }
+}
+
+template <bool Conway>
+bool PlaneWorld::evolve_chunk(const Chunk* n[9], Chunk& out) const {
+  // Word of row y (-1 to CHUNK_SIZE) in chunk column col (0 = west, 1 = center, 2 = east).
+  auto word = [&n](int col, int y) -> uint64_t {
+    int row_chunk = y < 0 ? 0 : (y >= CHUNK_SIZE ? 2 : 1);
+    const Chunk* c = n[row_chunk * 3 + col];
+    if (c == NULL) return 0;
+    return c->rows[(y + CHUNK_SIZE) % CHUNK_SIZE];
+  };
+
+  uint64_t any = 0;
+  for (int y = 0; y < CHUNK_SIZE; y++) {
+    uint64_t in[8];
+    int i = 0;
+    for (int dy = -1; dy <= 1; dy++) {
+      uint64_t c = word(1, y + dy);
+      // Bit x of "west" is the cell at x-1, bit x of "east" the cell at x+1.
+      uint64_t west = (c << 1) | (word(0, y + dy) >> (CHUNK_SIZE - 1));
+      uint64_t east = (c >> 1) | (word(2, y + dy) << (CHUNK_SIZE - 1));
+      in[i++] = west;
+      in[i++] = east;
+      if (dy != 0) in[i++] = c;
+    }
+    uint64_t alive = n[4] != NULL ? n[4]->rows[y] : 0;
+
+    // Count the 8 neighbors of all 64 cells at once into the bit planes b0 to b3.
+    uint64_t s0, s1, s2, c0, c1, c2, b0, c3, t, k1, b1, k2;
+    add3(in[0], in[1], in[2], s0, c0);
+    add3(in[3], in[4], in[5], s1, c1);
+    add2(in[6], in[7], s2, c2);
+    add3(s0, s1, s2, b0, c3);
+    add3(c0, c1, c2, t, k1);
+    add2(t, c3, b1, k2);
+    uint64_t b2 = k1 ^ k2;
+    uint64_t b3 = k1 & k2;
+
+    uint64_t next;
+    if (Conway) {
+      next = b1 & ~b2 & ~b3 & (b0 | alive);
+    } else {
+      uint64_t born = 0, survives = 0;
+      for (int count = 0; count <= 8; count++) {
+        uint64_t eq = ((count & 1) ? b0 : ~b0) & ((count & 2) ? b1 : ~b1)
+                    & ((count & 4) ? b2 : ~b2) & ((count & 8) ? b3 : ~b3);
+        if (this->rule.birth & (1 << count)) born |= eq;
+        if (this->rule.survive & (1 << count)) survives |= eq;
+      }
+      next = (alive & survives) | (~alive & born);
+    }
+    out.rows[y] = next;
+    any |= next;
+  }
+  return any != 0;
+}
+
+void PlaneWorld::evolve() {
+  // Candidates are the stored chunks and the neighbors that living cells on a border can reach.
+  std::unordered_set<int64_t, KeyHash> candidates;
+  candidates.reserve(this->chunks.size() * 2);
+  for (const auto& entry : this->chunks) {
+    int32_t cx = key_x(entry.first), cy = key_y(entry.first);
+    const Chunk& c = entry.second;
+    candidates.insert(entry.first);
+
+    uint64_t west = 0, east = 0;
+    for (int y = 0; y < CHUNK_SIZE; y++) {
+      west |= c.rows[y] & 1;
+      east |= c.rows[y] >> (CHUNK_SIZE - 1);
+    }
+    bool north = c.rows[0] != 0, south = c.rows[CHUNK_SIZE - 1] != 0;
+    if (west) candidates.insert(key(cx - 1, cy));
+    if (east) candidates.insert(key(cx + 1, cy));
+    if (north) candidates.insert(key(cx, cy - 1));
+    if (south) candidates.insert(key(cx, cy + 1));
+    if (c.rows[0] & 1) candidates.insert(key(cx - 1, cy - 1));
+    if (c.rows[0] >> (CHUNK_SIZE - 1)) candidates.insert(key(cx + 1, cy - 1));
+    if (c.rows[CHUNK_SIZE - 1] & 1) candidates.insert(key(cx - 1, cy + 1));
+    if (c.rows[CHUNK_SIZE - 1] >> (CHUNK_SIZE - 1)) candidates.insert(key(cx + 1, cy + 1));
+  }
+
+  std::unordered_map<int64_t, Chunk, KeyHash> next;
+  next.reserve(candidates.size());
+  bool conway = this->rule.is_conway();
+  Chunk result;
+  for (int64_t k : candidates) {
+    int32_t cx = key_x(k), cy = key_y(k);
+    const Chunk* n[9];
+    for (int dy = -1; dy <= 1; dy++) {
+      for (int dx = -1; dx <= 1; dx++) {
+        auto it = this->chunks.find(key(cx + dx, cy + dy));
+        n[(dy + 1) * 3 + dx + 1] = it != this->chunks.end() ? &it->second : NULL;
+      }
+    }
+    bool alive = conway ? evolve_chunk<true>(n, result) : evolve_chunk<false>(n, result);
+    // Empty chunks are freed (not copied into the new map).
+    if (alive) next.emplace(k, result);
+  }
+
+  this->chunks.swap(next);
+  this->generation++;
+  update_bounding_box();
+}
+
+void PlaneWorld::update_bounding_box() {
+  this->min_x = this->min_y = LONG_MAX;
+  this->max_x = this->max_y = LONG_MIN;
+  for (const auto& entry : this->chunks) {
+    long ox = (long)key_x(entry.first) * CHUNK_SIZE;
+    long oy = (long)key_y(entry.first) * CHUNK_SIZE;
+    uint64_t columns = 0;
+    for (int y = 0; y < CHUNK_SIZE; y++) {
+      if (entry.second.rows[y] == 0) continue;
+      columns |= entry.second.rows[y];
+      this->min_y = std::min(this->min_y, oy + y);
+      this->max_y = std::max(this->max_y, oy + y);
+    }
+    this->min_x = std::min(this->min_x, ox + __builtin_ctzll(columns));
+    this->max_x = std::max(this->max_x, ox + 63 - __builtin_clzll(columns));
+  }
+}
+
+bool PlaneWorld::bounding_box(long& min_x, long& min_y, long& max_x, long& max_y) const {
+  if (this->chunks.empty()) return false;
+  min_x = this->min_x;
+  min_y = this->min_y;
+  max_x = this->max_x;
+  max_y = this->max_y;
+  return true;
+}
+
+uint64_t PlaneWorld::population() const {
+  uint64_t count = 0;
+  for (const auto& entry : this->chunks) {
+    for (int y = 0; y < CHUNK_SIZE; y++) {
+      count += __builtin_popcountll(entry.second.rows[y]);
+    }
+  }
+  return count;
+}
+
+void PlaneWorld::save_gamestate(std::string file_name) const {
+  file_name = "configurations/" + file_name + ".txt";
+  // Check if file already exists.
+  if (std::filesystem::exists(file_name)) {
+    throw std::runtime_error("File already exists: " + file_name);
+  }
+  long x0 = 0, y0 = 0, x1 = -1, y1 = -1;
+  bounding_box(x0, y0, x1, y1);
+
+  std::ofstream file(file_name);
+  if (file.is_open()) {
+    std::string text = "height = " + std::to_string(y1 - y0 + 1);
+    text += "\nwidth = " + std::to_string(x1 - x0 + 1);
+    text += "\nrule = " + this->rule.to_string();
+    text += "\nstart =";
+    for (const auto& entry : this->chunks) {
+      long ox = (long)key_x(entry.first) * CHUNK_SIZE;
+      long oy = (long)key_y(entry.first) * CHUNK_SIZE;
+      for (int y = 0; y < CHUNK_SIZE; y++) {
+        for (uint64_t bits = entry.second.rows[y]; bits != 0; bits &= bits - 1) {
+          long x = ox + __builtin_ctzll(bits);
+          text += " (" + std::to_string(x - x0) + "," + std::to_string(oy + y - y0) + "),";
+        }
+      }
+    }
+    file << text;
+    file.close();
+  } else {
+    throw std::runtime_error("Unable to create file: " + file_name);
+  }
+}
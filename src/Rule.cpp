@@ -0,0 +1,42 @@
+#include "Rule.h"
+
+#include <cctype>
+#include <stdexcept>
+
+Rule Rule::parse(const std::string& rulestring) {
+  Rule rule;
+  rule.birth = 0;
+  rule.survive = 0;
+  bool has_birth = false, has_survive = false;
+
+  uint16_t* target = nullptr;
+  for (char c : rulestring) {
+    if (c == 'B' || c == 'b') {
+      target = &rule.birth;
+      has_birth = true;
+    } else if (c == 'S' || c == 's') {
+      target = &rule.survive;
+      has_survive = true;
+    } else if (c >= '0' && c <= '8' && target != nullptr) {
+      *target |= 1 << (c - '0');
+    } else if (c != '/' && !std::isspace((unsigned char)c)) {
+      throw std::invalid_argument("Invalid rulestring: \"" + rulestring + "\" (expected e.g. B3/S23)");
+    }
+  }
+  if (!has_birth || !has_survive) {
+    throw std::invalid_argument("Invalid rulestring: \"" + rulestring + "\" (expected e.g. B3/S23)");
+  }
+  return rule;
+}
+
+std::string Rule::to_string() const {
+  std::string text = "B";
+  for (int n = 0; n <= 8; n++) {
+    if (birth & (1 << n)) text += (char)('0' + n);
+  }
+  text += "/S";
+  for (int n = 0; n <= 8; n++) {
+    if (survive & (1 << n)) text += (char)('0' + n);
+  }
+  return text;
+}
@@ -0,0 +1,236 @@
+#include "Scheduler.h"
+#include "World.h"
+
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+
+WorldScheduler::WorldScheduler(const DeviceSelection& selection, int queues, int host_threads, int batch) {
+    cl_int err;
+    DeviceInfo selected = OpenCLWrapper::select_device(selection);
+    this->device = selected.device;
+    std::cout << "OpenCL: Scheduling worlds on " << selected.name << "..." << std::endl;
+    this->context = clCreateContext(NULL, 1, &this->device, NULL, NULL, &err);
+    OpenCLWrapper::checkError(err, "clCreateContext");
+    for (int i = 0; i < std::max(1, queues); i++) {
+        this->queues.push_back(clCreateCommandQueue(this->context, this->device, 0, &err));
+        OpenCLWrapper::checkError(err, "clCreateCommandQueue");
+    }
+    this->batch = std::max(1, batch);
+    for (int i = 0; i < std::max(1, host_threads); i++) {
+        this->hosts.emplace_back(&WorldScheduler::host_loop, this);
+    }
+}
+
+WorldScheduler::~WorldScheduler() {
+    try {
+        wait_all();
+    } catch (const std::runtime_error& e) {
+        // A failed job was already reported to wait, or nobody waited for it.
+    }
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->stop = true;
+    }
+    this->changed.notify_all();
+    for (std::thread& host : this->hosts) host.join();
+
+    for (std::unique_ptr<Slot>& slot : this->slots) {
+        for (int i = 0; i < 2; i++) {
+            clReleaseKernel(slot->kernels[i]);
+            clReleaseMemObject(slot->buffers[i]);
+        }
+    }
+    for (auto& program : this->programs) clReleaseProgram(program.second);
+    for (cl_command_queue queue : this->queues) clReleaseCommandQueue(queue);
+    clReleaseContext(this->context);
+}
+
+int WorldScheduler::add(World& world) {
+    cl_int err;
+    // The jobs upload from and read back into the host grid.
+    world.release_mapping();
+    world.sync_grid();
+
+    cl_program program;
+    std::string options = OpenCLWrapper::build_options(world);
+    {
+        // Only add builds programs, the host threads never look at them.
+        std::lock_guard<std::mutex> lock(this->mutex);
+        auto it = this->programs.find(options);
+        program = it != this->programs.end() ? it->second : NULL;
+    }
+    if (program == NULL) {
+        std::cout << "OpenCL: Building program for rule " << world.rule.to_string() << "..." << std::endl;
+        std::string sourceStr = OpenCLWrapper::readKernelSource("../src/evolve_and_compare.cl");
+        const char* source = sourceStr.c_str();
+        program = clCreateProgramWithSource(this->context, 1, &source, NULL, &err);
+        OpenCLWrapper::checkError(err, "clCreateProgramWithSource");
+        err = clBuildProgram(program, 1, &this->device, options.c_str(), NULL, NULL);
+        OpenCLWrapper::checkError(err, "clBuildProgram");
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->programs[options] = program;
+    }
+
+    std::unique_ptr<Slot> slot(new Slot());
+    slot->owner = this;
+    slot->world = &world;
+    for (int i = 0; i < 2; i++) {
+        slot->buffers[i] = clCreateBuffer(this->context, CL_MEM_READ_WRITE, sizeof(bool) * world.N, NULL, &err);
+        OpenCLWrapper::checkError(err, "clCreateBuffer (world)");
+    }
+    for (int i = 0; i < 2; i++) {
+        // Ping-pong with fixed arguments, so no two host threads ever set arguments of the same kernel.
+        slot->kernels[i] = clCreateKernel(program, "evolve", &err);
+        OpenCLWrapper::checkError(err, "clCreateKernel (evolve)");
+        err = clSetKernelArg(slot->kernels[i], 0, sizeof(cl_mem), &slot->buffers[i]);
+        OpenCLWrapper::checkError(err, "clSetKernelArg (grid)");
+        err = clSetKernelArg(slot->kernels[i], 1, sizeof(cl_mem), &slot->buffers[1 - i]);
+        OpenCLWrapper::checkError(err, "clSetKernelArg (newGrid)");
+        err = clSetKernelArg(slot->kernels[i], 2, sizeof(int), &world.width);
+        OpenCLWrapper::checkError(err, "clSetKernelArg (width)");
+        err = clSetKernelArg(slot->kernels[i], 3, sizeof(int), &world.height);
+        OpenCLWrapper::checkError(err, "clSetKernelArg (height)");
+    }
+
+    std::lock_guard<std::mutex> lock(this->mutex);
+    slot->index = (int)this->slots.size();
+    slot->queue = this->queues[slot->index % this->queues.size()];
+    this->slots.push_back(std::move(slot));
+    return (int)this->slots.size() - 1;
+}
+
+void WorldScheduler::submit(int world, long generations) {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    Slot& slot = *this->slots.at(world);
+    auto now = std::chrono::steady_clock::now();
+    slot.jobs.push_back(Job{std::max(0L, generations), now});
+    if (slot.running) return;
+    slot.running = true;
+    if (this->active++ == 0) this->busy_since = now;
+    this->ready.push_back(&slot);
+    this->changed.notify_all();
+}
+
+void WorldScheduler::host_loop() {
+    while (true) {
+        Slot* slot;
+        {
+            std::unique_lock<std::mutex> lock(this->mutex);
+            this->changed.wait(lock, [&] { return this->stop || !this->ready.empty(); });
+            if (this->ready.empty()) return;
+            slot = this->ready.front();
+            this->ready.pop_front();
+        }
+        advance(*slot);
+    }
+}
+
+void CL_CALLBACK WorldScheduler::completed(cl_event, cl_int status, void* data) {
+    // Runs on a thread of the OpenCL runtime: no OpenCL calls here, only hand the world back.
+    Slot* slot = (Slot*)data;
+    WorldScheduler* scheduler = slot->owner;
+    std::lock_guard<std::mutex> lock(scheduler->mutex);
+    if (status < 0 && scheduler->error.empty()) {
+        scheduler->error = "OpenCL command failed for world " + std::to_string(slot->index) + ": " + std::to_string(status);
+    }
+    scheduler->ready.push_back(slot);
+    scheduler->changed.notify_all();
+}
+
+void WorldScheduler::advance(Slot& slot) {
+    World& world = *slot.world;
+    cl_int err;
+    bool start = slot.event == NULL; // A new job, not a completed batch.
+    if (slot.event != NULL) {
+        clReleaseEvent(slot.event);
+        slot.event = NULL;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        auto now = std::chrono::steady_clock::now();
+        if (!this->error.empty()) {
+            // Drop the jobs of this world, wait reports the error.
+            slot.jobs.clear();
+            slot.remaining = 0;
+            slot.reading = false;
+        } else if (slot.reading) {
+            // The result is on the host: the job is done.
+            Job job = slot.jobs.front();
+            slot.jobs.pop_front();
+            world.generation += job.generations;
+            double latency = std::chrono::duration<double>(now - job.submitted).count();
+            slot.report.jobs++;
+            slot.report.generations += job.generations;
+            slot.latency_sum += latency;
+            slot.report.max_latency = std::max(slot.report.max_latency, latency);
+            slot.report.mean_latency = slot.latency_sum / slot.report.jobs;
+            this->cell_generations += (double)world.N * job.generations;
+            slot.reading = false;
+            start = true;
+        }
+        if (slot.jobs.empty()) {
+            slot.running = false;
+            if (--this->active == 0) this->busy_seconds += std::chrono::duration<double>(now - this->busy_since).count();
+            this->changed.notify_all();
+            return;
+        }
+        if (start) slot.remaining = slot.jobs.front().generations;
+    }
+    if (start) {
+        world.grid_changed();
+        // The host grid is the state between jobs (it may have been edited), and stays untouched during the job.
+        err = clEnqueueWriteBuffer(slot.queue, slot.buffers[slot.current], CL_FALSE, 0, sizeof(bool) * world.N,
+                                   world.grid, 0, NULL, NULL);
+        OpenCLWrapper::checkError(err, "clEnqueueWriteBuffer (world)");
+    }
+
+    long steps = std::min<long>(this->batch, slot.remaining);
+    slot.remaining -= steps;
+    cl_event event = NULL;
+    size_t global_work_size[2] = {(size_t)world.width, (size_t)world.height};
+    for (long s = 0; s < steps; s++) {
+        bool last = s == steps - 1 && slot.remaining > 0;
+        err = clEnqueueNDRangeKernel(slot.queue, slot.kernels[slot.current], 2, NULL, global_work_size, NULL,
+                                     0, NULL, last ? &event : NULL);
+        OpenCLWrapper::checkError(err, "clEnqueueNDRangeKernel (evolve)");
+        slot.current = 1 - slot.current;
+    }
+    if (slot.remaining == 0) {
+        err = clEnqueueReadBuffer(slot.queue, slot.buffers[slot.current], CL_FALSE, 0, sizeof(bool) * world.N,
+                                  world.grid, 0, NULL, &event);
+        OpenCLWrapper::checkError(err, "clEnqueueReadBuffer (world)");
+        slot.reading = true;
+    }
+    // Set before the callback can run, the next advance of this world releases it.
+    slot.event = event;
+    err = clSetEventCallback(event, CL_COMPLETE, &WorldScheduler::completed, &slot);
+    OpenCLWrapper::checkError(err, "clSetEventCallback");
+    clFlush(slot.queue);
+}
+
+void WorldScheduler::wait(int world) {
+    std::unique_lock<std::mutex> lock(this->mutex);
+    Slot& slot = *this->slots.at(world);
+    this->changed.wait(lock, [&] { return !slot.running; });
+    if (!this->error.empty()) throw std::runtime_error(this->error);
+}
+
+void WorldScheduler::wait_all() {
+    std::unique_lock<std::mutex> lock(this->mutex);
+    this->changed.wait(lock, [&] { return this->active == 0; });
+    if (!this->error.empty()) throw std::runtime_error(this->error);
+}
+
+WorldScheduler::WorldReport WorldScheduler::report(int world) {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    return this->slots.at(world)->report;
+}
+
+double WorldScheduler::throughput() {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    double seconds = this->busy_seconds;
+    if (this->active > 0) seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - this->busy_since).count();
+    return seconds > 0 ? this->cell_generations / seconds : 0;
+}
@@ -0,0 +1,28 @@
+#include "Statistics.h"
+
+#include <fstream>
+#include <stdexcept>
+
+void write_statistics(const std::string& file_name, const std::vector<GenerationStats>& series,
+                      int tiles_x, int tiles_y) {
+  std::ofstream file(file_name);
+  if (!file.is_open()) {
+    throw std::runtime_error("Unable to create file: " + file_name);
+  }
+  file << "# tile = " << STATS_TILE << "x" << STATS_TILE << ", tiles = " << tiles_x << "x" << tiles_y << "\n";
+  file << "generation,population,births,deaths,min_x,min_y,max_x,max_y,tiles\n";
+  for (const GenerationStats& stats : series) {
+    file << stats.generation << "," << stats.population << "," << stats.births << "," << stats.deaths << ",";
+    if (stats.population > 0) {
+      file << stats.min_x << "," << stats.min_y << "," << stats.max_x << "," << stats.max_y << ",";
+    } else {
+      file << ",,,,";
+    }
+    for (size_t i = 0; i < stats.tiles.size(); i++) {
+      if (i > 0) file << " ";
+      file << stats.tiles[i];
+    }
+    file << "\n";
+  }
+  file.close();
+}
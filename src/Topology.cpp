@@ -0,0 +1,95 @@
+#include "Topology.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Parse a cpu list like "0-3,8-11".
+static std::vector<int> parse_cpu_list(const std::string& list) {
+  std::vector<int> cpus;
+  std::istringstream iss(list);
+  std::string range;
+  while (std::getline(iss, range, ',')) {
+    if (range.empty() || range == "\n") continue;
+    size_t dash = range.find('-');
+    int first = std::stoi(range.substr(0, dash));
+    int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+    for (int cpu = first; cpu <= last; cpu++) cpus.push_back(cpu);
+  }
+  return cpus;
+}
+
+static std::vector<NumaNode> read_nodes() {
+  cpu_set_t allowed;
+  CPU_ZERO(&allowed);
+  bool restricted = sched_getaffinity(0, sizeof(allowed), &allowed) == 0;
+
+  std::vector<NumaNode> nodes;
+  // Node ids can have gaps (e.g. memory-only nodes), so probe up to a generous bound.
+  for (int id = 0; id < 1024; id++) {
+    std::ifstream file("/sys/devices/system/node/node" + std::to_string(id) + "/cpulist");
+    if (!file.is_open()) continue;
+    std::string list;
+    std::getline(file, list);
+    NumaNode node;
+    node.id = id;
+    for (int cpu : parse_cpu_list(list)) {
+      if (!restricted || CPU_ISSET(cpu, &allowed)) node.cpus.push_back(cpu);
+    }
+    if (!node.cpus.empty()) nodes.push_back(node);
+  }
+
+  if (nodes.empty()) {
+    NumaNode node;
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+      if (restricted && CPU_ISSET(cpu, &allowed)) node.cpus.push_back(cpu);
+    }
+    if (node.cpus.empty()) {
+      for (unsigned cpu = 0; cpu < std::max(1u, std::thread::hardware_concurrency()); cpu++) node.cpus.push_back(cpu);
+    }
+    nodes.push_back(node);
+  }
+  return nodes;
+}
+
+const std::vector<NumaNode>& Topology::nodes() {
+  static const std::vector<NumaNode> nodes = read_nodes();
+  return nodes;
+}
+
+bool Topology::pin_current_thread(int cpu) {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+std::vector<int> Topology::page_nodes(const void* address, size_t bytes, size_t stride) {
+  std::vector<void*> pages;
+  for (size_t offset = 0; offset < bytes; offset += stride) {
+    pages.push_back((void*)((const char*)address + offset));
+  }
+  std::vector<int> status(pages.size(), -1);
+#ifdef SYS_move_pages
+  // move_pages without target nodes only queries: status is the node, or a negative errno.
+  if (!pages.empty() && syscall(SYS_move_pages, 0, pages.size(), pages.data(), NULL, status.data(), 0) != 0) {
+    std::fill(status.begin(), status.end(), -1);
+  }
+#endif
+  for (int& node : status) {
+    if (node < 0) node = -1;
+  }
+  return status;
+}
+
+size_t Topology::page_size() {
+  long size = sysconf(_SC_PAGESIZE);
+  return size > 0 ? (size_t)size : 4096;
+}
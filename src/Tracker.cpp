@@ -0,0 +1,440 @@
+#include "Tracker.h"
+#include "World.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+
+// Cells within this distance (in both directions) belong to the same object, as in the census.
+static const int LINK_DISTANCE = 2;
+
+static inline int wrap(int value, int size) {
+  return ((value % size) + size) % size;
+}
+
+// Difference a - b of two positions on a ring, in [-size / 2, size / 2].
+static inline int ring_delta(int a, int b, int size) {
+  int d = wrap(a - b, size);
+  return d > size / 2 ? d - size : d;
+}
+
+// Whether the intervals [a, a + a_length) and [b, b + b_length) on a ring overlap.
+static inline bool ring_overlap(int a, int a_length, int b, int b_length, int size) {
+  if (a_length >= size || b_length >= size) return true;
+  return wrap(b - a, size) < a_length || wrap(a - b, size) < b_length;
+}
+
+static inline uint64_t load64(const bool* p) {
+  uint64_t word;
+  std::memcpy(&word, p, sizeof(word));
+  return word;
+}
+
+static inline uint64_t mix64(uint64_t x) {
+  x ^= x >> 33;
+  x *= 0xFF51AFD7ED558CCDULL;
+  x ^= x >> 33;
+  x *= 0xC4CEB9FE1A85EC53ULL;
+  x ^= x >> 33;
+  return x;
+}
+
+// Longest span of tiles looked at (MAX_SPAN * STATS_TILE cells), objects are far smaller.
+static const int MAX_SPAN = 4096;
+
+// Tiles (of STATS_TILE cells) under the interval [start, start + length) of a ring, each only once.
+static int tile_span(int start, int length, int size, int* span) {
+  int count = 0;
+  length = std::min(length, size);
+  for (int offset = 0; offset < length && count < MAX_SPAN;) {
+    int position = wrap(start + offset, size);
+    int tile = position / STATS_TILE;
+    if (count == 0 || span[0] != tile) span[count++] = tile;
+    // Continue at the next tile (or the start of the ring).
+    offset += std::min(STATS_TILE - position % STATS_TILE, size - position);
+  }
+  return count;
+}
+
+ObjectTracker::ObjectTracker(int max_period) {
+  this->max_period = std::max(1, max_period);
+}
+
+const std::vector<TrackedObject>& ObjectTracker::objects() const {
+  static const std::vector<TrackedObject> none;
+  return this->past.empty() ? none : this->past.back().objects;
+}
+
+CellList ObjectTracker::fill_object(World& world, int x, int y, std::vector<int>& marked) {
+  CellList cells;
+  std::vector<std::pair<int, int> > stack;
+  this->visited[y * world.width + x] = 1;
+  marked.push_back(y * world.width + x);
+  stack.push_back(std::make_pair(x, y));
+  while (!stack.empty()) {
+    std::pair<int, int> c = stack.back();
+    stack.pop_back();
+    cells.push_back(c);
+    for (int dy = -LINK_DISTANCE; dy <= LINK_DISTANCE; dy++) {
+      for (int dx = -LINK_DISTANCE; dx <= LINK_DISTANCE; dx++) {
+        // Unwrapped coordinates, so objects on the seam of the torus stay in one piece.
+        int ux = c.first + dx;
+        int uy = c.second + dy;
+        int index = wrap(uy, world.height) * world.width + wrap(ux, world.width);
+        if (world.grid[index] && !this->visited[index]) {
+          this->visited[index] = 1;
+          marked.push_back(index);
+          stack.push_back(std::make_pair(ux, uy));
+        }
+      }
+    }
+  }
+  return cells;
+}
+
+void ObjectTracker::describe(World& world, TrackedObject& object) {
+  int min_x, min_y;
+  CellList normalised = normalise_cells(*object.cells, min_x, min_y);
+  int max_x = 0, max_y = 0;
+  uint64_t hash = 0;
+  // normalised is sorted, so the hash only depends on the shape.
+  for (const auto& c : normalised) {
+    max_x = std::max(max_x, c.first);
+    max_y = std::max(max_y, c.second);
+    hash = mix64(hash ^ ((uint64_t)(uint32_t)c.first << 32 | (uint32_t)c.second));
+  }
+  object.hash = hash;
+  object.x = wrap(min_x, world.width);
+  object.y = wrap(min_y, world.height);
+  object.width = max_x + 1;
+  object.height = max_y + 1;
+  object.population = (int)object.cells->size();
+}
+
+void ObjectTracker::covered_tiles(World& world, const TrackedObject& object, int margin, std::vector<int>& tiles) {
+  // Tile rows and columns under the grown box, every row and column only once.
+  int rows[MAX_SPAN], columns[MAX_SPAN];
+  int row_count = tile_span(object.y - margin, object.height + 2 * margin, world.height, rows);
+  int column_count = tile_span(object.x - margin, object.width + 2 * margin, world.width, columns);
+  tiles.clear();
+  for (int r = 0; r < row_count; r++) {
+    for (int c = 0; c < column_count; c++) tiles.push_back(rows[r] * world.tiles_x() + columns[c]);
+  }
+}
+
+bool ObjectTracker::touches_changed(World& world, const TrackedObject& object, const std::vector<uint8_t>& changed) {
+  int rows[MAX_SPAN], columns[MAX_SPAN];
+  int row_count = tile_span(object.y - LINK_DISTANCE, object.height + 2 * LINK_DISTANCE, world.height, rows);
+  int column_count = tile_span(object.x - LINK_DISTANCE, object.width + 2 * LINK_DISTANCE, world.width, columns);
+  for (int r = 0; r < row_count; r++) {
+    for (int c = 0; c < column_count; c++) {
+      if (changed[rows[r] * world.tiles_x() + columns[c]]) return true;
+    }
+  }
+  return false;
+}
+
+uint64_t ObjectTracker::shape_key(uint64_t hash, int bucket_x, int bucket_y) const {
+  return mix64(hash ^ ((uint64_t)bucket_y * this->buckets_x + bucket_x));
+}
+
+int ObjectTracker::bucket(int position, int buckets, int size) const {
+  return std::min(buckets - 1, position / (size / buckets));
+}
+
+void ObjectTracker::index_shapes(World& world, const Analysis& analysis, bool add) {
+  for (const TrackedObject& object : analysis.objects) {
+    uint64_t key = shape_key(object.hash, bucket(object.x, this->buckets_x, world.width),
+                             bucket(object.y, this->buckets_y, world.height));
+    if (add) {
+      this->shapes[key].push_back(Shape{object.hash, analysis.generation, object.x, object.y});
+      continue;
+    }
+    auto it = this->shapes.find(key);
+    if (it == this->shapes.end()) continue;
+    std::vector<Shape>& list = it->second;
+    for (size_t i = 0; i < list.size(); i++) {
+      if (list[i].generation == analysis.generation && list[i].x == object.x && list[i].y == object.y) {
+        list[i] = list.back();
+        list.pop_back();
+        break;
+      }
+    }
+    if (list.empty()) this->shapes.erase(it);
+  }
+}
+
+void ObjectTracker::index_tiles(World& world, Analysis& analysis) {
+  int tiles_x = world.tiles_x();
+  size_t tiles = analysis.fingerprints.size();
+  std::vector<int> home(analysis.objects.size());
+  analysis.tile_first.assign(tiles + 1, 0);
+  analysis.large.clear();
+  for (size_t i = 0; i < analysis.objects.size(); i++) {
+    const TrackedObject& object = analysis.objects[i];
+    home[i] = (object.y / STATS_TILE) * tiles_x + object.x / STATS_TILE;
+    // The box grown by the link distance spans at most two tiles in each direction.
+    if (object.width + 2 * LINK_DISTANCE > STATS_TILE || object.height + 2 * LINK_DISTANCE > STATS_TILE) {
+      analysis.large.push_back((int)i);
+    }
+    analysis.tile_first[home[i] + 1]++;
+  }
+  for (size_t t = 0; t < tiles; t++) analysis.tile_first[t + 1] += analysis.tile_first[t];
+  analysis.by_tile.resize(analysis.objects.size());
+  std::vector<int> fill(analysis.tile_first.begin(), analysis.tile_first.end() - 1);
+  for (size_t i = 0; i < analysis.objects.size(); i++) analysis.by_tile[fill[home[i]]++] = (int)i;
+}
+
+void ObjectTracker::find_period(World& world, TrackedObject& object, long generation) {
+  object.period = 0;
+  object.dx = 0;
+  object.dy = 0;
+  // The buckets next to the one of the object, each only once (there may be fewer than 3).
+  std::vector<uint64_t> keys;
+  int bx = bucket(object.x, this->buckets_x, world.width);
+  int by = bucket(object.y, this->buckets_y, world.height);
+  for (int oy = -1; oy <= 1; oy++) {
+    for (int ox = -1; ox <= 1; ox++) {
+      uint64_t key = shape_key(object.hash, wrap(bx + ox, this->buckets_x), wrap(by + oy, this->buckets_y));
+      if (std::find(keys.begin(), keys.end(), key) == keys.end()) keys.push_back(key);
+    }
+  }
+  // The shortest period, then the shortest displacement.
+  int best = -1;
+  for (uint64_t key : keys) {
+    auto it = this->shapes.find(key);
+    if (it == this->shapes.end()) continue;
+    for (const Shape& earlier : it->second) {
+      long period = generation - earlier.generation;
+      if (earlier.hash != object.hash || period <= 0 || (object.period > 0 && period > object.period)) continue;
+      int dx = ring_delta(object.x, earlier.x, world.width);
+      int dy = ring_delta(object.y, earlier.y, world.height);
+      // Nothing moves faster than one cell per generation.
+      if (std::abs(dx) > period || std::abs(dy) > period) continue;
+      if (period < object.period || best < 0 || std::abs(dx) + std::abs(dy) < best) {
+        best = std::abs(dx) + std::abs(dy);
+        object.period = (int)period;
+        object.dx = dx;
+        object.dy = dy;
+      }
+    }
+  }
+}
+
+void ObjectTracker::assign_id(World& world, TrackedObject& object, const std::unordered_map<int, std::vector<int> >& candidates,
+                              std::unordered_set<long>& claimed, long generation) {
+  const TrackedObject* best = NULL;
+  if (!this->past.empty()) {
+    const std::vector<TrackedObject>& previous = this->past.back().objects;
+    std::vector<int> tiles;
+    covered_tiles(world, object, 0, tiles);
+    for (int tile : tiles) {
+      auto it = candidates.find(tile);
+      if (it == candidates.end()) continue;
+      for (int index : it->second) {
+        const TrackedObject& earlier = previous[index];
+        if (claimed.count(earlier.id)) continue;
+        // Cells move at most one cell per generation: compare with the earlier box grown by one.
+        if (!ring_overlap(earlier.x - 1, earlier.width + 2, object.x, object.width, world.width)
+            || !ring_overlap(earlier.y - 1, earlier.height + 2, object.y, object.height, world.height)) continue;
+        bool same = earlier.hash == object.hash;
+        if (best == NULL || (same && best->hash != object.hash)
+            || (same == (best->hash == object.hash) && earlier.population > best->population)) {
+          best = &earlier;
+        }
+      }
+    }
+  }
+  if (best != NULL) {
+    object.id = best->id;
+    object.first_generation = best->first_generation;
+  } else {
+    object.id = this->next_id++;
+    object.first_generation = generation;
+  }
+  claimed.insert(object.id);
+}
+
+void ObjectTracker::analyse(World& world) {
+  auto begin = std::chrono::steady_clock::now();
+  long generation = world.generation;
+  // Rewound (seek, clear): the past generations are no longer the past.
+  if (!this->past.empty() && generation <= this->past.back().generation) {
+    this->past.clear();
+    this->shapes.clear();
+  }
+  if (this->visited.size() != world.N) this->visited.assign(world.N, 0);
+  this->buckets_x = std::max(1, world.width / (this->max_period + 1));
+  this->buckets_y = std::max(1, world.height / (this->max_period + 1));
+
+  Analysis next;
+  next.generation = generation;
+  next.fingerprints = world.tile_fingerprints();
+  size_t tiles = next.fingerprints.size();
+  bool incremental = !this->past.empty() && this->past.back().fingerprints.size() == tiles;
+  std::vector<uint8_t> changed(tiles, 1);
+  if (incremental) {
+    for (size_t t = 0; t < tiles; t++) changed[t] = next.fingerprints[t] != this->past.back().fingerprints[t];
+  }
+
+  // Objects in unchanged surroundings are the same as before, the cells of the others are seeds.
+  std::vector<int> seeds;
+  std::vector<int> dropped;
+  std::vector<int> marked;
+  std::unordered_set<long> claimed;
+  std::vector<uint8_t> carry_period; // Per carried over object: whether its period is still known.
+  if (incremental) {
+    const std::vector<TrackedObject>& previous = this->past.back().objects;
+    for (size_t i = 0; i < previous.size(); i++) {
+      const TrackedObject& object = previous[i];
+      if (!touches_changed(world, object, changed)) {
+        next.objects.push_back(object);
+        claimed.insert(object.id);
+        // Unchanged since the previous analysis: still period 1 if it was.
+        carry_period.push_back(object.period == 1);
+        continue;
+      }
+      dropped.push_back((int)i);
+      for (const auto& c : *object.cells) {
+        int index = wrap(c.second, world.height) * world.width + wrap(c.first, world.width);
+        if (world.grid[index]) seeds.push_back(index);
+      }
+    }
+
+    // Changed tiles that are back in the state of an older analysis (oscillators) keep its objects.
+    int tiles_x = world.tiles_x(), tiles_y = world.tiles_y();
+    std::vector<uint8_t> differs(tiles), resolved(tiles, 0), home_seen(tiles, 0);
+    std::vector<int> matching, homes;
+    for (int j = (int)this->past.size() - 2; j >= 0; j--) {
+      const Analysis& earlier = this->past[j];
+      matching.clear();
+      for (size_t t = 0; t < tiles; t++) {
+        differs[t] = next.fingerprints[t] != earlier.fingerprints[t];
+        if (changed[t] && !resolved[t] && !differs[t]) matching.push_back((int)t);
+      }
+      if (matching.empty()) continue;
+      long gap = generation - earlier.generation;
+      auto carry = [&](const TrackedObject& object) {
+        const auto& first = object.cells->front();
+        if (this->visited[wrap(first.second, world.height) * world.width + wrap(first.first, world.width)]) return;
+        // Objects away from the changed tiles were carried over from the newest analysis.
+        if (!touches_changed(world, object, changed) || touches_changed(world, object, differs)) return;
+        for (const auto& c : *object.cells) {
+          int index = wrap(c.second, world.height) * world.width + wrap(c.first, world.width);
+          this->visited[index] = 1;
+          marked.push_back(index);
+        }
+        next.objects.push_back(object);
+        // Back in the same state: an oscillator whose period divides the gap keeps it.
+        carry_period.push_back(object.period > 0 && object.dx == 0 && object.dy == 0 && gap % object.period == 0);
+        // The id may have gone to another object in the meantime.
+        if (!claimed.insert(object.id).second) {
+          next.objects.back().id = this->next_id++;
+          next.objects.back().first_generation = generation;
+          claimed.insert(next.objects.back().id);
+        }
+      };
+      // Small objects touching a matching tile have their top left corner in it or a neighbor, every such tile once.
+      homes.clear();
+      for (int t : matching) {
+        // Older analyses only help with the tiles this one doesn't match.
+        resolved[t] = 1;
+        for (int oy = -1; oy <= 1; oy++) {
+          for (int ox = -1; ox <= 1; ox++) {
+            int home = wrap(t / tiles_x + oy, tiles_y) * tiles_x + wrap(t % tiles_x + ox, tiles_x);
+            if (!home_seen[home]) {
+              home_seen[home] = 1;
+              homes.push_back(home);
+            }
+          }
+        }
+      }
+      for (int home : homes) {
+        home_seen[home] = 0;
+        for (int k = earlier.tile_first[home]; k < earlier.tile_first[home + 1]; k++) {
+          carry(earlier.objects[earlier.by_tile[k]]);
+        }
+      }
+      for (int index : earlier.large) carry(earlier.objects[index]);
+    }
+  }
+  size_t kept = next.objects.size();
+  this->reused += kept;
+
+  // Living cells of the changed tiles, every worker scans the tile rows of its band.
+  int bands = world.pool != NULL ? world.pool->size() : 1;
+  std::vector<std::vector<int> > band_seeds(bands);
+  std::function<void(int)> scan = [&](int band) {
+    int y_begin, y_end;
+    world.band_range(band, bands, y_begin, y_end);
+    for (int y = y_begin; y < y_end; y++) {
+      const uint8_t* tile_row = changed.data() + (size_t)(y / STATS_TILE) * world.tiles_x();
+      for (int x = 0; x < world.width; x += STATS_TILE) {
+        if (!tile_row[x / STATS_TILE]) continue;
+        int end = std::min(world.width, x + STATS_TILE);
+        for (int i = x; i < end; i++) {
+          // Skip 8 dead cells at once.
+          if (i + 8 <= end && load64(world.grid + y * world.width + i) == 0) {
+            i += 7;
+            continue;
+          }
+          if (world.grid[y * world.width + i]) band_seeds[band].push_back(y * world.width + i);
+        }
+      }
+    }
+  };
+  if (world.pool != NULL) world.pool->run(scan); else scan(0);
+  for (const std::vector<int>& list : band_seeds) seeds.insert(seeds.end(), list.begin(), list.end());
+
+  // Flood fills only reach changed regions: a cell linked to a carried over object would be part of it.
+  for (int index : seeds) {
+    if (this->visited[index]) continue;
+    TrackedObject object;
+    object.cells = std::make_shared<const CellList>(fill_object(world, index % world.width, index / world.width, marked));
+    next.objects.push_back(std::move(object));
+  }
+  for (int index : marked) this->visited[index] = 0;
+  this->segmented += next.objects.size() - kept;
+
+  // Shapes of the new objects and periods, in parallel (the past is only read).
+  std::function<void(int)> measure = [&](int worker) {
+    size_t count = next.objects.size();
+    for (size_t i = count * worker / bands; i < count * (worker + 1) / bands; i++) {
+      if (i >= kept) describe(world, next.objects[i]);
+      if (i >= kept || !carry_period[i]) find_period(world, next.objects[i], generation);
+    }
+  };
+  if (world.pool != NULL) world.pool->run(measure); else measure(0);
+
+  // Carried over objects keep their ids, the others inherit the id of the object they came from.
+  std::unordered_map<int, std::vector<int> > candidates;
+  std::vector<int> covered;
+  if (incremental) {
+    for (int index : dropped) {
+      // Objects carried over from an older analysis already have their ids.
+      if (claimed.count(this->past.back().objects[index].id)) continue;
+      covered_tiles(world, this->past.back().objects[index], 1, covered);
+      for (int tile : covered) candidates[tile].push_back(index);
+    }
+  } else if (!this->past.empty()) {
+    const std::vector<TrackedObject>& previous = this->past.back().objects;
+    for (size_t i = 0; i < previous.size(); i++) {
+      covered_tiles(world, previous[i], 1, covered);
+      for (int tile : covered) candidates[tile].push_back((int)i);
+    }
+  }
+  for (size_t i = kept; i < next.objects.size(); i++) {
+    assign_id(world, next.objects[i], candidates, claimed, generation);
+  }
+
+  index_shapes(world, next, true);
+  index_tiles(world, next);
+  this->past.push_back(std::move(next));
+  while ((int)this->past.size() > this->max_period + 1) {
+    index_shapes(world, this->past.front(), false);
+    this->past.pop_front();
+  }
+  this->seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+}
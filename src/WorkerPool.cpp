@@ -0,0 +1,122 @@
+#include "WorkerPool.h"
+#include "Topology.h"
+
+#include <algorithm>
+#include <chrono>
+
+#include <pthread.h>
+#include <sched.h>
+
+// Pins the calling thread to a cpu for its lifetime and gives it its own affinity back afterwards,
+// so threads it starts later (history, exports, OpenCL runtime, other pools) are not confined to that cpu.
+class CallerPin {
+private:
+  cpu_set_t saved;
+  bool pinned = false;
+
+public:
+  CallerPin(int cpu) {
+    if (cpu < 0 || pthread_getaffinity_np(pthread_self(), sizeof(this->saved), &this->saved) != 0) return;
+    this->pinned = Topology::pin_current_thread(cpu);
+  }
+
+  ~CallerPin() {
+    if (this->pinned) pthread_setaffinity_np(pthread_self(), sizeof(this->saved), &this->saved);
+  }
+};
+
+WorkerPool::WorkerPool(int size, bool pin) {
+  size = std::max(1, size);
+  this->worker_cpus.assign(size, -1);
+  this->worker_nodes.assign(size, -1);
+  this->busy_seconds.assign(size, 0);
+  if (pin) {
+    // Contiguous groups of workers per node, sized by the cpus of the node.
+    const std::vector<NumaNode>& nodes = Topology::nodes();
+    size_t cpus = 0;
+    for (const NumaNode& node : nodes) cpus += node.cpus.size();
+    size_t first = 0, seen = 0;
+    for (const NumaNode& node : nodes) {
+      seen += node.cpus.size();
+      size_t last = (size_t)size * seen / cpus;
+      for (size_t i = first; i < last; i++) {
+        // More workers than cpus: several workers share a cpu of their node.
+        this->worker_cpus[i] = node.cpus[(i - first) % node.cpus.size()];
+        this->worker_nodes[i] = node.id;
+      }
+      first = last;
+    }
+  }
+  for (int i = 1; i < size; i++) {
+    this->threads.emplace_back(&WorkerPool::worker_loop, this, i);
+  }
+}
+
+WorkerPool::~WorkerPool() {
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->stop = true;
+  }
+  this->start.notify_all();
+  for (std::thread& thread : this->threads) {
+    thread.join();
+  }
+}
+
+void WorkerPool::worker_loop(int index) {
+  if (this->worker_cpus[index] >= 0) Topology::pin_current_thread(this->worker_cpus[index]);
+  unsigned long seen = 0;
+  while (true) {
+    const std::function<void(int)>* current;
+    {
+      std::unique_lock<std::mutex> lock(this->mutex);
+      this->start.wait(lock, [&] { return this->stop || this->epoch != seen; });
+      if (this->stop) return;
+      seen = this->epoch;
+      current = this->job;
+    }
+    run_timed(*current, index);
+    {
+      std::lock_guard<std::mutex> lock(this->mutex);
+      if (--this->pending == 0) this->done.notify_one();
+    }
+  }
+}
+
+void WorkerPool::run_timed(const std::function<void(int)>& job, int index) {
+  auto begin = std::chrono::steady_clock::now();
+  StepCounters* counters = index > 0 ? this->counters : nullptr;
+  if (counters != nullptr) counters->start(index);
+  job(index);
+  if (counters != nullptr) counters->stop(index);
+  // Only worker index writes its entry, read after run returns (ordered by the mutex).
+  this->busy_seconds[index] += std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+}
+
+void WorkerPool::reset_timing() {
+  std::fill(this->busy_seconds.begin(), this->busy_seconds.end(), 0);
+  this->wall_seconds = 0;
+}
+
+void WorkerPool::run(const std::function<void(int)>& job) {
+  auto begin = std::chrono::steady_clock::now();
+  // The caller runs band 0 on the cpu of worker 0, only for the duration of the job.
+  CallerPin pin(this->worker_cpus[0]);
+  if (this->threads.empty()) {
+    run_timed(job, 0);
+    this->wall_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->job = &job;
+    this->pending = (int)this->threads.size();
+    this->epoch++;
+  }
+  this->start.notify_all();
+  // The calling thread takes index 0 instead of waiting idle.
+  run_timed(job, 0);
+  std::unique_lock<std::mutex> lock(this->mutex);
+  this->done.wait(lock, [&] { return this->pending == 0; });
+  this->wall_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+}
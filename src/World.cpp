@@ -1,4 +1,7 @@
 #include "World.h"
+#include "FixedEngine.h"
+#include "Random.h"
+#include "Topology.h"
 
 #include <iostream>
 #include <ostream>
@@ -9,6 +12,11 @@
 #include <string>
 #include <vector>
 #include <chrono>
+#include <cstring>
+#include <climits>
+#include <algorithm>
+#include <functional>
+#include <map>
 
 /*
 * To compile your source code, please use the following command to link the OpenCL library: 
@@ -23,8 +31,9 @@ World::World(int height, int width) {
   this->generation = 0;
   this->grid = new bool[this->N];
   std::fill_n(this->grid, this->N, 0);
+  this->nextGrid = new bool[this->N];
   this->cl = NULL;
-  this->patterns = {'b', 'g', 'm', 't'};
+  this->patterns = PatternLibrary::shared().names();
   std::cout << "WORLD CREATED." << std::endl;
 }
 
@@ -40,7 +49,9 @@ World::World(std::string &file_name) {
     std::ifstream file(file_name);
     if (file.is_open()) {
       std::string line;
+      int line_number = 0;
       while (std::getline(file, line)) {
+        line_number++;
         std::istringstream iss(line);
         std::string key;
         char equalsign;
@@ -50,6 +61,14 @@ World::World(std::string &file_name) {
             iss >> this->height;
           } else if (key == "width") {
             iss >> this->width;
+          } else if (key == "rule") {
+            std::string rulestring;
+            iss >> rulestring;
+            try {
+              this->rule = Rule::parse(rulestring);
+            } catch (const std::invalid_argument& e) {
+              throw std::runtime_error("File \"" + file_name + "\" line " + std::to_string(line_number) + ": " + e.what());
+            }
           } else if (key == "start") {
             // Parse start positions
             char nan;
@@ -73,8 +92,9 @@ World::World(std::string &file_name) {
   this->generation = 0;
   this->grid = new bool[this->N];
   std::fill_n(this->grid, this->N, 0);
+  this->nextGrid = new bool[this->N];
   this->cl = NULL;
-  this->patterns = {'b', 'g', 'm', 't'};
+  this->patterns = PatternLibrary::shared().names();
 
   // Set cell states.
   for (size_t i = 0; i < startPositions.size(); i++) {
@@ -86,17 +106,333 @@ World::World(std::string &file_name) {
 }
 
 World::~World() {
+  release_mapping(false);
+  delete this->history;
+  delete this->log;
+  delete this->exporter;
+  delete this->tracker;
+  delete this->counters;
+  delete this->selector;
+  delete this->split;
   delete this->cl;
-  delete[] this->grid; 
+  delete this->pool;
+  if (!this->grid_mapped) delete[] this->grid; 
+  delete[] this->nextGrid;
 }
 
 void World::init_OpenCL() {
+  release_mapping();
   delete this->cl;
+  this->cl = NULL;
   this->cl = new OpenCLWrapper(*this);
+  map_grid();
+}
+
+void World::map_grid() {
+  if (this->cl == NULL || !this->cl->zero_copy || this->grid_mapped) return;
+  // From now on the grid lives in the host-visible buffer.
+  bool* mapped = this->cl->mapGrid(this->cl->buffer_grid, sizeof(bool) * this->N);
+  std::memcpy(mapped, this->grid, sizeof(bool) * this->N);
+  delete[] this->grid;
+  this->grid = mapped;
+  this->grid_mapped = true;
+}
+
+void World::release_mapping(bool keep_cells) {
+  if (!this->grid_mapped) return;
+  bool* cells = NULL;
+  if (keep_cells) {
+    cells = new bool[this->N];
+    std::memcpy(cells, this->grid, sizeof(bool) * this->N);
+  }
+  this->cl->unmapGrid(this->cl->mapped_buffer, this->grid);
+  clFinish(this->cl->queue);
+  // The zero-copy steps ping-pong the kernel arguments, the copy path expects buffer_grid -> buffer_newGrid.
+  this->cl->bind_grid_buffers();
+  this->grid = cells;
+  this->grid_mapped = false;
+}
+
+void World::set_device(const DeviceSelection& selection) {
+  this->device_selection = selection;
+  if (this->cl != NULL) init_OpenCL();
+}
+
+void World::set_split_devices(const std::vector<DeviceSelection>& selections) {
+  this->split_devices = selections;
+  sync_grid();
+  delete this->split;
+  this->split = NULL;
+}
+
+void World::sync_grid() {
+  if (this->split != NULL) this->split->download();
+}
+
+void World::grid_changed() {
+  if (this->split != NULL) this->split->invalidate();
+  this->tiles_valid = false;
+  this->packed_generation = -1;
+}
+
+void World::set_history(int keyframe_interval, size_t max_bytes) {
+  delete this->history;
+  this->history = NULL;
+  if (keyframe_interval <= 0) return;
+  sync_grid();
+  this->history = new History(this->N, keyframe_interval, max_bytes);
+  this->history->record(this->generation, this->grid);
+}
+
+History* World::getHistory() {
+  return this->history;
+}
+
+void World::set_log(const std::string& file_name, int keyframe_interval) {
+  delete this->log;
+  this->log = NULL;
+  if (file_name.empty()) return;
+  sync_grid();
+  this->log = new DeltaLogWriter(file_name, this->height, this->width, keyframe_interval);
+  this->log->record(this->generation, this->grid);
+}
+
+DeltaLogWriter* World::getLog() {
+  return this->log;
+}
+
+void World::set_export(const std::string& prefix, const ExportOptions& options) {
+  delete this->exporter;
+  this->exporter = NULL;
+  if (prefix.empty()) return;
+  sync_grid();
+  this->exporter = new FrameExporter(prefix, this->height, this->width, options);
+  this->exporter->submit(this->generation, this->grid);
+}
+
+FrameExporter* World::getExporter() {
+  return this->exporter;
+}
+
+void World::set_counters(bool enabled) {
+  delete this->counters;
+  this->counters = enabled ? new StepCounters(this->N) : NULL;
+}
+
+StepCounters* World::getCounters() {
+  return this->counters;
+}
+
+void World::set_adaptive(bool enabled, const AdaptiveOptions& options) {
+  delete this->selector;
+  this->selector = enabled ? new EngineSelector(*this, options) : NULL;
+}
+
+EngineSelector* World::getSelector() {
+  return this->selector;
+}
+
+void World::start_counters() {
+  if (this->counters == NULL) return;
+  this->counters->begin_step(this->pool != NULL ? this->pool->size() : 1);
+  this->counters->start(0);
+  if (this->pool != NULL) this->pool->set_counters(this->counters);
+}
+
+void World::stop_counters(long generations) {
+  if (this->counters == NULL) return;
+  if (this->pool != NULL) this->pool->set_counters(NULL);
+  this->counters->stop(0);
+  this->counters->end_step(this->generation, generations);
+}
+
+void World::set_tracking(int max_period) {
+  delete this->tracker;
+  this->tracker = NULL;
+  if (max_period <= 0) return;
+  set_fingerprints(true);
+  sync_grid();
+  this->tracker = new ObjectTracker(max_period);
+  this->tracker->analyse(*this);
+}
+
+ObjectTracker* World::getTracker() {
+  return this->tracker;
+}
+
+bool World::seek(long generation) {
+  if (this->history == NULL || !this->history->restore(generation, this->grid)) return false;
+  this->generation = generation;
+  // Evolving from here records the following generations again.
+  this->history->truncate(generation);
+  grid_changed();
+  return true;
+}
+
+void World::set_zero_copy(ZeroCopy mode) {
+  this->zero_copy = mode;
+  if (this->cl != NULL) init_OpenCL();
+}
+
+void World::set_engine(Engine engine) {
+  // The other engines start from the host grid.
+  if (engine != Engine::Split) sync_grid();
+  // Set up OpenCL on first use, a missing device throws before anything changes.
+  if (engine == Engine::OpenCL && this->cl == NULL) init_OpenCL();
+  // The CPU engines swap grid and nextGrid, so they need a grid owned by the world.
+  if (engine != Engine::OpenCL) release_mapping();
+  // The OpenCL engine allocates a new grid per generation on the calling thread, place it again.
+  bool place = this->engine == Engine::OpenCL && engine != Engine::OpenCL && engine != Engine::Split;
+  this->engine = engine;
+  if (place && this->pool != NULL) first_touch();
+  // Back on OpenCL after a CPU engine: map the grid again instead of silently copying every step.
+  if (engine == Engine::OpenCL) map_grid();
+}
+
+void World::set_block_steps(int steps) {
+  this->block_steps = std::max(1, steps);
+  // The halo of evolve_multi is compiled into the kernel.
+  if (this->cl != NULL) init_OpenCL();
+}
+
+void World::set_threads(int threads) {
+  sync_grid();
+  delete this->pool;
+  this->pool = threads > 1 ? new WorkerPool(threads, this->pin_threads) : NULL;
+  if (this->pool != NULL) first_touch();
+  reset_bandwidth();
+}
+
+void World::set_pinning(bool enabled) {
+  this->pin_threads = enabled;
+  if (this->pool != NULL) set_threads(this->pool->size());
+}
+
+void World::set_fixed_sizes(bool enabled) {
+  this->fixed_sizes = enabled;
+}
+
+void World::band_range(int band, int bands, int& y_begin, int& y_end) {
+  int rows_per_band = ((tiles_y() + bands - 1) / bands) * STATS_TILE;
+  y_begin = std::min(this->height, band * rows_per_band);
+  y_end = std::min(this->height, y_begin + rows_per_band);
+}
+
+void World::first_touch() {
+  // Large new[] blocks are fresh pages from the kernel, placed on the node that writes them first.
+  bool* cells = this->grid_mapped ? this->grid : new bool[this->N];
+  bool* next = new bool[this->N];
+  std::function<void(int)> job = [&](int band) {
+    int y_begin, y_end;
+    band_range(band, this->pool->size(), y_begin, y_end);
+    size_t begin = (size_t)y_begin * this->width, count = (size_t)(y_end - y_begin) * this->width;
+    if (cells != this->grid) std::memcpy(cells + begin, this->grid + begin, count);
+    std::fill_n(next + begin, count, 0);
+  };
+  this->pool->run(job);
+  if (cells != this->grid) {
+    delete[] this->grid;
+    this->grid = cells;
+  }
+  delete[] this->nextGrid;
+  this->nextGrid = next;
+  // Worker scratch buffers are allocated again by their workers.
+  this->block_scratch.clear();
+  grid_changed();
+}
+
+std::vector<NodeBandwidth> World::bandwidth_report() {
+  std::vector<NodeBandwidth> report;
+  if (this->pool == NULL) return report;
+  size_t page = Topology::page_size();
+  for (int band = 0; band < this->pool->size(); band++) {
+    int node = this->pool->node(band);
+    auto it = std::find_if(report.begin(), report.end(), [node](const NodeBandwidth& entry) { return entry.node == node; });
+    if (it == report.end()) {
+      NodeBandwidth entry;
+      entry.node = node;
+      entry.seconds = this->pool->wall();
+      it = report.insert(report.end(), entry);
+    }
+    int y_begin, y_end;
+    band_range(band, this->pool->size(), y_begin, y_end);
+    size_t begin = (size_t)y_begin * this->width, count = (size_t)(y_end - y_begin) * this->width;
+    it->workers++;
+    it->rows += y_end - y_begin;
+    it->bytes += 2.0 * count * this->band_passes;
+    it->busy += this->pool->busy(band);
+    // local_pages holds the count of local pages until the end.
+    for (const bool* cells : {(const bool*)this->grid, (const bool*)this->nextGrid}) {
+      for (int page_node : Topology::page_nodes(cells + begin, count, page)) {
+        it->local_pages += page_node >= 0 && page_node == node;
+      }
+    }
+  }
+  for (NodeBandwidth& entry : report) {
+    size_t pages = 0;
+    for (int band = 0; band < this->pool->size(); band++) {
+      if (this->pool->node(band) != entry.node) continue;
+      int y_begin, y_end;
+      band_range(band, this->pool->size(), y_begin, y_end);
+      pages += 2 * (((size_t)(y_end - y_begin) * this->width + page - 1) / page);
+    }
+    entry.local_pages = pages > 0 ? entry.local_pages / pages : 0;
+    entry.busy = entry.seconds > 0 ? entry.busy / entry.workers / entry.seconds : 0;
+  }
+  return report;
+}
+
+void World::reset_bandwidth() {
+  this->band_passes = 0;
+  if (this->pool != NULL) this->pool->reset_timing();
+}
+
+void World::set_statistics(bool enabled) {
+  this->collect_statistics = enabled;
+}
+
+void World::save_statistics(std::string file_name) {
+  write_statistics("configurations/" + file_name + ".csv", this->statistics, tiles_x(), tiles_y());
+}
+
+const std::vector<GenerationStats>& World::getStatistics() {
+  return this->statistics;
+}
+
+void World::set_rule(const Rule& rule) {
+  this->rule = rule;
+  // The rule is baked into the kernel, so the program has to be rebuilt.
+  if (this->cl != NULL) init_OpenCL();
+  sync_grid();
+  delete this->split;
+  this->split = NULL;
+}
+
+Rule World::getRule() {
+  return this->rule;
+}
+
+void World::fill_random(double density, uint64_t seed) {
+  CounterRNG rng(seed);
+  // Compare 32 random bits per cell with the density threshold.
+  uint64_t threshold = (uint64_t)(density * 4294967296.0);
+  for (ulong i = 0; i < this->N; i += 2) {
+    uint64_t r = rng.at(0, i / 2);
+    this->grid[i] = (r & 0xFFFFFFFF) < threshold;
+    if (i + 1 < this->N) this->grid[i + 1] = (r >> 32) < threshold;
+  }
+  grid_changed();
+}
+
+void World::clear() {
+  std::fill_n(this->grid, this->N, 0);
+  this->generation = 0;
+  grid_changed();
 }
 
 
 void World::save_gamestate(std::string file_name) {
+  sync_grid();
   file_name = "configurations/" + file_name + ".txt";
   // Check if file already exists.
   if (std::filesystem::exists(file_name)) {
@@ -107,6 +443,7 @@ void World::save_gamestate(std::string file_name) {
   if (file.is_open()) {
       std::string text = "height = " + std::to_string(this->height);
       text += "\nwidth = " + std::to_string(this->width);
+      text += "\nrule = " + this->rule.to_string();
       text += "\nstart =";
       for (int x = 0; x < this->width; x++) {
         for (int y = 0; y < this->height; y++) {
@@ -122,8 +459,91 @@ void World::save_gamestate(std::string file_name) {
   } 
 }
 
-// OpenCL VERSION
+// 8 cells per multiply.
+uint64_t grid_hash(const bool* grid, ulong N) {
+  uint64_t h = 0xCBF29CE484222325ULL;
+  ulong i = 0;
+  for (; i + 8 <= N; i += 8) {
+    uint64_t word;
+    std::memcpy(&word, grid + i, sizeof(word));
+    h = (h ^ word) * 0x100000001B3ULL;
+    h ^= h >> 29;
+  }
+  for (; i < N; i++) {
+    h = (h ^ grid[i]) * 0x100000001B3ULL;
+  }
+  return h;
+}
+
+std::string engine_name(Engine engine) {
+  switch (engine) {
+  case Engine::Scalar:
+    return "scalar";
+  case Engine::Lookup:
+    return "lookup";
+  case Engine::Split:
+    return "split";
+  case Engine::Blocked:
+    return "blocked";
+  case Engine::OpenCL:
+  default:
+    return "opencl";
+  }
+}
+
+Engine parse_engine(const std::string& name) {
+  for (Engine engine : {Engine::OpenCL, Engine::Scalar, Engine::Lookup, Engine::Split, Engine::Blocked}) {
+    if (engine_name(engine) == name) return engine;
+  }
+  throw std::invalid_argument("Unknown engine: " + name);
+}
+
 bool* World::evolve() {
+  bool* result;
+  std::chrono::steady_clock::time_point begin;
+  if (this->selector != NULL) begin = std::chrono::steady_clock::now();
+  start_counters();
+  switch (this->engine) {
+  case Engine::Scalar:
+    result = evolve_scalar();
+    break;
+  case Engine::Lookup:
+    result = evolve_lookup();
+    break;
+  case Engine::Split:
+    result = evolve_split();
+    break;
+  case Engine::Blocked:
+    result = evolve_blocked(1);
+    break;
+  case Engine::OpenCL:
+  default:
+    result = evolve_opencl();
+  }
+  stop_counters(1);
+  record_generation();
+  if (this->selector != NULL) {
+    // May move the world to another engine for the next step.
+    this->selector->record(*this, 1, std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count());
+  }
+  return result;
+}
+
+void World::record_generation() {
+  if (this->history != NULL || this->log != NULL || this->exporter != NULL || this->tracker != NULL) sync_grid();
+  // Only copy the grid, the coding runs on the history, log and export threads.
+  if (this->history != NULL) this->history->record(this->generation, this->grid);
+  if (this->log != NULL) this->log->record(this->generation, this->grid);
+  if (this->exporter != NULL) this->exporter->submit(this->generation, this->grid);
+  if (this->tracker != NULL) this->tracker->analyse(*this);
+}
+
+// OpenCL VERSION
+bool* World::evolve_opencl() {
+  // Only the default engine gets here without set_engine or init_OpenCL.
+  if (this->cl == NULL) throw std::runtime_error("OpenCL is not initialized");
+  if (this->grid_mapped) return evolve_zero_copy();
+
   // Go through all cells in the current grid and determine whether they:
   // 1. Die, as if by underpopulation or overpopulation
   // 2. Continue living on to the next generation
@@ -137,13 +557,25 @@ bool* World::evolve() {
   double write_duration, kernel_duration, read_duration;
 
   // Write current grid to buffer only if it has changed
-  cl->err = clEnqueueWriteBuffer(cl->queue, cl->buffer_grid, CL_TRUE, 0, sizeof(bool) * this->N, grid, 0, NULL, &write_event);
+  // Non-blocking: the in-order queue runs the kernel after the write, and the blocking read below
+  // returns only after both, so grid stays valid long enough.
+  cl->err = clEnqueueWriteBuffer(cl->queue, cl->buffer_grid, CL_FALSE, 0, sizeof(bool) * this->N, grid, 0, NULL, &write_event);
   cl->checkError(cl->err, "clEnqueueWriteBuffer");
 
 
-  // Run the kernel (evolve) function using the GPU.
-  cl->err = clEnqueueNDRangeKernel(cl->queue, cl->kernel_evolve, 2, NULL, cl->evolve_global_work_size, NULL, 0, NULL, &kernel_event);
-  cl->checkError(cl->err, "clEnqueueNDRangeKernel");
+  if (this->collect_statistics) {
+    // Reset the statistic counters: population, births, deaths, min x, min y, max x, max y.
+    static const cl_int initial_counters[7] = {0, 0, 0, INT_MAX, INT_MAX, -1, -1};
+    cl->err = clEnqueueWriteBuffer(cl->queue, cl->buffer_counters, CL_FALSE, 0, sizeof(initial_counters), initial_counters, 0, NULL, NULL);
+    cl->checkError(cl->err, "clEnqueueWriteBuffer (buffer_counters)");
+    // Run the kernel (evolve_stats) function using the GPU, one work group per tile.
+    cl->err = clEnqueueNDRangeKernel(cl->queue, cl->kernel_evolve_stats, 2, NULL, cl->stats_global_work_size, cl->stats_local_work_size, 0, NULL, &kernel_event);
+    cl->checkError(cl->err, "clEnqueueNDRangeKernel (evolve_stats)");
+  } else {
+    // Run the kernel (evolve) function using the GPU.
+    cl->err = clEnqueueNDRangeKernel(cl->queue, cl->kernel_evolve, 2, NULL, cl->evolve_global_work_size, NULL, 0, NULL, &kernel_event);
+    cl->checkError(cl->err, "clEnqueueNDRangeKernel");
+  }
   // Read the resulting new grid from the buffer into host memory (newGrid).
   cl->err = clEnqueueReadBuffer(cl->queue, cl->buffer_newGrid, CL_TRUE, 0, sizeof(bool) * this->N, newGrid, 0, NULL, &read_event);
   cl->checkError(cl->err, "clEnqueueReadBuffer");
@@ -153,6 +585,8 @@ bool* World::evolve() {
   this->grid = newGrid;
   this->generation++;
 
+  if (this->collect_statistics) this->statistics.push_back(read_opencl_statistics());
+
   // Profiling information (SEE OpenCLWrapper.cpp:25 BEFORE UNCOMMENTING)
   /*
   clGetEventProfilingInfo(write_event, CL_PROFILING_COMMAND_START, sizeof(time_start), &time_start, NULL);
@@ -173,86 +607,288 @@ bool* World::evolve() {
   std::cout << "Read Buffer Duration: " << read_duration << " ms\n";
   */
 
+  clReleaseEvent(write_event);
+  clReleaseEvent(kernel_event);
+  clReleaseEvent(read_event);
+
   return this->grid;
 }
 
 
+bool* World::evolve_zero_copy() {
+  cl_mem source = cl->mapped_buffer;
+  cl_mem target = source == cl->buffer_grid ? cl->buffer_newGrid : cl->buffer_grid;
+  cl_kernel kernel = this->collect_statistics ? cl->kernel_evolve_stats : cl->kernel_evolve;
+
+  // Hand the grid to the device, the kernel reads it where the host wrote it.
+  cl->unmapGrid(source, this->grid);
+  cl->err = clSetKernelArg(kernel, 0, sizeof(cl_mem), &source);
+  cl->checkError(cl->err, "clSetKernelArg (source)");
+  cl->err = clSetKernelArg(kernel, 1, sizeof(cl_mem), &target);
+  cl->checkError(cl->err, "clSetKernelArg (target)");
+
+  if (this->collect_statistics) {
+    static const cl_int initial_counters[7] = {0, 0, 0, INT_MAX, INT_MAX, -1, -1};
+    cl->err = clEnqueueWriteBuffer(cl->queue, cl->buffer_counters, CL_FALSE, 0, sizeof(initial_counters), initial_counters, 0, NULL, NULL);
+    cl->checkError(cl->err, "clEnqueueWriteBuffer (buffer_counters)");
+    cl->err = clEnqueueNDRangeKernel(cl->queue, kernel, 2, NULL, cl->stats_global_work_size, cl->stats_local_work_size, 0, NULL, NULL);
+  } else {
+    cl->err = clEnqueueNDRangeKernel(cl->queue, kernel, 2, NULL, cl->evolve_global_work_size, NULL, 0, NULL, NULL);
+  }
+  cl->checkError(cl->err, "clEnqueueNDRangeKernel");
+
+  // Map the new generation. On unified memory this only synchronizes, nothing is copied.
+  this->grid = cl->mapGrid(target, sizeof(bool) * this->N);
+  this->generation++;
+
+  if (this->collect_statistics) this->statistics.push_back(read_opencl_statistics());
+
+  return this->grid;
+}
+
+void World::evolve_generations(long generations) {
+  bool multi = this->engine == Engine::OpenCL && this->block_steps > 1 && !this->collect_statistics;
+  bool observed = this->history != NULL || this->log != NULL || this->exporter != NULL || this->tracker != NULL;
+  if (multi && !observed && this->selector == NULL) {
+    // Everything stays on the device until the last generation.
+    start_counters();
+    evolve_opencl_multi(generations);
+    stop_counters(generations);
+    return;
+  }
+  while (generations > 0) {
+    // The adaptive selection can change the engine between steps.
+    multi = this->engine == Engine::OpenCL && this->block_steps > 1 && !this->collect_statistics;
+    bool blocked = this->engine == Engine::Blocked || multi;
+    int steps = blocked ? (int)std::min<long>(this->block_steps, generations) : 1;
+    if (steps == 1) {
+      evolve();
+    } else {
+      std::chrono::steady_clock::time_point begin;
+      if (this->selector != NULL) begin = std::chrono::steady_clock::now();
+      start_counters();
+      if (multi) evolve_opencl_multi(steps); else evolve_blocked(steps);
+      stop_counters(steps);
+      record_generation();
+      if (this->selector != NULL) {
+        this->selector->record(*this, steps, std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count());
+      }
+    }
+    generations -= steps;
+  }
+}
+
+bool* World::evolve_split() {
+  // The statistics are computed by the scalar loop.
+  if (this->collect_statistics) {
+    sync_grid();
+    return evolve_scalar();
+  }
+
+  if (this->split == NULL) {
+    std::vector<DeviceSelection> selections = this->split_devices;
+    if (selections.empty()) selections.push_back(this->device_selection);
+    this->split = new DeviceSplit(*this, selections);
+  }
+  this->split->evolve();
+  return this->grid;
+}
+
+bool* World::evolve_opencl_multi(long generations) {
+  if (this->cl == NULL) throw std::runtime_error("OpenCL is not initialized");
+  size_t bytes = sizeof(bool) * this->N;
+  cl_mem source = cl->buffer_grid;
+  if (this->grid_mapped) {
+    source = cl->mapped_buffer;
+    cl->unmapGrid(source, this->grid);
+  } else {
+    cl->err = clEnqueueWriteBuffer(cl->queue, source, CL_FALSE, 0, bytes, this->grid, 0, NULL, NULL);
+    cl->checkError(cl->err, "clEnqueueWriteBuffer (buffer_grid)");
+  }
+  cl_mem target = source == cl->buffer_grid ? cl->buffer_newGrid : cl->buffer_grid;
+
+  // The in-order queue orders the launches, no events or host waits in between.
+  while (generations > 0) {
+    int steps = (int)std::min<long>(cl->multi_steps, generations);
+    cl->err = clSetKernelArg(cl->kernel_multi, 0, sizeof(cl_mem), &source);
+    cl->checkError(cl->err, "clSetKernelArg (source)");
+    cl->err = clSetKernelArg(cl->kernel_multi, 1, sizeof(cl_mem), &target);
+    cl->checkError(cl->err, "clSetKernelArg (target)");
+    cl->err = clSetKernelArg(cl->kernel_multi, 4, sizeof(int), &steps);
+    cl->checkError(cl->err, "clSetKernelArg (steps)");
+    cl->err = clEnqueueNDRangeKernel(cl->queue, cl->kernel_multi, 2, NULL, cl->stats_global_work_size,
+                                     cl->stats_local_work_size, 0, NULL, NULL);
+    cl->checkError(cl->err, "clEnqueueNDRangeKernel (evolve_multi)");
+    std::swap(source, target);
+    generations -= steps;
+    this->generation += steps;
+  }
+
+  if (this->grid_mapped) {
+    this->grid = cl->mapGrid(source, bytes);
+  } else {
+    cl->err = clEnqueueReadBuffer(cl->queue, source, CL_TRUE, 0, bytes, this->grid, 0, NULL, NULL);
+    cl->checkError(cl->err, "clEnqueueReadBuffer (evolve_multi)");
+  }
+  return this->grid;
+}
+
+GenerationStats World::read_opencl_statistics() {
+  // Only the counters and one value per tile are transferred, never the grid.
+  cl_int counters[7];
+  GenerationStats stats;
+  stats.generation = this->generation;
+  stats.tiles.resize(cl->tile_count);
+  cl->err = clEnqueueReadBuffer(cl->queue, cl->buffer_counters, CL_FALSE, 0, sizeof(counters), counters, 0, NULL, NULL);
+  cl->checkError(cl->err, "clEnqueueReadBuffer (buffer_counters)");
+  cl->err = clEnqueueReadBuffer(cl->queue, cl->buffer_tiles, CL_TRUE, 0, sizeof(cl_ushort) * cl->tile_count, stats.tiles.data(), 0, NULL, NULL);
+  cl->checkError(cl->err, "clEnqueueReadBuffer (buffer_tiles)");
+  stats.population = counters[0];
+  stats.births = counters[1];
+  stats.deaths = counters[2];
+  if (stats.population > 0) {
+    stats.min_x = counters[3];
+    stats.min_y = counters[4];
+    stats.max_x = counters[5];
+    stats.max_y = counters[6];
+  }
+  return stats;
+}
+
 // SCALAR VERSION
-/*
-bool* World::evolve() {
-  // Declare new grid
-  bool* newGrid = new bool[this->N];
+bool* World::evolve_scalar() {
+  // Sizes compiled in FixedEngine: constant wrap and strides. Single threaded, as these grids are small.
+  FixedStep fixed = this->fixed_sizes && this->pool == NULL && !this->collect_statistics ? find_fixed_step(this->height, this->width, this->rule) : NULL;
+  if (fixed != NULL) {
+    bool tracking = track_step();
+    fixed(this->grid, this->nextGrid, this->rule);
+    if (tracking) for (int y = 0; y < this->height; y++) mark_changed_tiles(y, 0, this->width);
+    std::swap(this->grid, this->nextGrid);
+    this->generation++;
+    this->band_passes++;
+    if (tracking) this->tracked_generation = this->generation;
+    return this->grid;
+  }
+
+  if (this->rule.is_conway()) {
+    // B3/S23 is compiled with constant neighbor counts.
+    return evolve_scalar_rule([](bool alive, int determinationValue) {
+      return determinationValue == 3 || (determinationValue == 2 && alive);
+    });
+  }
+  // Other rules look up the new state in a table indexed by state and neighbor count.
+  bool table[18];
+  for (int n = 0; n <= 8; n++) {
+    table[n] = this->rule.next(false, n);
+    table[9 + n] = this->rule.next(true, n);
+  }
+  return evolve_scalar_rule([&table](bool alive, int determinationValue) {
+    return table[alive * 9 + determinationValue];
+  });
+}
+
+template <class NextState>
+bool* World::evolve_scalar_rule(NextState next) {
+  // Bands consist of whole tile rows, so every band owns the tiles it counts.
+  int bands = this->pool != NULL ? this->pool->size() : 1;
+  bool tracking = track_step();
+
+  if (this->collect_statistics) {
+    // Every band (thread) fills its own partial, merged after the step.
+    std::vector<GenerationStats> partials(bands);
+    GenerationStats stats;
+    stats.generation = this->generation + 1;
+    stats.tiles.assign(tiles_x() * tiles_y(), 0);
+    std::function<void(int)> job = [&](int band) {
+      int y_begin, y_end;
+      band_range(band, bands, y_begin, y_end);
+      evolve_rows<true>(next, y_begin, y_end, &partials[band], stats.tiles.data());
+      if (tracking) for (int y = y_begin; y < y_end; y++) mark_changed_tiles(y, 0, this->width);
+    };
+    if (this->pool != NULL) this->pool->run(job); else job(0);
+    for (const GenerationStats& partial : partials) stats.merge(partial);
+    this->statistics.push_back(std::move(stats));
+  } else {
+    std::function<void(int)> job = [&](int band) {
+      int y_begin, y_end;
+      band_range(band, bands, y_begin, y_end);
+      evolve_rows<false>(next, y_begin, y_end, NULL, NULL);
+      if (tracking) for (int y = y_begin; y < y_end; y++) mark_changed_tiles(y, 0, this->width);
+    };
+    if (this->pool != NULL) this->pool->run(job); else job(0);
+  }
+
+  // Swap old and new grid and increment generation counter.
+  std::swap(this->grid, this->nextGrid);
+  this->generation++;
+  this->band_passes++;
+  if (tracking) this->tracked_generation = this->generation;
+
+  return this->grid;
+}
 
+template <bool Stats, class NextState>
+void World::evolve_rows(NextState next, int y_begin, int y_end, GenerationStats* partial, uint16_t* tiles) {
   // Go through all cells in the current grid and determine whether they:
   // 1. Die, as if by underpopulation or overpopulation
   // 2. Continue living on to the next generation
   // 3. Come to life, as if by reproduction
-  for (int y = 0; y < this->height; y++) {
+  for (int y = y_begin; y < y_end; y++) {
+    // Wrapped row offsets, computed once per row instead of once per neighbor.
+    const bool* above = this->grid + ((y - 1 + this->height) % this->height) * this->width;
+    const bool* row = this->grid + y * this->width;
+    const bool* below = this->grid + ((y + 1) % this->height) * this->width;
+    bool* newRow = this->nextGrid + y * this->width;
+    uint16_t* tileRow = Stats ? tiles + (y / STATS_TILE) * tiles_x() : NULL;
+    int first = -1, last = -1;
     for (int x = 0; x < this->width; x++) {
+      int xl = (x - 1 + this->width) % this->width;
+      int xr = (x + 1) % this->width;
       // Variable for counting all living neighbors
-      int determinationValue = 0;
-      // Go through all adjacent cells and add them up
-      for (int dy = -1; dy <= 1; dy++) {
-        for (int dx = -1; dx <=1; dx++) {
-          if (dx == 0 && dy ==0) continue;
-
-          int sx = (x+ dx+ this->width) % this->width;
-          int sy = (y+ dy+ this->height) % this->height;
-
-          determinationValue += this->grid[sy * this->width + sx];
+      int determinationValue = above[xl] + above[x] + above[xr]
+                             + row[xl] + row[xr]
+                             + below[xl] + below[x] + below[xr];
+      bool state = next(row[x], determinationValue);
+      newRow[x] = state;
+      if (Stats) {
+        partial->births += state & !row[x];
+        partial->deaths += row[x] & !state;
+        if (state) {
+          tileRow[x / STATS_TILE]++;
+          if (first < 0) first = x;
+          last = x;
         }
       }
-      if (determinationValue == 2) {
-        newGrid[y * this->width + x] = this->grid[y * this->width + x];
-      } else if (determinationValue == 3) {
-        newGrid[y * this->width + x] = 1;
-      } else {
-        newGrid[y * this->width + x] = 0;
-      }
+    }
+    if (Stats && first >= 0) {
+      partial->min_x = std::min(partial->min_x, first);
+      partial->max_x = std::max(partial->max_x, last);
+      partial->min_y = std::min(partial->min_y, y);
+      partial->max_y = std::max(partial->max_y, y);
+    }
+  }
+  if (Stats && y_begin < y_end) {
+    // Population from the tiles of the band instead of a counter per cell.
+    for (int t = (y_begin / STATS_TILE) * tiles_x(); t < ((y_end + STATS_TILE - 1) / STATS_TILE) * tiles_x(); t++) {
+      partial->population += tiles[t];
     }
   }
-
-  // Overwrite old with new grid and increment generation counter.
-  if (memory_safety) delete[] this->grid;
-  this->grid = newGrid;
-  this->generation++;
-
-  return this->grid;
 }
-*/
 
 
 void World::randomize() {
-  // seed random number generator with current time
-  srand(time(0));
+  // seed the counter-based generator once with the start time, every call draws the next counter
+  static const CounterRNG rng((uint64_t)time(0));
+  uint64_t r = rng.at((uint64_t)(uintptr_t)this, this->random_calls++);
 
   // random starting cell for pattern
-  int x = rand() % this->width;
-  int y = rand() % this->height;
+  int x = (r & 0xFFFFFFFF) % this->width;
+  int y = ((r >> 32) & 0xFFFF) % this->height;
 
-  // random pattern among the ones implemented
-  int patternIndex = rand() % this->patterns.size();
+  // random pattern among the ones of the library
+  int patternIndex = (r >> 48) % this->patterns.size();
 
-  char pattern = this->patterns[patternIndex];
-
-  switch (pattern)
-  {
-  case 'b':
-    add_beacon(y, x);
-    break;
-  case 'g':
-    add_glider(y, x);
-    break;
-  case 'm':
-    add_methuselah(y, x);
-    break;
-  case 't':
-    add_toad(y, x);
-    break;
-  
-  default:
-    break;
-  }
+  stamp(PatternLibrary::shared().get(this->patterns[patternIndex]), y, x, 0, false);
 }
 
 // OpenCL VERSION
@@ -263,16 +899,17 @@ bool World::are_worlds_identical(bool* grid_1, bool* grid_2) {
   cl_ulong time_start, time_end;
   double write_duration_1, write_duration_2, write_duration_result, kernel_duration, read_duration;
 
+  // The writes are non-blocking, the blocking read of the result at the end waits for all of them (in-order queue).
   // Write grid_1 to buffer grid1
-  cl->err = clEnqueueWriteBuffer(cl->queue, cl->buffer_grid1, CL_TRUE, 0, sizeof(bool) * this->N, grid_1, 0, NULL, &write_event_1);
+  cl->err = clEnqueueWriteBuffer(cl->queue, cl->buffer_grid1, CL_FALSE, 0, sizeof(bool) * this->N, grid_1, 0, NULL, &write_event_1);
   cl->checkError(cl->err, "clEnqueueWriteBuffer (buffer_grid1)");
 
   // Write grid_2 to buffer grid2
-  cl->err = clEnqueueWriteBuffer(cl->queue, cl->buffer_grid2, CL_TRUE, 0, sizeof(bool) * this->N, grid_2, 0, NULL, &write_event_2);
+  cl->err = clEnqueueWriteBuffer(cl->queue, cl->buffer_grid2, CL_FALSE, 0, sizeof(bool) * this->N, grid_2, 0, NULL, &write_event_2);
   cl->checkError(cl->err, "clEnqueueWriteBuffer (buffer_grid2)");
 
   // Write result to buffer result
-  cl->err = clEnqueueWriteBuffer(cl->queue, cl->buffer_result, CL_TRUE, 0, sizeof(int), &host_result, 0, NULL, &write_event_result);
+  cl->err = clEnqueueWriteBuffer(cl->queue, cl->buffer_result, CL_FALSE, 0, sizeof(int), &host_result, 0, NULL, &write_event_result);
   cl->checkError(cl->err, "clEnqueueWriteBuffer (buffer_result)");
 
   // Run the kernel (compare_arrays) function using the GPU
@@ -313,6 +950,12 @@ bool World::are_worlds_identical(bool* grid_1, bool* grid_2) {
   std::cout << "Read Buffer Duration: " << read_duration << " ms\n";
   */
 
+  clReleaseEvent(write_event_1);
+  clReleaseEvent(write_event_2);
+  clReleaseEvent(write_event_result);
+  clReleaseEvent(kernel_event);
+  clReleaseEvent(read_event);
+
   return (bool)host_result;
 }
 
@@ -338,6 +981,7 @@ bool World::are_worlds_identical(bool* grid_1, bool* grid_2) {
 
 
 int World::get_cell_state(int y, int x) {
+  sync_grid();
   // Return cell state, if coordinates are valid
   if (x >= 0 && x < width && y >= 0 && y < height) {
     return grid[y * width + x];
@@ -350,6 +994,7 @@ int World::get_cell_state(int y, int x) {
 }
 
 int World::get_cell_state(int p) {
+  sync_grid();
   // Determine 2d coordinates from point and return cell state, if point is valid
   if (this->N >= p) {
     return grid[p];
@@ -362,9 +1007,11 @@ int World::get_cell_state(int p) {
 }
 
 void World::set_cell_state(int state, int y, int x) {
+  sync_grid();
   // Set the cell state, if coordinates are valid
   if (x >= 0 && x < width && y >= 0 && y < height) {
     this->grid[y * width + x] = state;
+    grid_changed();
   }
   // Print error message, if coordinates are invalid
   else {
@@ -373,9 +1020,11 @@ void World::set_cell_state(int state, int y, int x) {
 }
 
 void World::set_cell_state(int state, int p) {
+  sync_grid();
   int cell_count = this->height * this->width;
   if (cell_count >= p) {
     this->grid[p] = state;
+    grid_changed();
   }
   // Print error message, if point is invalid
   else {
@@ -388,56 +1037,135 @@ void World::set_cell_state(int state, int p) {
 
 void World::add_beacon(int y, int x) {
   // Add beacon pattern, if coordinates are in bounds
-  if (x >= 0 && y >= 0 && x+3 < width && y+3 < height) {
-    this->grid[y * width + x] = 1;
-    this->grid[(y+1) * width + x] = 1;
-    this->grid[y * width + x+1] = 1;
-
-    this->grid[(y+3) * width + x+3] = 1;
-    this->grid[(y+3) * width + x+2] = 1;
-    this->grid[(y+2) * width + x+3] = 1;
-  }
+  stamp(PatternLibrary::shared().get("beacon"), y, x, 0, false);
 }
 
 void World::add_glider(int y, int x) {
   // Add glider pattern, if coordinates are in bounds
-  if (x >= 0 && y >= 0 && x+3 < width && y+3 < height) {
-    this->grid[y * width + x+1] = 1;
-    this->grid[(y+1) * width + x+2] = 1;
-
-    this->grid[(y+2) * width + x] = 1;
-    this->grid[(y+2) * width + x+1] = 1;
-    this->grid[(y+2) * width + x+2] = 1;
-  }
+  stamp(PatternLibrary::shared().get("glider"), y, x, 0, false);
 }
 
 void World::add_methuselah(int y, int x) {
   // Add methuselah pattern, if coordinates are in bounds
-  if (x >= 0 && y >= 0 && x+2 < width && y+2 < height) {
-    this->grid[y * width + x+1] = 1;
-    this->grid[y * width + x+2] = 1;
-    this->grid[(y+1) * width + x] = 1;
-    this->grid[(y+1) * width + x+1] = 1;
-    this->grid[(y+2) * width + x+1] = 1;
-  }
+  stamp(PatternLibrary::shared().get("methuselah"), y, x, 0, false);
 }
 
 void World::add_toad(int y, int x) {
   // Add toad pattern, if coordinates are in bounds
-  if (x >= 0 && y >= 0 && x+3 < width && y+3 < height) {
-    this->grid[y * width + x+2] = 1;
-    this->grid[(y+1) * width + x] = 1;
-    this->grid[(y+2) * width + x] = 1;
-    this->grid[(y+1) * width + x+3] = 1;
-    this->grid[(y+2) * width + x+3] = 1;
-    this->grid[(y+3) * width + x+1] = 1;
+  stamp(PatternLibrary::shared().get("toad"), y, x, 0, false);
+}
+
+void World::stamp_rows(const Pattern& pattern, int y, int x, bool wrap, int y_begin, int y_end) {
+  for (int py = 0; py < pattern.height; py++) {
+    int ty = y + py;
+    if (wrap) ty = ((ty % this->height) + this->height) % this->height;
+    if (ty < y_begin || ty >= y_end) continue;
+    bool* row = this->grid + (size_t)ty * this->width;
+    // Only the living cells of the packed row are visited.
+    for (int w = 0; w < pattern.words; w++) {
+      uint64_t bits = pattern.bits[py * pattern.words + w];
+      while (bits != 0) {
+        int tx = x + w * 64 + __builtin_ctzll(bits);
+        bits &= bits - 1;
+        if (wrap) tx = ((tx % this->width) + this->width) % this->width;
+        row[tx] = 1;
+      }
+    }
+  }
+}
+
+bool World::stamp(const Pattern& pattern, int y, int x, int transform, bool wrap) {
+  const Pattern& placed = transform == 0 ? pattern : pattern.transformed(transform);
+  if (!wrap && (x < 0 || y < 0 || x + placed.width > this->width || y + placed.height > this->height)) {
+    return false;
+  }
+  sync_grid();
+  stamp_rows(placed, y, x, wrap, 0, this->height);
+  grid_changed();
+  return true;
+}
+
+void World::stamp_all(const std::vector<Placement>& placements, bool wrap) {
+  sync_grid();
+  // Transform every (pattern, transform) once, before the parallel pass.
+  std::map<std::pair<const Pattern*, int>, Pattern> transformed;
+  std::vector<const Pattern*> placed(placements.size());
+  for (size_t i = 0; i < placements.size(); i++) {
+    const Placement& placement = placements[i];
+    if (placement.transform == 0) {
+      placed[i] = placement.pattern;
+      continue;
+    }
+    auto key = std::make_pair(placement.pattern, placement.transform);
+    auto it = transformed.find(key);
+    if (it == transformed.end()) {
+      it = transformed.emplace(key, placement.pattern->transformed(placement.transform)).first;
+    }
+    placed[i] = &it->second;
   }
+
+  int bands = this->pool != NULL ? this->pool->size() : 1;
+  int rows_per_band = (this->height + bands - 1) / bands;
+  // Placements per band, so a worker only visits the patterns that reach its rows.
+  std::vector<std::vector<size_t> > band_placements(bands);
+  for (size_t i = 0; i < placements.size(); i++) {
+    const Pattern& pattern = *placed[i];
+    int y = placements[i].y, x = placements[i].x;
+    if (!wrap && (x < 0 || y < 0 || x + pattern.width > this->width || y + pattern.height > this->height)) continue;
+    int first = ((y % this->height) + this->height) % this->height;
+    int last = first + std::min(pattern.height, this->height) - 1; // Past the bottom edge if the pattern wraps.
+    for (int row = first; row <= last;) {
+      int local = row % this->height;
+      std::vector<size_t>& list = band_placements[local / rows_per_band];
+      if (list.empty() || list.back() != i) list.push_back(i);
+      // First row of the next band (or of the top band after the bottom edge).
+      row += std::min((local / rows_per_band + 1) * rows_per_band, this->height) - local;
+    }
+  }
+
+  std::function<void(int)> job = [&](int band) {
+    int y_begin = std::min(this->height, band * rows_per_band);
+    int y_end = std::min(this->height, y_begin + rows_per_band);
+    for (size_t i : band_placements[band]) {
+      stamp_rows(*placed[i], placements[i].y, placements[i].x, wrap, y_begin, y_end);
+    }
+  };
+  if (this->pool != NULL) {
+    this->pool->run(job);
+  } else {
+    job(0);
+  }
+  grid_changed();
+}
+
+void World::fill_patterns(const std::vector<std::string>& names, long count, uint64_t seed) {
+  if (count < 0) throw std::invalid_argument("Negative number of patterns: " + std::to_string(count));
+  const PatternLibrary& library = PatternLibrary::shared();
+  std::vector<std::string> choices = names.empty() ? library.names() : names;
+  std::vector<const Pattern*> patterns;
+  for (const std::string& name : choices) patterns.push_back(&library.get(name));
+
+  CounterRNG rng(seed);
+  std::vector<Placement> placements(count);
+  for (long i = 0; i < count; i++) {
+    uint64_t r = rng.at(0, i);
+    placements[i].pattern = patterns[((r >> 48) & 0x1FFF) % patterns.size()];
+    placements[i].x = (r & 0xFFFFFF) % this->width;
+    placements[i].y = ((r >> 24) & 0xFFFFFF) % this->height;
+    placements[i].transform = (r >> 61) & 7;
+  }
+  stamp_all(placements, true);
 }
 
 void World::print() {
+  sync_grid();
+  print(this->grid);
+}
+
+void World::print(const bool* cells) {
   for (int i = 0; i < height; i++) {
     for (int j = 0; j < width; j++) {
-      if (grid[i * width + j]) {
+      if (cells[i * width + j]) {
         std::cout << "\033[32mx\033[0m" << " ";
       } else {
         std::cout << "\033[90mo\033[0m" << " ";
@@ -447,6 +1175,53 @@ void World::print() {
   }
 }
 
+GridView World::view() {
+  sync_grid();
+  return GridView{this->grid, this->height, this->width, this->generation};
+}
+
+PackedView World::packed_view() {
+  size_t words_per_row = (this->width + 63) / 64;
+  if (this->packed_generation != this->generation) {
+    sync_grid();
+    this->packed_words.assign(words_per_row * this->height, 0);
+    for (int y = 0; y < this->height; y++) {
+      const bool* row = this->grid + (size_t)y * this->width;
+      uint64_t* dest = this->packed_words.data() + y * words_per_row;
+      int x = 0;
+      // 8 cells (bytes of 0 or 1) per multiply: bit i of the result is byte i.
+      for (; x + 8 <= this->width; x += 8) {
+        uint64_t bytes;
+        std::memcpy(&bytes, row + x, sizeof(bytes));
+        dest[x / 64] |= ((bytes * 0x0102040810204080ULL) >> 56) << (x % 64);
+      }
+      for (; x < this->width; x++) {
+        dest[x / 64] |= (uint64_t)row[x] << (x % 64);
+      }
+    }
+    this->packed_generation = this->generation;
+  }
+  return PackedView{this->packed_words.data(), this->height, this->width, words_per_row, this->generation};
+}
+
+void World::set_cells(const bool* cells) {
+  std::memcpy(this->grid, cells, sizeof(bool) * this->N);
+  grid_changed();
+}
+
+void World::set_region(int y, int x, int rows, int columns, const uint8_t* cells, size_t stride) {
+  if (y < 0 || x < 0 || rows < 0 || columns < 0 || y + rows > this->height || x + columns > this->width) {
+    throw std::out_of_range("Region outside the world");
+  }
+  sync_grid();
+  for (int r = 0; r < rows; r++) {
+    bool* dest = this->grid + (size_t)(y + r) * this->width + x;
+    const uint8_t* src = cells + r * stride;
+    for (int c = 0; c < columns; c++) dest[c] = src[c] != 0;
+  }
+  grid_changed();
+}
+
 long World::getGeneration() {
   return this->generation;
 }
@@ -1,18 +1,41 @@
 #include "cli.h"
+#include "Census.h"
+#include "Conformance.h"
+#include "Daemon.h"
+#include "PlaneWorld.h"
+#include "Scheduler.h"
 #include <iostream>
 #include <thread>
 #include <sstream>
 #include <cstring>
+#include <chrono>
+#include <csignal>
 
 // Constructor for CommandLineInterface, handles command line Arguments
 CommandLineInterface::CommandLineInterface(int argc, char **argv) {
     this->print = false;
     this->delay_in_ms = 0;
-    if (argc >= 2 && argc <= 3) {
+    if (argc >= 2 && std::string(argv[1]).rfind("--", 0) == 0) {
+        try {
+            headless(argc, argv);
+        } catch (const std::logic_error& e) {
+            // Malformed options: std::stoi and the parsers throw invalid_argument or out_of_range.
+            std::cerr << "Invalid option: " << e.what() << std::endl;
+            std::cout << std::endl;
+            usage();
+            std::exit(1);
+        }
+    } else if (argc >= 2 && argc <= 3) {
         if (argc == 2) {
             std::cout << "Open File:" << argv[1] << std::endl;
             std::string filename = std::string(argv[1]);
-            this->world = new World(filename);
+            try {
+                this->world = new World(filename);
+            } catch (const std::runtime_error& e) {
+                // Missing file or invalid rule.
+                std::cerr << e.what() << std::endl;
+                std::exit(1);
+            }
         } else if (argc == 3) {
             int width = atoi(argv[1]);
             int height = atoi(argv[2]);
@@ -25,15 +48,406 @@ CommandLineInterface::CommandLineInterface(int argc, char **argv) {
     } else {
         std::cout << "Unknown Number of Parameters." << std::endl;
         std::cout << std::endl;
-        std::cout << "Kindly add the name of a safestate or the height and width "
-                "of the playing field"
-                << std::endl;
+        usage();
+    }
+}
+
+void CommandLineInterface::usage() {
+    std::cout << "Kindly add the name of a safestate or the height and width "
+            "of the playing field"
+            << std::endl;
+    std::cout << "or run a headless mode:" << std::endl;
+    std::cout << "  --census <soups> [--threads=n] [--soup=16] [--size=96] [--seed=s] "
+            "[--generations=20000] [--rule=B3/S23] [--out=census.txt]" << std::endl;
+    std::cout << "  --bench [--engines=scalar,lookup] [--size=1024] [--densities=0.1,0.3,0.5] "
+            "[--generations=100] [--threads=n] [--steps=1] [--pin=1] [--numa=0] [--counters=0] [--peak=GB/s] [--interval=256] (engine adaptive: switches by itself)" << std::endl;
+    std::cout << "  --conformance [--engines=scalar,lookup,blocked,opencl,adaptive] [--sizes=1x1,33x31,...] "
+            "[--rules=B3/S23,B36/S23] [--fills=random,patterns] [--seeds=1] [--threads=1,3] "
+            "[--generations=2000] [--steps=1,4]" << std::endl;
+    std::cout << "  --plane <safestate> [--generations=1000] [--out=safestate]" << std::endl;
+    std::cout << "  --replay <log> [--from=first] [--to=last] [--print=0] [--delay=33]" << std::endl;
+    std::cout << "  --export <safestate> [--generations=1000] [--every=1] [--scale=1] [--format=png] "
+            "[--ages=0] [--threads=n] [--engine=lookup] [--out=frame]" << std::endl;
+    std::cout << "  --serve <socket> [--threads=1] (resident worlds, protocol in Daemon.h)" << std::endl;
+    std::cout << "  --schedule [--worlds=16] [--size=256] [--rules=B3/S23] [--generations=1000] [--jobs=4] "
+            "[--queues=4] [--hosts=2] [--batch=32] (many worlds on one OpenCL device)" << std::endl;
+    std::cout << "  --devices (list the OpenCL devices)" << std::endl;
+    std::cout << "Devices are selected with [--device=gpu:0] and [--split=cpu:0/4,gpu:0] (split engine)." << std::endl;
+}
+
+// The daemon of --serve, stopped by SIGINT and SIGTERM.
+static Daemon* serving = NULL;
+
+static void stop_serving(int) {
+    if (serving != NULL) serving->stop();
+}
+
+// Split a comma separated list.
+static std::vector<std::string> split_list(const std::string& list) {
+    std::vector<std::string> items;
+    std::istringstream iss(list);
+    std::string item;
+    while (std::getline(iss, item, ',')) {
+        if (!item.empty()) items.push_back(item);
+    }
+    return items;
+}
+
+// Value of an option given as --name=value, or the fallback if the option is missing.
+static std::string get_option(int argc, char** argv, const std::string& name, const std::string& fallback) {
+    std::string prefix = "--" + name + "=";
+    for (int i = 2; i < argc; i++) {
+        std::string arg(argv[i]);
+        if (arg.rfind(prefix, 0) == 0) return arg.substr(prefix.size());
+    }
+    return fallback;
+}
+
+// Devices of a comma separated list (see DeviceSelection::parse).
+static std::vector<DeviceSelection> parse_devices(const std::string& list) {
+    std::vector<DeviceSelection> selections;
+    for (const std::string& item : split_list(list)) {
+        selections.push_back(DeviceSelection::parse(item));
+    }
+    return selections;
+}
+
+// Memory traffic per NUMA node of the CPU engines (see World::bandwidth_report).
+static void print_bandwidth(World& world) {
+    for (const NodeBandwidth& entry : world.bandwidth_report()) {
+        std::cout << "  node " << (entry.node >= 0 ? std::to_string(entry.node) : "-") << ": " << entry.workers
+                  << " workers, " << entry.rows << " rows, " << (int)(entry.local_pages * 100) << "% local pages, "
+                  << (entry.seconds > 0 ? entry.bytes / entry.seconds / 1e9 : 0) << " GB/s, "
+                  << (int)(entry.busy * 100) << "% busy" << std::endl;
+    }
+}
+
+// Hardware counters of the steps (see World::set_counters): totals, the slowest step and every thread.
+static void print_counters(World& world, double peak_bandwidth) {
+    StepCounters* counters = world.getCounters();
+    GenerationCounters total = counters->total();
+    if (total.steps == 0) return;
+    if (!counters->available(Counter::Cycles)) {
+        std::cout << "  counters: not available (perf_event_open refused, see /proc/sys/kernel/perf_event_paranoid)" << std::endl;
+        return;
+    }
+    CounterMetrics metrics = counters->metrics(total, peak_bandwidth);
+    std::cout << "  counters: " << total.values[Counter::Cycles] / total.steps << " cycles/generation, "
+              << metrics.cells_per_cycle << " cells/cycle, " << metrics.instructions_per_cycle << " instructions/cycle";
+    if (counters->available(Counter::CacheMisses)) {
+        std::cout << ", " << total.values[Counter::CacheMisses] / total.steps << " LLC misses/generation, "
+                  << metrics.bandwidth / 1e9 << " GB/s";
+        if (peak_bandwidth > 0) {
+            std::cout << " (" << (int)(metrics.peak_fraction * 100) << "% of " << peak_bandwidth / 1e9 << " GB/s peak)";
+        }
+    }
+    std::cout << std::endl;
+
+    const GenerationCounters& slowest = counters->getSlowest();
+    std::cout << "  slowest step: generation " << slowest.generation << ", "
+              << slowest.values[Counter::Cycles] / slowest.steps << " cycles/generation, "
+              << counters->metrics(slowest, peak_bandwidth).cells_per_cycle << " cells/cycle" << std::endl;
+
+    const std::vector<CounterValues>& threads = counters->getThreads();
+    for (size_t i = 0; i < threads.size() && threads.size() > 1; i++) {
+        std::cout << "  thread " << i << ": " << threads[i][Counter::Cycles] << " cycles, "
+                  << threads[i][Counter::Instructions] << " instructions, "
+                  << threads[i][Counter::CacheMisses] << " LLC misses" << std::endl;
+    }
+}
+
+// Engine switches of the adaptive selection (see World::set_adaptive).
+static void print_switches(EngineSelector& selector) {
+    std::cout << "adaptive: density " << selector.getDensity() << ", activity " << selector.getActivity() << ", "
+              << selector.trial_runs() << " trials, " << selector.switches().size() << " switches" << std::endl;
+    for (const EngineSwitch& entry : selector.switches()) {
+        std::cout << "  generation " << entry.generation << ": " << engine_name(entry.from) << " -> "
+                  << engine_name(entry.to) << " (density " << entry.density << ", activity " << entry.activity
+                  << ", predicted " << entry.speedup << "x)" << std::endl;
+    }
+}
+
+// Objects of the last tracked generation by kind (see World::set_tracking).
+static void print_objects(ObjectTracker& tracker) {
+    int still = 0, oscillators = 0, spaceships = 0, unknown = 0;
+    for (const TrackedObject& object : tracker.objects()) {
+        if (object.period == 0) unknown++;
+        else if (object.dx != 0 || object.dy != 0) spaceships++;
+        else if (object.period == 1) still++;
+        else oscillators++;
+    }
+    std::cout << "objects: " << still << " still, " << oscillators << " oscillators, " << spaceships
+              << " spaceships, " << unknown << " without period (" << tracker.analysis_seconds() << " s analysis, "
+              << tracker.reused_objects() << " carried over, " << tracker.segmented_objects() << " segmented)" << std::endl;
+}
+
+void CommandLineInterface::headless(int argc, char** argv) {
+    std::string mode(argv[1]);
+    if (mode == "--census") {
+        if (argc < 3) {
+            std::cout << "Kindly add the number of soups." << std::endl;
+            return;
+        }
+        uint64_t soups = std::stoull(argv[2]);
+        int threads = std::stoi(get_option(argc, argv, "threads",
+                                           std::to_string(std::max(1u, std::thread::hardware_concurrency()))));
+        int soup_size = std::stoi(get_option(argc, argv, "soup", "16"));
+        int world_size = std::stoi(get_option(argc, argv, "size", "96"));
+        uint64_t seed = std::stoull(get_option(argc, argv, "seed", std::to_string(time(0))));
+        long max_generations = std::stol(get_option(argc, argv, "generations", "20000"));
+        std::string out = get_option(argc, argv, "out", "census.txt");
+        Rule rule = Rule::parse(get_option(argc, argv, "rule", "B3/S23"));
+
+        Census census(soup_size, world_size, seed, threads, max_generations, rule);
+        census.run(soups, out);
+    } else if (mode == "--bench") {
+        // Throughput of the engines on random soups of several densities.
+        std::vector<std::string> engines = split_list(get_option(argc, argv, "engines", "scalar,lookup"));
+        std::vector<std::string> densities = split_list(get_option(argc, argv, "densities", "0.1,0.3,0.5"));
+        int size = std::stoi(get_option(argc, argv, "size", "1024"));
+        long generations = std::stol(get_option(argc, argv, "generations", "100"));
+        int threads = std::stoi(get_option(argc, argv, "threads", "1"));
+        int block_steps = std::stoi(get_option(argc, argv, "steps", "1"));
+        std::string device = get_option(argc, argv, "device", "");
+        std::string split = get_option(argc, argv, "split", "");
+        bool pin = get_option(argc, argv, "pin", "1") != "0";
+        bool numa = get_option(argc, argv, "numa", "0") != "0";
+        bool count = get_option(argc, argv, "counters", "0") != "0";
+        // Peak memory bandwidth in GB/s for the counter report, measured if not given.
+        double peak = std::stod(get_option(argc, argv, "peak", "0")) * 1e9;
+        if (count && peak <= 0) peak = StepCounters::peak_bandwidth();
+        AdaptiveOptions adaptive;
+        adaptive.interval = std::stol(get_option(argc, argv, "interval", "256"));
+
+        std::cout << "engine\tdensity\tgenerations/s\tMcells/s" << std::endl;
+        for (const std::string& density : densities) {
+            for (const std::string& name : engines) {
+                World world(size, size);
+                world.set_pinning(pin);
+                world.set_threads(threads);
+                world.set_block_steps(block_steps);
+                if (device != "") world.set_device(DeviceSelection::parse(device));
+                world.set_split_devices(parse_devices(split));
+                // adaptive starts on the lookup engine and switches by itself.
+                world.set_engine(name == "adaptive" ? Engine::Lookup : parse_engine(name));
+                world.fill_random(std::stod(density), 1);
+                world.set_counters(count);
+                if (name == "adaptive") world.set_adaptive(true, adaptive);
+
+                auto begin = std::chrono::high_resolution_clock::now();
+                world.evolve_generations(generations);
+                auto end = std::chrono::high_resolution_clock::now();
+                double seconds = std::chrono::duration<double>(end - begin).count();
+                std::cout << name << "\t" << density << "\t" << generations / seconds << "\t"
+                          << generations * (double)world.N / seconds / 1e6 << std::endl;
+                if (numa) print_bandwidth(world);
+                if (count) print_counters(world, peak);
+                if (world.getSelector() != NULL) print_switches(*world.getSelector());
+            }
+        }
+    } else if (mode == "--conformance") {
+        // Every engine against the scalar reference, per generation, with throughput.
+        std::vector<Engine> engines;
+        bool adaptive = false;
+        for (const std::string& name : split_list(get_option(argc, argv, "engines", "scalar,lookup,blocked,opencl,adaptive"))) {
+            if (name == "adaptive") adaptive = true; else engines.push_back(parse_engine(name));
+        }
+        std::vector<Rule> rules;
+        for (const std::string& rule : split_list(get_option(argc, argv, "rules", "B3/S23,B36/S23"))) {
+            rules.push_back(Rule::parse(rule));
+        }
+        std::vector<uint64_t> seeds;
+        for (const std::string& seed : split_list(get_option(argc, argv, "seeds", "1"))) {
+            seeds.push_back(std::stoull(seed));
+        }
+        std::vector<int> threads;
+        for (const std::string& count : split_list(get_option(argc, argv, "threads", "1,3"))) {
+            threads.push_back(std::stoi(count));
+        }
+        std::vector<std::string> sizes = split_list(get_option(argc, argv, "sizes",
+            "1x1,1x5,2x2,2x7,7x2,3x3,5x17,33x31,64x64,100x37,129x257,333x500"));
+        std::vector<std::string> fills = split_list(get_option(argc, argv, "fills", "random,patterns"));
+        long generations = std::stol(get_option(argc, argv, "generations", "2000"));
+        std::vector<int> block_steps;
+        for (const std::string& steps : split_list(get_option(argc, argv, "steps", "1,4"))) {
+            block_steps.push_back(std::stoi(steps));
+        }
+
+        Conformance conformance(engines, sizes, rules, fills, seeds, threads, generations, block_steps,
+                                get_option(argc, argv, "device", ""), adaptive);
+        // Non-zero exit status if any engine diverged, or an explicitly requested one was skipped, for scripts.
+        int failures = conformance.run(std::cout);
+        bool requested = get_option(argc, argv, "engines", "") != "";
+        if (failures > 0 || (requested && conformance.skipped_runs() > 0)) std::exit(1);
+    } else if (mode == "--plane") {
+        if (argc < 3) {
+            std::cout << "Kindly add the name of a safestate." << std::endl;
+            return;
+        }
+        // Load the start cells from a world file and run them on the unbounded plane.
+        std::string filename = std::string(argv[2]);
+        World start(filename);
+        PlaneWorld plane(start);
+        long generations = std::stol(get_option(argc, argv, "generations", "1000"));
+        std::string out = get_option(argc, argv, "out", "");
+
+        auto begin = std::chrono::high_resolution_clock::now();
+        for (long g = 0; g < generations; g++) {
+            plane.evolve();
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+        auto duration = std::chrono::duration_cast<std::chrono::microseconds>(end - begin);
+
+        long min_x, min_y, max_x, max_y;
+        std::cout << "Generation: " << plane.getGeneration() << std::endl;
+        std::cout << "Population: " << plane.population() << std::endl;
+        std::cout << "Chunks: " << plane.chunk_count() << " of " << PlaneWorld::CHUNK_SIZE << "x"
+                  << PlaneWorld::CHUNK_SIZE << " cells" << std::endl;
+        if (plane.bounding_box(min_x, min_y, max_x, max_y)) {
+            std::cout << "Bounding box: (" << min_x << "," << min_y << ") to (" << max_x << "," << max_y << ")" << std::endl;
+        }
+        std::cout << "Time taken to run the evolutions: " << duration.count() << " microseconds." << std::endl;
+        if (!out.empty()) plane.save_gamestate(out);
+    } else if (mode == "--replay") {
+        if (argc < 3) {
+            std::cout << "Kindly add the name of a delta log." << std::endl;
+            return;
+        }
+        // Reconstruct a range of generations of a log written with the (l)og display setting.
+        DeltaLogReader reader(argv[2]);
+        long from = std::stol(get_option(argc, argv, "from", std::to_string(reader.first_generation())));
+        long to = std::stol(get_option(argc, argv, "to", std::to_string(reader.last_generation())));
+        bool print = get_option(argc, argv, "print", "0") != "0";
+        int delay = std::stoi(get_option(argc, argv, "delay", std::to_string(FRAME_INTERVAL_MS)));
+        std::cout << "Log: " << reader.getHeight() << "x" << reader.getWidth() << ", generations "
+                  << reader.first_generation() << " to " << reader.last_generation() << ", "
+                  << reader.getRuns().size() << " keyframes" << std::endl;
+
+        World world(reader.getHeight(), reader.getWidth());
+        long frames = 0;
+        auto begin = std::chrono::high_resolution_clock::now();
+        for (long g = from; g <= to && g >= 0; g++) {
+            if (!reader.read(g, world.grid)) continue;
+            frames++;
+            if (print) {
+                std::cout << "\033[2J\033[H" << "Replay | Generation: " << g << std::endl;
+                world.print();
+                std::this_thread::sleep_for(std::chrono::milliseconds(delay));
+            }
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+        auto duration = std::chrono::duration_cast<std::chrono::microseconds>(end - begin);
+        std::cout << "Reconstructed " << frames << " generations in " << duration.count() << " microseconds." << std::endl;
+    } else if (mode == "--export") {
+        if (argc < 3) {
+            std::cout << "Kindly add the name of a safestate." << std::endl;
+            return;
+        }
+        // Evolve a world file and write every selected generation as an image.
+        std::string filename = std::string(argv[2]);
+        World world(filename);
+        long generations = std::stol(get_option(argc, argv, "generations", "1000"));
+        ExportOptions options;
+        options.every = std::stol(get_option(argc, argv, "every", "1"));
+        options.scale = std::stoi(get_option(argc, argv, "scale", "1"));
+        options.format = get_option(argc, argv, "format", "png") == "pgm" ? ImageFormat::PGM : ImageFormat::PNG;
+        options.ages = get_option(argc, argv, "ages", "0") != "0";
+        options.threads = std::stoi(get_option(argc, argv, "threads", "0"));
+        world.set_engine(parse_engine(get_option(argc, argv, "engine", "lookup")));
+
+        auto begin = std::chrono::high_resolution_clock::now();
+        world.set_export(get_option(argc, argv, "out", "frame"), options);
+        for (long g = 0; g < generations; g++) {
+            world.evolve();
+        }
+        world.getExporter()->flush();
+        auto end = std::chrono::high_resolution_clock::now();
+        auto duration = std::chrono::duration_cast<std::chrono::microseconds>(end - begin);
+        std::cout << "Wrote " << world.getExporter()->image_count() << " images of " << generations + 1
+                  << " generations in " << duration.count() << " microseconds." << std::endl;
+    } else if (mode == "--serve") {
+        if (argc < 3) {
+            std::cout << "Kindly add the path of the socket." << std::endl;
+            return;
+        }
+        // Keep worlds and their engines resident and take commands over a Unix domain socket.
+        Daemon daemon(argv[2], std::stoi(get_option(argc, argv, "threads", "1")));
+        serving = &daemon;
+        std::signal(SIGINT, stop_serving);
+        std::signal(SIGTERM, stop_serving);
+        std::cout << "Serving on " << argv[2] << std::endl;
+        daemon.run();
+        serving = NULL;
+        std::cout << "Stopped with " << daemon.world_count() << " resident worlds." << std::endl;
+    } else if (mode == "--schedule") {
+        // Many independent worlds sharing one device, every world advanced by several jobs.
+        int count = std::stoi(get_option(argc, argv, "worlds", "16"));
+        int size = std::stoi(get_option(argc, argv, "size", "256"));
+        std::vector<std::string> rules = split_list(get_option(argc, argv, "rules", "B3/S23"));
+        long generations = std::stol(get_option(argc, argv, "generations", "1000"));
+        int jobs = std::stoi(get_option(argc, argv, "jobs", "4"));
+        std::string device = get_option(argc, argv, "device", "");
+        WorldScheduler scheduler(device != "" ? DeviceSelection::parse(device) : DeviceSelection(),
+                                 std::stoi(get_option(argc, argv, "queues", "4")),
+                                 std::stoi(get_option(argc, argv, "hosts", "2")),
+                                 std::stoi(get_option(argc, argv, "batch", "32")));
+
+        std::vector<std::unique_ptr<World> > worlds;
+        for (int i = 0; i < count; i++) {
+            worlds.emplace_back(new World(size, size));
+            if (!rules.empty()) worlds.back()->set_rule(Rule::parse(rules[i % rules.size()]));
+            worlds.back()->fill_random(0.3, i + 1);
+            scheduler.add(*worlds.back());
+        }
+        auto begin = std::chrono::high_resolution_clock::now();
+        for (int j = 0; j < jobs; j++) {
+            for (int i = 0; i < count; i++) {
+                scheduler.submit(i, generations);
+            }
+        }
+        scheduler.wait_all();
+        auto end = std::chrono::high_resolution_clock::now();
+        double seconds = std::chrono::duration<double>(end - begin).count();
+
+        std::cout << "world\tjobs\tgeneration\tmean latency ms\tmax latency ms" << std::endl;
+        for (int i = 0; i < count; i++) {
+            WorldScheduler::WorldReport report = scheduler.report(i);
+            std::cout << i << "\t" << report.jobs << "\t" << worlds[i]->getGeneration() << "\t"
+                      << report.mean_latency * 1e3 << "\t" << report.max_latency * 1e3 << std::endl;
+        }
+        std::cout << "Advanced " << count << " worlds by " << jobs * generations << " generations in "
+                  << seconds << " s, " << scheduler.throughput() / 1e6 << " Mcells/s." << std::endl;
+    } else if (mode == "--devices") {
+        std::vector<DeviceInfo> devices = OpenCLWrapper::list_devices();
+        if (devices.empty()) std::cout << "No OpenCL devices found." << std::endl;
+        // Index per type, as used by --device (e.g. the second CPU device is cpu:1).
+        int gpus = 0, cpus = 0, others = 0;
+        for (size_t i = 0; i < devices.size(); i++) {
+            std::string selection;
+            if (devices[i].type & CL_DEVICE_TYPE_GPU) {
+                selection = "gpu:" + std::to_string(gpus++);
+            } else if (devices[i].type & CL_DEVICE_TYPE_CPU) {
+                selection = "cpu:" + std::to_string(cpus++);
+            } else {
+                selection = "accelerator:" + std::to_string(others++);
+            }
+            std::cout << "any:" << i << "\t" << selection << "\t" << devices[i].name << std::endl;
+        }
+    } else {
+        std::cout << "Unknown mode: " << mode << std::endl;
     }
 }
 
 // Handling user input for Game control
 void CommandLineInterface::mainMenu() {
-    this->world->init_OpenCL();
+    try {
+        this->world->init_OpenCL();
+    } catch (const std::runtime_error& e) {
+        // No OpenCL device on this node, the CPU engines still work.
+        std::cerr << e.what() << std::endl << "Using the scalar engine." << std::endl;
+        this->world->set_engine(Engine::Scalar);
+        std::this_thread::sleep_for(std::chrono::seconds(2));
+    }
 
     bool run = true;
     while (run) {
@@ -45,6 +459,12 @@ void CommandLineInterface::mainMenu() {
         std::cout << "(n)ext Generation" << std::endl;
         std::cout << "(p)lay simulation" << std::endl;
         std::cout << "(p)lay simulation for n generations" << std::endl;
+        std::cout << "(o)verlapped OpenCL run for n generations" << std::endl;
+        if (this->world->getHistory() != NULL) {
+            std::cout << "(b)ack n generations / (g)o to generation n (history: "
+                      << this->world->getHistory()->first_generation() << " to "
+                      << this->world->getHistory()->last_generation() << ")" << std::endl;
+        }
         std::cout << "(q)uit" << std::endl;
         std::string input;
         char objectType;
@@ -69,6 +489,26 @@ void CommandLineInterface::mainMenu() {
                         evolveLoop();
                     }
                     break;
+                case 'o':
+                    if (input.size() > 2) {
+                        iss.str(input.substr(2));
+                        if (iss >> n) this->overlappedRun(n);
+                    }
+                    break;
+                case 'b':
+                case 'g':
+                    if (input.size() > 2) {
+                        iss.str(input.substr(2));
+                        long target;
+                        if (iss >> target) {
+                            if (objectType == 'b') target = this->world->getGeneration() - target;
+                            if (!this->world->seek(target)) {
+                                std::cerr << "Generation " << target << " is not in the history." << std::endl;
+                                std::this_thread::sleep_for(std::chrono::seconds(2));
+                            }
+                        }
+                    }
+                    break;
                 case 'a':
                     addMenu(); // Enter the edit menu
                     break;
@@ -77,6 +517,7 @@ void CommandLineInterface::mainMenu() {
                     break;
                 case 'q':
                     run = false;
+                    if (!this->statistics_file.empty()) this->world->save_statistics(this->statistics_file);
                     saveMenu();
                     break;
                 default:
@@ -101,6 +542,11 @@ void CommandLineInterface::addMenu() {
         std::cout << "(t)oad (x,y)" << std::endl;
         std::cout << "(m)ethuselah (x,y)" << std::endl;
         std::cout << "(r)andom pattern" << std::endl;
+        std::cout << "(s)tamp library pattern (name x y [transform 0-7])" << std::endl;
+        std::cout << "(f)ill with n random library patterns (n [seed])" << std::endl;
+        std::cout << "patterns:";
+        for (const std::string& name : PatternLibrary::shared().names()) std::cout << " " << name;
+        std::cout << std::endl;
         std::cout << "(q)uit (go back to main menu)" << std::endl;
 
         std::string input;
@@ -167,6 +613,36 @@ void CommandLineInterface::addMenu() {
             case 'r':
                 this->world->randomize();
                 break;
+            case 's': {
+                std::istringstream args(input.substr(1));
+                std::string name;
+                int transform = 0;
+                if (args >> name >> x >> y) {
+                    args >> transform;
+                    try {
+                        this->world->stamp(PatternLibrary::shared().get(name), y, x, transform & 7);
+                    } catch (const std::invalid_argument& e) {
+                        std::cerr << e.what() << std::endl;
+                    }
+                }
+                break;
+            }
+            case 'f': {
+                std::istringstream args(input.substr(1));
+                long count;
+                uint64_t seed = time(0);
+                if (args >> count) {
+                    args >> seed;
+                    auto start = std::chrono::high_resolution_clock::now();
+                    this->world->fill_patterns({}, count, seed);
+                    auto stop = std::chrono::high_resolution_clock::now();
+                    std::cout << "Stamped " << count << " patterns in "
+                              << std::chrono::duration_cast<std::chrono::microseconds>(stop - start).count()
+                              << " microseconds." << std::endl;
+                    std::this_thread::sleep_for(std::chrono::seconds(2));
+                }
+                break;
+            }
             case 'q':
                 run = false;
                 break;
@@ -179,7 +655,11 @@ void CommandLineInterface::addMenu() {
 // Loop for controlling the auto play loop
 void CommandLineInterface::evolveLoop() {
     std::atomic<bool> run(true);
-    std::thread autoPlayThread(&CommandLineInterface::autoPlay, this, std::ref(run));
+    FrameSlot slot(this->world->N);
+    // Read before the simulation thread owns the world.
+    long start_generation = this->world->getGeneration();
+    std::thread simulationThread(&CommandLineInterface::simulationLoop, this, std::ref(run), std::ref(slot));
+    std::thread autoPlayThread(&CommandLineInterface::autoPlay, this, std::ref(run), std::ref(slot), start_generation);
 
     char input;
 
@@ -189,32 +669,122 @@ void CommandLineInterface::evolveLoop() {
             run = false;
         }
     }
-    // Deleting the thread
+    // Deleting the threads
+    simulationThread.join();
     autoPlayThread.join();
 };
 
-void CommandLineInterface::autoPlay(std::atomic<bool> &run) {
+void CommandLineInterface::simulationLoop(std::atomic<bool> &run, FrameSlot &slot) {
+    // The blocked and OpenCL engines only compute every block_steps-th generation, the display skips generations anyway.
+    long generations = this->world->engine == Engine::Blocked || this->world->engine == Engine::OpenCL ? this->world->block_steps : 1;
     while (run) {
-        std::cout << "\033[2J\033[H" << "Auto Play | Generation: " << this->world->getGeneration() << std::endl;
-        this->world->evolve();
+        this->world->evolve_generations(generations);
+        // The cells are only copied if they are displayed.
+        if (this->print) {
+            this->world->sync_grid();
+            std::memcpy(slot.write_buffer(), this->world->grid, sizeof(bool) * this->world->N);
+        }
+        slot.publish(this->world->getGeneration());
+        // Delay, 0 = as fast as the engine can go.
+        if (delay_in_ms > 0) std::this_thread::sleep_for(std::chrono::milliseconds(delay_in_ms));
+    }
+}
+
+void CommandLineInterface::autoPlay(std::atomic<bool> &run, FrameSlot &slot, long start_generation) {
+    long last_generation = start_generation;
+    auto last_frame = std::chrono::steady_clock::now();
+    auto next_frame = last_frame;
+    while (run) {
+        next_frame += std::chrono::milliseconds(FRAME_INTERVAL_MS);
+        std::this_thread::sleep_until(next_frame);
+        auto now = std::chrono::steady_clock::now();
+        // A slow terminal drops frames instead of catching up.
+        if (next_frame < now) next_frame = now;
+        if (!slot.acquire()) continue;
+
+        double seconds = std::chrono::duration<double>(now - last_frame).count();
+        double rate = (slot.generation() - last_generation) / seconds;
+        last_generation = slot.generation();
+        last_frame = now;
+
+        std::cout << "\033[2J\033[H" << "Auto Play | Generation: " << slot.generation()
+                  << " | " << (long)rate << " generations/s" << std::endl;
         if(this->print) {
-            this->world->print();
+            this->world->print(slot.cells());
         }
         std::cout << "(q)uit (go back to main menu)" << std::endl;
-        // Delay.
-        std::this_thread::sleep_for(std::chrono::milliseconds(delay_in_ms));
     }
 }
 
+void CommandLineInterface::overlappedRun(long generations) {
+    auto start = std::chrono::high_resolution_clock::now();
+    try {
+        // The consumer runs on its own thread while the device computes the next generations.
+        this->world->evolve_pipelined(generations, 4, [this](long generation, const bool* cells) {
+            if (this->print) {
+                std::cout << "\033[2J\033[H" << "Overlapped Run | Generation: " << generation << std::endl;
+                this->world->print(cells);
+            }
+        });
+    } catch (const std::runtime_error& e) {
+        // No OpenCL device, nothing was evolved.
+        std::cerr << e.what() << std::endl;
+        std::this_thread::sleep_for(std::chrono::seconds(2));
+        return;
+    }
+    auto stop = std::chrono::high_resolution_clock::now();
+    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(stop - start);
+    std::cout << "Time taken to run the evolutions: " << duration.count() << " microseconds." << std::endl;
+    std::this_thread::sleep_for(std::chrono::seconds(5));
+}
+
 void CommandLineInterface::displayMenu() {
     bool run = true;
     while (run) {
         std::cout << "\033[2J\033[H" << "Main Menu" << std::endl;
         if(this->print) this->world->print();
-        std::cout << "current delay: " << delay_in_ms << "\t|\tprint world update: " << this->print << std::endl;
+        std::cout << "current delay: " << delay_in_ms << "\t|\tprint world update: " << this->print
+                  << "\t|\trule: " << this->world->getRule().to_string()
+                  << "\t|\tengine: " << engine_name(this->world->engine)
+                  << (this->world->getSelector() != NULL ? " (adaptive)" : "")
+                  << "\t|\tdevice: " << this->world->device_selection.to_string()
+                  << "\t|\tblock steps: " << this->world->block_steps
+                  << "\t|\tthreads: " << (this->world->pool != NULL ? this->world->pool->size() : 1)
+                  << "\t|\tstatistics: " << (this->statistics_file.empty() ? "off" : this->statistics_file) << std::endl;
+        if (this->world->getHistory() != NULL) {
+            History* history = this->world->getHistory();
+            std::cout << "history: " << history->frame_count() << " generations, " << history->keyframe_count()
+                      << " keyframes, " << history->memory_usage() / 1024 << " KiB" << std::endl;
+        }
+        if (this->world->getLog() != NULL) {
+            std::cout << "log: " << this->world->getLog()->frame_count() << " generations, "
+                      << this->world->getLog()->byte_count() / 1024 << " KiB written" << std::endl;
+        }
+        if (this->world->getExporter() != NULL) {
+            std::cout << "export: " << this->world->getExporter()->image_count() << " images written" << std::endl;
+        }
+        if (this->world->getTracker() != NULL) print_objects(*this->world->getTracker());
+        if (this->world->getSelector() != NULL) print_switches(*this->world->getSelector());
+        if (this->world->pool != NULL) {
+            std::cout << "workers " << (this->world->pin_threads ? "pinned" : "not pinned") << ":" << std::endl;
+            print_bandwidth(*this->world);
+        }
         std::cout << std::endl;
         std::cout << "(d)elay settings (int ms)" << std::endl;
         std::cout << "(p)print world update (y/n)" << std::endl;
+        std::cout << "(r)ule (B/S notation, e.g. B36/S23)" << std::endl;
+        std::cout << "(e)ngine (opencl/scalar/lookup/split/blocked/adaptive)" << std::endl;
+        std::cout << "(k) generations per pass of the blocked and opencl engines (int)" << std::endl;
+        std::cout << "(c) OpenCL device (e.g. gpu:0, cpu:0)" << std::endl;
+        std::cout << "(m)ulti-device split (e.g. gpu:0,gpu:1 or cpu:0/4)" << std::endl;
+        std::cout << "(t)hreads of the CPU engines (int)" << std::endl;
+        std::cout << "(n)uma pinning of the CPU engine threads (y/n)" << std::endl;
+        std::cout << "(s)tatistics (file name without extension, saved on quit / n)" << std::endl;
+        std::cout << "(z)ero-copy OpenCL buffers (auto/on/off)" << std::endl;
+        std::cout << "(h)istory (keyframe interval, e.g. 64, memory bound 256 MiB / n)" << std::endl;
+        std::cout << "(o)bject tracking (longest period, e.g. 32 / n)" << std::endl;
+        std::cout << "(l)og every generation for replay (file name / n)" << std::endl;
+        std::cout << "(x) export images (prefix [every] [scale] [png/pgm] [ages] / n)" << std::endl;
         std::cout << "(q)uit" << std::endl;
         std::string input;
 
@@ -245,6 +815,135 @@ void CommandLineInterface::displayMenu() {
                 if (arr == "y") this->print = true;
                 if (arr == "n") this->print = false;
                 break;
+            case 'e':
+                try {
+                    if (arr == "adaptive") {
+                        this->world->set_adaptive(true);
+                    } else {
+                        this->world->set_engine(parse_engine(arr));
+                        this->world->set_adaptive(false);
+                    }
+                } catch (const std::invalid_argument& e) {
+                    std::cerr << e.what() << std::endl;
+                } catch (const std::runtime_error& e) {
+                    // No OpenCL device: the engine stays as it was.
+                    std::cerr << e.what() << std::endl;
+                }
+                break;
+            case 'k':
+                try {
+                    this->world->set_block_steps(std::stoi(arr));
+                } catch (const std::invalid_argument& e) {
+                    std::cerr << "Not a number" << std::endl;
+                } catch (const std::out_of_range& e) {
+
+                }
+                break;
+            case 't':
+                try {
+                    this->world->set_threads(std::stoi(arr));
+                } catch (const std::invalid_argument& e) {
+                    std::cerr << "Not a number" << std::endl;
+                } catch (const std::out_of_range& e) {
+
+                }
+                break;
+            case 'n':
+                if (arr == "y") this->world->set_pinning(true);
+                if (arr == "n") this->world->set_pinning(false);
+                break;
+            case 's':
+                if (arr == "n") {
+                    this->statistics_file = "";
+                    this->world->set_statistics(false);
+                } else if (!arr.empty()) {
+                    this->statistics_file = arr;
+                    this->world->set_statistics(true);
+                }
+                break;
+            case 'c':
+                try {
+                    this->world->set_device(DeviceSelection::parse(arr));
+                } catch (const std::invalid_argument& e) {
+                    std::cerr << e.what() << std::endl;
+                } catch (const std::runtime_error& e) {
+                    // The old context is gone, keep running on the CPU.
+                    std::cerr << e.what() << std::endl;
+                    this->world->set_engine(Engine::Scalar);
+                }
+                break;
+            case 'm':
+                try {
+                    this->world->set_split_devices(parse_devices(arr));
+                } catch (const std::invalid_argument& e) {
+                    std::cerr << e.what() << std::endl;
+                }
+                break;
+            case 'h':
+                if (arr == "n") {
+                    this->world->set_history(0, 0);
+                } else if (!arr.empty()) {
+                    try {
+                        this->world->set_history(std::stoi(arr), (size_t)256 << 20);
+                    } catch (const std::logic_error& e) {
+                        std::cerr << "Not a number" << std::endl;
+                    }
+                }
+                break;
+            case 'o':
+                if (arr == "n") {
+                    this->world->set_tracking(0);
+                } else if (!arr.empty()) {
+                    try {
+                        this->world->set_tracking(std::stoi(arr));
+                    } catch (const std::logic_error& e) {
+                        std::cerr << "Not a number" << std::endl;
+                    }
+                }
+                break;
+            case 'l':
+                try {
+                    // Keyframes every 256 generations: a seek applies at most 255 deltas.
+                    if (arr == "n") this->world->set_log("", 0);
+                    else if (!arr.empty()) this->world->set_log(arr, 256);
+                } catch (const std::runtime_error& e) {
+                    std::cerr << e.what() << std::endl;
+                }
+                break;
+            case 'x':
+                if (arr == "n") {
+                    this->world->set_export("", ExportOptions());
+                } else if (!arr.empty()) {
+                    // Optional settings after the prefix: numbers are every, then scale.
+                    ExportOptions options;
+                    std::string setting;
+                    int numbers = 0;
+                    try {
+                        while (iss >> setting) {
+                            if (setting == "png") options.format = ImageFormat::PNG;
+                            else if (setting == "pgm") options.format = ImageFormat::PGM;
+                            else if (setting == "ages") options.ages = true;
+                            else if (numbers++ == 0) options.every = std::stol(setting);
+                            else options.scale = std::stoi(setting);
+                        }
+                        this->world->set_export(arr, options);
+                    } catch (const std::logic_error& e) {
+                        std::cerr << "Not a number" << std::endl;
+                    }
+                }
+                break;
+            case 'z':
+                if (arr == "auto") this->world->set_zero_copy(ZeroCopy::Auto);
+                if (arr == "on") this->world->set_zero_copy(ZeroCopy::Enabled);
+                if (arr == "off") this->world->set_zero_copy(ZeroCopy::Disabled);
+                break;
+            case 'r':
+                try {
+                    this->world->set_rule(Rule::parse(arr));
+                } catch (const std::invalid_argument& e) {
+                    std::cerr << e.what() << std::endl;
+                }
+                break;
             case 'q':
                 run = false;
                 break;
@@ -304,14 +1003,13 @@ long CommandLineInterface::calculate_processing_time(long generations) {
     // Check only if two generations ago the grid was equal as this also catches static life.
     bool period_2_oscillator = false; 
 
-    // Disable automatic deletion of old grid after evolution
-    // - we use the old grid value before the evolution and delete it ourselves afterwards.
-    this->world->memory_safety = true;
-
-    bool* previousGrid = new bool[this->world->N];
-    // init with 2's just to make sure that twoGenerationsAgo isn't instantly equal with an empty grid
-    //std::fill_n(previousGrid, this->world->N, 2);
-    bool* twoGenerationsAgoGrid = new bool[this->world->N];
+    // Fingerprints of the last two generations instead of copies of their grids,
+    // only the tiles changed by the CPU engines are rehashed. Restored before returning.
+    bool tracked = this->world->track_tiles;
+    this->world->set_fingerprints(true);
+    uint64_t previousFingerprint = this->world->fingerprint();
+    // No generation before the first one, so the first comparison can't match.
+    uint64_t twoGenerationsAgoFingerprint = ~previousFingerprint;
 
     // Start the clock
     auto start = std::chrono::high_resolution_clock::now();
@@ -319,13 +1017,12 @@ long CommandLineInterface::calculate_processing_time(long generations) {
         std::cout << "\033[2J\033[H" 
                 << "Running the evolution for additional "
                     + std::to_string(generations-generations_done) + " generations...\n";
-        
-        // Copy the previous grid to the twoGenerationsAgo memory.
-        std::memcpy(twoGenerationsAgoGrid, previousGrid, sizeof(bool) * this->world->N);
-        // Copy the current grid (before evolution) to the previousGrid memory.
-        std::memcpy(previousGrid, this->world->grid, sizeof(bool) * this->world->N);
 
-        period_2_oscillator = this->world->are_worlds_identical(twoGenerationsAgoGrid, this->world->evolve());
+        this->world->evolve();
+        uint64_t fingerprint = this->world->fingerprint();
+        period_2_oscillator = fingerprint == twoGenerationsAgoFingerprint;
+        twoGenerationsAgoFingerprint = previousFingerprint;
+        previousFingerprint = fingerprint;
         generations_done++;
 
         if(this->print) this->world->print(); 
@@ -337,14 +1034,13 @@ long CommandLineInterface::calculate_processing_time(long generations) {
         // Delay.
         std::this_thread::sleep_for(std::chrono::milliseconds(delay_in_ms));
     }
-    delete[] previousGrid;
-    delete[] twoGenerationsAgoGrid;
 
     // Stop the clock
     auto stop = std::chrono::high_resolution_clock::now();
 
     // Calculate the duration
     auto duration = std::chrono::duration_cast<std::chrono::microseconds>(stop - start);
+    this->world->set_fingerprints(tracked);
 
     std::cout << "Time taken to run the evolutions: " 
               << duration.count()
@@ -352,9 +1048,6 @@ long CommandLineInterface::calculate_processing_time(long generations) {
 
     std::this_thread::sleep_for(std::chrono::seconds(5));
 
-    // To again automatically delete old grid after evolution.
-    this->world->memory_safety = true;
-
     return duration.count();
 }
 
@@ -1,9 +1,41 @@
-__kernel void evolve(const __global bool* grid,
-                     __global bool* newGrid,
-                     int width, int height) {
-  int x = get_global_id(0);
-  int y = get_global_id(1);
+// Life-like rule, passed as build options (-D BIRTH_MASK=... -D SURVIVE_MASK=...).
+// Bit n set: a cell with n living neighbors is born (BIRTH_MASK) or survives (SURVIVE_MASK).
+#ifndef BIRTH_MASK
+#define BIRTH_MASK 8
+#endif
+#ifndef SURVIVE_MASK
+#define SURVIVE_MASK 12
+#endif
+
+#ifndef STATS_TILE
+#define STATS_TILE 16
+#endif
+#define STATS_LOCAL (STATS_TILE * STATS_TILE)
+
+// Halo of the evolve_multi tiles, the maximum number of generations per launch (-D MULTI_STEPS=...).
+#ifndef MULTI_STEPS
+#define MULTI_STEPS 1
+#endif
+#define MULTI_SIZE (STATS_TILE + 2 * MULTI_STEPS)
 
+// New state of a cell given its state and number of living neighbors.
+inline bool apply_rule(bool alive, int determinationValue) {
+#if BIRTH_MASK == 8 && SURVIVE_MASK == 12
+  // B3/S23
+  if (determinationValue == 2) {
+    return alive;
+  } else if (determinationValue == 3) {
+    return 1;
+  } else {
+    return 0;
+  }
+#else
+  return ((alive ? SURVIVE_MASK : BIRTH_MASK) >> determinationValue) & 1;
+#endif
+}
+
+// New state of the cell (x, y).
+inline bool next_state(const __global bool* grid, int x, int y, int width, int height) {
   int determinationValue = 0;
 
   for (int dy = -1; dy <= 1; dy++) {
@@ -17,12 +49,145 @@ __kernel void evolve(const __global bool* grid,
     }
   }
 
-  if (determinationValue == 2) {
-    newGrid[y * width + x] = grid[y * width + x];
-  } else if (determinationValue == 3) {
-    newGrid[y * width + x] = 1;
-  } else {
-    newGrid[y * width + x] = 0;
+  return apply_rule(grid[y * width + x], determinationValue);
+}
+
+__kernel void evolve(const __global bool* grid,
+                     __global bool* newGrid,
+                     int width, int height) {
+  int x = get_global_id(0);
+  int y = get_global_id(1);
+
+  newGrid[y * width + x] = next_state(grid, x, y, width, height);
+}
+
+// evolve for several generations per launch: every work group loads its STATS_TILE x STATS_TILE tile
+// with a halo of MULTI_STEPS cells into local memory, advances it steps generations there
+// (the valid area shrinks by one cell per generation) and writes back the tile.
+// The global size is rounded up to whole tiles like evolve_stats.
+__kernel __attribute__((reqd_work_group_size(STATS_TILE, STATS_TILE, 1)))
+void evolve_multi(const __global bool* grid,
+                  __global bool* newGrid,
+                  int width, int height, int steps) {
+  __local uchar tile_a[MULTI_SIZE * MULTI_SIZE];
+  __local uchar tile_b[MULTI_SIZE * MULTI_SIZE];
+  __local uchar* cur = tile_a;
+  __local uchar* nxt = tile_b;
+
+  int lid = get_local_id(1) * STATS_TILE + get_local_id(0);
+  int x0 = get_group_id(0) * STATS_TILE - MULTI_STEPS;
+  int y0 = get_group_id(1) * STATS_TILE - MULTI_STEPS;
+
+  // Load the tile and its halo, wrapped around the torus (also past the edge of partial tiles).
+  for (int i = lid; i < MULTI_SIZE * MULTI_SIZE; i += STATS_LOCAL) {
+    int gx = ((x0 + i % MULTI_SIZE) % width + width) % width;
+    int gy = ((y0 + i / MULTI_SIZE) % height + height) % height;
+    cur[i] = grid[gy * width + gx];
+  }
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  for (int s = 1; s <= steps; s++) {
+    for (int i = lid; i < MULTI_SIZE * MULTI_SIZE; i += STATS_LOCAL) {
+      int rx = i % MULTI_SIZE;
+      int ry = i / MULTI_SIZE;
+      if (rx < s || ry < s || rx >= MULTI_SIZE - s || ry >= MULTI_SIZE - s) continue;
+      int determinationValue = cur[i - MULTI_SIZE - 1] + cur[i - MULTI_SIZE] + cur[i - MULTI_SIZE + 1]
+                             + cur[i - 1] + cur[i + 1]
+                             + cur[i + MULTI_SIZE - 1] + cur[i + MULTI_SIZE] + cur[i + MULTI_SIZE + 1];
+      nxt[i] = apply_rule(cur[i], determinationValue);
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+    __local uchar* swap = cur;
+    cur = nxt;
+    nxt = swap;
+  }
+
+  int x = get_global_id(0);
+  int y = get_global_id(1);
+  if (x < width && y < height) {
+    newGrid[y * width + x] = cur[(get_local_id(1) + MULTI_STEPS) * MULTI_SIZE + get_local_id(0) + MULTI_STEPS];
+  }
+}
+
+// evolve for one band of rows of a world split over several devices (DeviceSplit).
+// band holds rows + 2 rows: the halo row above, the band, the halo row below.
+// Only the band rows of newBand are written, the halos are filled in by the host.
+__kernel void evolve_band(const __global bool* band,
+                          __global bool* newBand,
+                          int width, int rows) {
+  int x = get_global_id(0);
+  int y = get_global_id(1) + 1;
+
+  // With the halos as first and last row, no row of the band wraps vertically.
+  newBand[y * width + x] = next_state(band, x, y, width, rows + 2);
+}
+
+
+// evolve with statistics: every work group is one STATS_TILE x STATS_TILE tile.
+// The tile is reduced in local memory, then one work item per group writes the tile density
+// and adds the tile to the global counters:
+// [0] population, [1] births, [2] deaths, [3] min x, [4] min y, [5] max x, [6] max y.
+// The global size is rounded up to whole tiles, work items outside the grid only take part in the reduction.
+__kernel __attribute__((reqd_work_group_size(STATS_TILE, STATS_TILE, 1)))
+void evolve_stats(const __global bool* grid,
+                  __global bool* newGrid,
+                  int width, int height,
+                  volatile __global int* counters,
+                  __global ushort* tiles) {
+  int x = get_global_id(0);
+  int y = get_global_id(1);
+  int lid = get_local_id(1) * STATS_TILE + get_local_id(0);
+
+  __local int l_population[STATS_LOCAL];
+  __local int l_births[STATS_LOCAL];
+  __local int l_deaths[STATS_LOCAL];
+  __local int l_min_x[STATS_LOCAL];
+  __local int l_min_y[STATS_LOCAL];
+  __local int l_max_x[STATS_LOCAL];
+  __local int l_max_y[STATS_LOCAL];
+
+  int alive = 0, born = 0, died = 0;
+  if (x < width && y < height) {
+    int old = grid[y * width + x];
+    alive = next_state(grid, x, y, width, height);
+    newGrid[y * width + x] = alive;
+    born = alive & !old;
+    died = old & !alive;
+  }
+  l_population[lid] = alive;
+  l_births[lid] = born;
+  l_deaths[lid] = died;
+  l_min_x[lid] = alive ? x : INT_MAX;
+  l_min_y[lid] = alive ? y : INT_MAX;
+  l_max_x[lid] = alive ? x : -1;
+  l_max_y[lid] = alive ? y : -1;
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  // Tree reduction in local memory.
+  for (int s = STATS_LOCAL / 2; s > 0; s >>= 1) {
+    if (lid < s) {
+      l_population[lid] += l_population[lid + s];
+      l_births[lid] += l_births[lid + s];
+      l_deaths[lid] += l_deaths[lid + s];
+      l_min_x[lid] = min(l_min_x[lid], l_min_x[lid + s]);
+      l_min_y[lid] = min(l_min_y[lid], l_min_y[lid + s]);
+      l_max_x[lid] = max(l_max_x[lid], l_max_x[lid + s]);
+      l_max_y[lid] = max(l_max_y[lid], l_max_y[lid + s]);
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+  }
+
+  if (lid == 0) {
+    tiles[get_group_id(1) * get_num_groups(0) + get_group_id(0)] = (ushort)l_population[0];
+    if (l_population[0] > 0) {
+      atomic_add(&counters[0], l_population[0]);
+      atomic_min(&counters[3], l_min_x[0]);
+      atomic_min(&counters[4], l_min_y[0]);
+      atomic_max(&counters[5], l_max_x[0]);
+      atomic_max(&counters[6], l_max_y[0]);
+    }
+    if (l_births[0] > 0) atomic_add(&counters[1], l_births[0]);
+    if (l_deaths[0] > 0) atomic_add(&counters[2], l_deaths[0]);
   }
 }
 